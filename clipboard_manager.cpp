@@ -1,19 +1,111 @@
+#ifdef _WIN32
 #include <windows.h>
 #include <shellapi.h>
+#include <wincrypt.h>
+#include <psapi.h>
+#include <io.h>
+#include <fcntl.h>
+#endif
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <set>
 #include <sstream>
-#include <deque>
 #include <vector>
+#include <deque>
 #include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <bitset>
+#include <cstdarg>
+#include <memory>
+#include <new>
+#include <ctime>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <regex>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+
+// Virtual-key codes used by the chord logic
+#define VK_ESCAPE 0x1B
+#define VK_RETURN 0x0D
+#define VK_TAB 0x09
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define CLIPBOARD_HAVE_SSE2 1
+#endif
+
+// AES-NI, PCLMULQDQ and SSE4.2 CRC32, enabled per function and chosen at runtime
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <wmmintrin.h>
+#include <tmmintrin.h>
+#include <nmmintrin.h>
+#define CLIPBOARD_HAVE_AESNI 1
+#endif
+
+// Heap allocations of the current thread are counted while
+// t_countAllocations is set: the replay and --check set it around
+// handleKeyEvent, as the hook path must never allocate. Only test builds
+// (-DCLIPBOARD_COUNT_ALLOCATIONS) replace new and delete to count them,
+// before any use so that every new and delete of the file pairs with these.
+thread_local bool t_countAllocations = false;
+thread_local unsigned long t_allocations = 0;
+
+#ifdef CLIPBOARD_COUNT_ALLOCATIONS
+const bool ALLOCATIONS_COUNTED = true;
+
+#ifdef __GNUC__
+#define CLIPBOARD_NOINLINE __attribute__((noinline))    // Else GCC inlines delete and flags free() on a new block
+#else
+#define CLIPBOARD_NOINLINE
+#endif
+
+void* operator new(size_t size) {
+    if (t_countAllocations) {
+        t_allocations++;
+    }
+    void* block = malloc(size ? size : 1);
+    if (block == nullptr) {
+        throw std::bad_alloc();
+    }
+    return block;
+}
+
+CLIPBOARD_NOINLINE void operator delete(void* block) noexcept {
+    free(block);
+}
+
+CLIPBOARD_NOINLINE void operator delete(void* block, size_t) noexcept {
+    free(block);
+}
+#else
+const bool ALLOCATIONS_COUNTED = false;
+#endif
 
 // ========================================
 // CLIPBOARD MANAGER - CONFIGURABLE VERSION
 // ========================================
 
-const std::string SAVE_FILE = "clipboard_slots.dat";
+std::string SAVE_FILE = "clipboard_slots.dat";
+std::string HISTORY_FILE = "clipboard_slots.history";
 
 // ID for system tray icon
 #define WM_TRAYICON (WM_USER + 1)
@@ -21,11 +113,20 @@ const std::string SAVE_FILE = "clipboard_slots.dat";
 #define ID_TRAY_ABOUT 2002
 #define ID_TRAY_TOGGLE_CONSOLE 2003
 
+// Names shared by all instances and tools
+#define OWNER_MUTEX_NAME "Local\\ClipboardManagerOwner"
+#define WINDOW_CLASS_NAME "ClipboardManager"
+
 // Global variables
+#ifdef _WIN32
 NOTIFYICONDATA nid;
 HWND g_hwnd = NULL;
 HWND g_console = NULL;
 HHOOK g_hook = NULL;
+bool g_headless = false;
+#else
+bool g_headless = true;     // No clipboard or keyboard hook outside Windows
+#endif
 bool g_running = true;
 bool g_consoleVisible = true;
 
@@ -34,6 +135,34 @@ int KEY_SAVE1 = 0xBA;      // $ by default
 int KEY_SAVE2 = 0xDD;      // £ by default
 int KEY_LOAD = 0xDE;       // ² by default
 int KEY_CLEAR = 0x43;      // C
+int KEY_UNDO = 0x5A;       // Z
+int KEY_ALIAS = 0x4E;      // N
+int KEY_TEMPLATE = 0x54;   // T
+int KEY_RANGE = 0x52;      // R
+int KEY_TYPE = 0x4B;       // K
+int KEY_TRANSFORM = 0x58;  // X
+int KEY_AUTO = 0x41;       // A
+
+// Operation letters typed after LOAD + R
+int KEY_RANGE_MOVE = 0x4D;    // M
+int KEY_RANGE_COPY = 0x43;    // C
+int KEY_RANGE_SWAP = 0x53;    // S
+int KEY_RANGE_DELETE = 0x44;  // D
+
+// Clipboard acquisition deadline (configurable with CLIPBOARD_TIMEOUT_MS)
+unsigned long CLIPBOARD_TIMEOUT_MS = 750;
+
+// Direct typing speed in characters per second (configurable with TYPE_RATE, 0 = no limit)
+unsigned long TYPE_RATE = 250;
+
+// Input idle time before background maintenance (configurable with IDLE_MAINTENANCE_MS, 0 = never)
+unsigned long IDLE_MAINTENANCE_MS = 30000;
+
+// Directory shared with other machines for slot sync (empty = no sync)
+std::string SYNC_DIR;
+
+// Near-duplicate slots written as deltas (configurable with DELTA_STORE)
+bool g_deltaStore = false;
 
 // Characters for slot keys (configurable)
 std::string SLOT_CHARS[10] = {"&", "é", "\"", "'", "(", "-", "è", "_", "ç", "à"};
@@ -52,35 +181,170 @@ int slotKeys[] = {
     0x30  // 0 or à (index 9)
 };
 
-// Key states
-std::map<int, bool> keyPressed;
-std::map<int, bool> actionExecuted;
+// Key states (one bit per virtual-key code)
+std::bitset<256> keyPressed;
+std::bitset<256> actionExecuted;
+
+// Action history (max 4), formatted in place in a fixed ring
+const size_t HISTORY_SIZE = 4;
+const size_t HISTORY_ENTRY_SIZE = 256;
+char actionHistory[HISTORY_SIZE][HISTORY_ENTRY_SIZE];
+size_t historyNext = 0;
+size_t historyCount = 0;
+std::mutex g_historyMutex;
+std::mutex g_displayMutex;
+
+// Slot number (or slot name) accumulation, fixed capacity so the hook
+// never allocates
+struct SlotDigits {
+    char digits[16] = {};
+    size_t length = 0;
+    
+    bool empty() const { return length == 0; }
+    const char* c_str() const { return digits; }
+    
+    bool overflowed = false;    // Input went past the capacity: never act on it
+    
+    void clear() {
+        length = 0;
+        digits[0] = '\0';
+        overflowed = false;
+    }
+    
+    void push(char digit) {
+        if (length + 1 < sizeof(digits)) {
+            digits[length++] = digit;
+            digits[length] = '\0';
+        } else {
+            overflowed = true;
+        }
+    }
+    
+    // Slot number according to rules: 0 alone is slot 10
+    SlotDigits finalSlot() const {
+        SlotDigits result = *this;
+        if (length == 1 && digits[0] == '0') {
+            result.clear();
+            result.push('1');
+            result.push('0');
+        }
+        return result;
+    }
+};
+
+// Operation on a block of numbered slots: [first, last] moved, copied or
+// swapped with the block starting at target, or deleted
+enum RangeKind {
+    RANGE_NONE,
+    RANGE_MOVE,
+    RANGE_COPY,
+    RANGE_SWAP,
+    RANGE_DELETE
+};
+
+// Highest slot number a range can reach (slots are sorted as int in the file)
+const unsigned long RANGE_SLOT_MAX = 999999999;
+
+struct RangeOp {
+    RangeKind kind = RANGE_NONE;
+    unsigned long first = 0;
+    unsigned long last = 0;
+    unsigned long target = 0;
+};
+
+RangeOp makeRangeOp(RangeKind kind, const unsigned long* fields, size_t count) {
+    // DELETE takes a slot or a range, the others add the target slot
+    RangeOp op;
+    if (kind == RANGE_NONE || count == 0) {
+        return op;
+    }
+    size_t blockFields = kind == RANGE_DELETE ? count : count - 1;
+    if (blockFields < 1 || blockFields > 2) {
+        return op;
+    }
+    op.kind = kind;
+    op.first = fields[0];
+    op.last = fields[blockFields - 1];
+    op.target = kind == RANGE_DELETE ? 0 : fields[count - 1];
+    return op;
+}
 
-// Action history (max 4)
-std::deque<std::string> actionHistory;
+// Range typed with LOAD + R: an operation letter, then up to three numbers
+// separated by R (LOAD + R, M, 1 1 R 5 0 0 R 1 2 = move 11-500 to 12)
+struct RangeChord {
+    RangeKind kind = RANGE_NONE;
+    unsigned long fields[3] = {};
+    size_t count = 0;         // Completed numbers
+    bool hasDigits = false;   // Digits typed for fields[count]
+    
+    void clear() {
+        kind = RANGE_NONE;
+        fields[0] = fields[1] = fields[2] = 0;
+        count = 0;
+        hasDigits = false;
+    }
+    
+    void push(char digit) {
+        if (count < 3 && fields[count] <= RANGE_SLOT_MAX / 10) {
+            fields[count] = fields[count] * 10 + (digit - '0');
+            hasDigits = true;
+        }
+    }
+    
+    void separate() {
+        if (hasDigits && count + 1 < 3) {
+            count++;
+            hasDigits = false;
+        }
+    }
+    
+    RangeOp rangeOp() const {
+        // Same rule as slot keys: 0 alone is slot 10
+        unsigned long numbers[3];
+        size_t total = count + (hasDigits ? 1 : 0);
+        for (size_t i = 0; i < total; i++) {
+            numbers[i] = fields[i] == 0 ? 10 : fields[i];
+        }
+        return makeRangeOp(kind, numbers, total);
+    }
+};
 
-// Slot number accumulation
-std::string currentSlotNumber = "";
+SlotDigits currentSlotNumber;
+SlotDigits currentAlias;
+RangeChord currentRange;
+bool isAliasMode = false;  // Slot name typed with SAVE+N or LOAD+N
 bool isAccumulatingSlot = false;
 bool isClearMode = false;  // CLEAR mode active with LOAD+C
+bool isTypeMode = false;  // Type the slot instead of loading it with LOAD+K
+bool isTransformMode = false;  // Apply the chord transforms with LOAD+X
+bool isTemplateMode = false;  // Save as template with SAVE+T
+bool isRangeMode = false;  // Range command typed with LOAD+R
 
 // ========================================
 // HISTORY MANAGEMENT
 // ========================================
 
-void addToHistory(const std::string& action) {
-    actionHistory.push_front(action);
-    if (actionHistory.size() > 4) {
-        actionHistory.pop_back();
+void addToHistory(const char* format, ...) {
+    // printf-style: the entry is formatted directly into the ring
+    std::lock_guard<std::mutex> lock(g_historyMutex);
+    va_list args;
+    va_start(args, format);
+    vsnprintf(actionHistory[historyNext], HISTORY_ENTRY_SIZE, format, args);
+    va_end(args);
+    historyNext = (historyNext + 1) % HISTORY_SIZE;
+    if (historyCount < HISTORY_SIZE) {
+        historyCount++;
     }
 }
 
 void displayHistory() {
-    if (actionHistory.empty()) {
+    std::lock_guard<std::mutex> lock(g_historyMutex);
+    if (historyCount == 0) {
         std::cout << "[No recent actions]\n" << std::endl;
     } else {
-        for (const auto& action : actionHistory) {
-            std::cout << action << std::endl;
+        // Most recent first
+        for (size_t i = 1; i <= historyCount; i++) {
+            std::cout << actionHistory[(historyNext + HISTORY_SIZE - i) % HISTORY_SIZE] << std::endl;
         }
         std::cout << std::endl;
     }
@@ -91,18 +355,22 @@ void displayHistory() {
 // ========================================
 
 void showConsole() {
+#ifdef _WIN32
     if (g_console) {
         ShowWindow(g_console, SW_SHOW);
         SetForegroundWindow(g_console);
         g_consoleVisible = true;
     }
+#endif
 }
 
 void hideConsole() {
+#ifdef _WIN32
     if (g_console) {
         ShowWindow(g_console, SW_HIDE);
         g_consoleVisible = false;
     }
+#endif
 }
 
 void toggleConsole() {
@@ -113,6 +381,185 @@ void toggleConsole() {
     }
 }
 
+// ========================================
+// PHASE TRACING
+// ========================================
+// --profile <file.json> times every phase of the actions (clipboard
+// acquisition, UTF-16 conversion, escaping, store rewrite, console
+// redraw...) and writes them as Chrome trace_event JSON on exit, to open in
+// Perfetto (ui.perfetto.dev) or chrome://tracing. Each thread appends to
+// its own buffer without locking; when tracing is off a phase costs one
+// relaxed atomic load.
+
+const size_t PHASE_BUFFER_EVENTS = 1 << 16;  // Per thread; later events are dropped
+const size_t PHASE_MAX_THREADS = 32;
+
+struct PhaseEvent {
+    const char* name;   // String literal
+    uint64_t beginNs;   // Since g_phaseEpoch
+    uint64_t endNs;
+    uint64_t bytes;     // Size handled by the phase, 0 if not meaningful
+};
+
+// Written only by its thread; count is published with release so that the
+// dump reads complete events
+struct PhaseBuffer {
+    const char* threadName;
+    std::atomic<size_t> count{0};
+    std::atomic<unsigned long> dropped{0};
+    PhaseEvent events[PHASE_BUFFER_EVENTS];
+};
+
+std::atomic<bool> g_phaseTracing(false);
+std::string g_phaseTracePath;
+std::chrono::steady_clock::time_point g_phaseEpoch;
+// The keyboard hook and action worker get buffers allocated when tracing
+// starts: a first event there must not allocate 2 MB
+enum PhaseReservedBuffer : int {
+    PHASE_BUFFER_HOOK,
+    PHASE_BUFFER_WORKER,
+    PHASE_RESERVED_BUFFERS
+};
+
+std::atomic<PhaseBuffer*> g_phaseBuffers[PHASE_MAX_THREADS];
+std::atomic<size_t> g_phaseBufferCount(PHASE_RESERVED_BUFFERS);
+
+// Shown as the thread name in the trace; set at the top of each thread
+thread_local const char* g_phaseThreadName = "thread";
+// Set at the top of the hook and worker threads
+thread_local int g_phaseReservedBuffer = -1;
+
+uint64_t phaseClockNs(std::chrono::steady_clock::time_point time = std::chrono::steady_clock::now()) {
+    return time > g_phaseEpoch ? std::chrono::duration_cast<std::chrono::nanoseconds>(time - g_phaseEpoch).count() : 0;
+}
+
+PhaseBuffer* phaseBuffer() {
+    // Reserved, or else allocated on the first event of the thread; never freed
+    thread_local PhaseBuffer* buffer = nullptr;
+    thread_local bool registered = false;
+    if (!registered) {
+        registered = true;
+        if (g_phaseReservedBuffer >= 0) {
+            buffer = g_phaseBuffers[g_phaseReservedBuffer].load(std::memory_order_acquire);
+            if (buffer != nullptr) {
+                return buffer;
+            }
+        }
+        size_t index = g_phaseBufferCount.fetch_add(1);
+        if (index < PHASE_MAX_THREADS) {
+            buffer = new PhaseBuffer();
+            buffer->threadName = g_phaseThreadName;
+            g_phaseBuffers[index].store(buffer, std::memory_order_release);
+        }
+    }
+    return buffer;
+}
+
+void recordPhase(const char* name, uint64_t beginNs, uint64_t endNs, uint64_t bytes = 0) {
+    PhaseBuffer* buffer = phaseBuffer();
+    if (buffer == nullptr) {
+        return;
+    }
+    size_t index = buffer->count.load(std::memory_order_relaxed);
+    if (index == PHASE_BUFFER_EVENTS) {
+        buffer->dropped++;
+        return;
+    }
+    buffer->events[index] = {name, beginNs, endNs, bytes};
+    buffer->count.store(index + 1, std::memory_order_release);
+}
+
+// Times the enclosing scope: PhaseScope phase("writeStoreFile");
+class PhaseScope {
+public:
+    explicit PhaseScope(const char* name, uint64_t bytes = 0)
+        : m_name(name), m_bytes(bytes), m_active(g_phaseTracing.load(std::memory_order_relaxed)) {
+        if (m_active) {
+            m_beginNs = phaseClockNs();
+        }
+    }
+    
+    ~PhaseScope() {
+        if (m_active) {
+            recordPhase(m_name, m_beginNs, phaseClockNs(), m_bytes);
+        }
+    }
+    
+    PhaseScope(const PhaseScope&) = delete;
+    PhaseScope& operator=(const PhaseScope&) = delete;
+    
+private:
+    const char* m_name;
+    uint64_t m_bytes;
+    uint64_t m_beginNs = 0;
+    bool m_active;
+};
+
+void startPhaseTracing(const std::string& path) {
+    const char* reservedNames[PHASE_RESERVED_BUFFERS] = {"keyboard hook", "action worker"};
+    for (int i = 0; i < PHASE_RESERVED_BUFFERS; i++) {
+        if (g_phaseBuffers[i].load() == nullptr) {
+            PhaseBuffer* buffer = new PhaseBuffer();
+            buffer->threadName = reservedNames[i];
+            g_phaseBuffers[i].store(buffer, std::memory_order_release);
+        }
+    }
+    g_phaseTracePath = path;
+    g_phaseEpoch = std::chrono::steady_clock::now();
+    g_phaseTracing = true;
+}
+
+bool writePhaseTrace(size_t& written, unsigned long& dropped) {
+    // Complete ("X") events, timestamps in microseconds
+    written = 0;
+    dropped = 0;
+    FILE* file = fopen(g_phaseTracePath.c_str(), "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", file);
+    fputs("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"Clipboard Manager\"}}", file);
+    size_t threads = std::min(g_phaseBufferCount.load(), PHASE_MAX_THREADS);
+    for (size_t t = 0; t < threads; t++) {
+        const PhaseBuffer* buffer = g_phaseBuffers[t].load(std::memory_order_acquire);
+        if (buffer == nullptr) {
+            continue;
+        }
+        fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%zu,\"args\":{\"name\":\"%s\"}}",
+                t + 1, buffer->threadName);
+        size_t count = buffer->count.load(std::memory_order_acquire);
+        for (size_t i = 0; i < count; i++) {
+            const PhaseEvent& event = buffer->events[i];
+            fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"phase\",\"ph\":\"X\",\"pid\":1,\"tid\":%zu,\"ts\":%.3f,\"dur\":%.3f",
+                    event.name, t + 1, event.beginNs / 1000.0, (event.endNs - event.beginNs) / 1000.0);
+            if (event.bytes > 0) {
+                fprintf(file, ",\"args\":{\"bytes\":%llu}", (unsigned long long)event.bytes);
+            }
+            fputc('}', file);
+        }
+        written += count;
+        dropped += buffer->dropped.load();
+    }
+    fputs("\n]}\n", file);
+    bool ok = ferror(file) == 0;
+    return fclose(file) == 0 && ok;
+}
+
+void stopPhaseTracing() {
+    if (!g_phaseTracing) {
+        return;
+    }
+    g_phaseTracing = false;
+    size_t written;
+    unsigned long dropped;
+    if (writePhaseTrace(written, dropped)) {
+        std::cout << "OK Phase trace: " << written << " events written to " << g_phaseTracePath
+                  << " (" << dropped << " dropped)" << std::endl;
+    } else {
+        std::cout << "XX Unable to write the phase trace to " << g_phaseTracePath << std::endl;
+    }
+}
+
 // ========================================
 // CONVERSION UTILITIES
 // ========================================
@@ -211,597 +658,9429 @@ std::string vkToChar(int vk) {
 }
 
 // ========================================
-// SAVE FILE MANAGEMENT
+// TEXT ENCODING
 // ========================================
+// UTF-8 <-> UTF-16 conversion in a single pass. Runs of ASCII are handled
+// 16 bytes at a time (SSE2) or 8 bytes at a time (portable fallback).
+// Code units are a template parameter so the same code works with the
+// 16-bit wchar_t of Windows and with char16_t elsewhere.
 
-std::string escapeString(const std::string& str) {
-    std::string result;
-    for (char c : str) {
-        if (c == '\n') result += "\\n";
-        else if (c == '\r') result += "\\r";
-        else if (c == '\\') result += "\\\\";
-        else if (c == '|') result += "\\p";
-        else result += c;
+inline size_t asciiPrefixLength(const char* data, size_t length) {
+    size_t i = 0;
+#ifdef CLIPBOARD_HAVE_SSE2
+    while (i + 16 <= length) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        if (_mm_movemask_epi8(chunk) != 0) break;
+        i += 16;
     }
-    return result;
+#endif
+    while (i + 8 <= length) {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        if (word & 0x8080808080808080ULL) break;
+        i += 8;
+    }
+    while (i < length && static_cast<unsigned char>(data[i]) < 0x80) {
+        i++;
+    }
+    return i;
 }
 
-std::string unescapeString(const std::string& str) {
-    std::string result;
-    for (size_t i = 0; i < str.length(); i++) {
-        if (str[i] == '\\' && i + 1 < str.length()) {
-            if (str[i + 1] == 'n') { result += '\n'; i++; }
-            else if (str[i + 1] == 'r') { result += '\r'; i++; }
-            else if (str[i + 1] == '\\') { result += '\\'; i++; }
-            else if (str[i + 1] == 'p') { result += '|'; i++; }
-            else result += str[i];
+// Decodes the sequence at data[i]; returns its length in bytes (1 for an
+// invalid byte, in which case codepoint is set to U+FFFD)
+inline size_t decodeUtf8(const unsigned char* data, size_t i, size_t length, uint32_t& codepoint) {
+    unsigned char lead = data[i];
+    size_t needed;
+    uint32_t minimum;
+    if (lead < 0x80) { codepoint = lead; return 1; }
+    else if (lead >= 0xC2 && lead <= 0xDF) { needed = 1; codepoint = lead & 0x1F; minimum = 0x80; }
+    else if (lead >= 0xE0 && lead <= 0xEF) { needed = 2; codepoint = lead & 0x0F; minimum = 0x800; }
+    else if (lead >= 0xF0 && lead <= 0xF4) { needed = 3; codepoint = lead & 0x07; minimum = 0x10000; }
+    else { codepoint = 0xFFFD; return 1; }
+    
+    if (i + needed >= length) {
+        codepoint = 0xFFFD;
+        return 1;
+    }
+    for (size_t k = 1; k <= needed; k++) {
+        unsigned char next = data[i + k];
+        if ((next & 0xC0) != 0x80) {
+            codepoint = 0xFFFD;
+            return 1;
+        }
+        codepoint = (codepoint << 6) | (next & 0x3F);
+    }
+    // Reject overlong forms, surrogates and values beyond U+10FFFF
+    if (codepoint < minimum || (codepoint >= 0xD800 && codepoint <= 0xDFFF) || codepoint > 0x10FFFF) {
+        codepoint = 0xFFFD;
+        return 1;
+    }
+    return needed + 1;
+}
+
+bool utf8Validate(const char* data, size_t length) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    size_t i = 0;
+    while (i < length) {
+        i += asciiPrefixLength(data + i, length - i);
+        if (i >= length) break;
+        uint32_t codepoint;
+        size_t consumed = decodeUtf8(bytes, i, length, codepoint);
+        if (consumed == 1) {
+            // Only an invalid sequence decodes to a single non-ASCII byte
+            return false;
+        }
+        i += consumed;
+    }
+    return true;
+}
+
+// dst must hold at least length code units; returns the number written.
+// Invalid sequences are replaced with U+FFFD.
+template <typename Char16>
+size_t utf8ToUtf16(const char* src, size_t length, Char16* dst) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(src);
+    size_t i = 0;
+    size_t out = 0;
+    while (i < length) {
+#ifdef CLIPBOARD_HAVE_SSE2
+        if (sizeof(Char16) == 2) {
+            const __m128i zero = _mm_setzero_si128();
+            while (i + 16 <= length) {
+                __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+                if (_mm_movemask_epi8(chunk) != 0) break;
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + out), _mm_unpacklo_epi8(chunk, zero));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + out + 8), _mm_unpackhi_epi8(chunk, zero));
+                i += 16;
+                out += 16;
+            }
+        }
+#endif
+        size_t ascii = asciiPrefixLength(src + i, length - i);
+        for (size_t k = 0; k < ascii; k++) {
+            dst[out++] = static_cast<Char16>(bytes[i + k]);
+        }
+        i += ascii;
+        if (i >= length) break;
+        
+        uint32_t codepoint;
+        i += decodeUtf8(bytes, i, length, codepoint);
+        if (codepoint >= 0x10000) {
+            codepoint -= 0x10000;
+            dst[out++] = static_cast<Char16>(0xD800 + (codepoint >> 10));
+            dst[out++] = static_cast<Char16>(0xDC00 + (codepoint & 0x3FF));
         } else {
-            result += str[i];
+            dst[out++] = static_cast<Char16>(codepoint);
         }
     }
-    return result;
+    return out;
 }
 
-void loadKeyConfiguration() {
-    std::ifstream file(SAVE_FILE);
-    if (!file.is_open()) {
-        return;
+// dst must hold at least 3 * length bytes; returns the number written.
+// Unpaired surrogates are replaced with U+FFFD.
+template <typename Char16>
+size_t utf16ToUtf8(const Char16* src, size_t length, char* dst) {
+    size_t i = 0;
+    size_t out = 0;
+    while (i < length) {
+#ifdef CLIPBOARD_HAVE_SSE2
+        if (sizeof(Char16) == 2) {
+            const __m128i highBits = _mm_set1_epi16(static_cast<short>(0xFF80));
+            const __m128i zero = _mm_setzero_si128();
+            while (i + 8 <= length) {
+                __m128i units = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+                if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(units, highBits), zero)) != 0xFFFF) break;
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + out), _mm_packus_epi16(units, units));
+                i += 8;
+                out += 8;
+            }
+        }
+#endif
+        uint32_t unit = static_cast<uint32_t>(src[i]) & 0xFFFF;
+        if (unit < 0x80) {
+            dst[out++] = static_cast<char>(unit);
+            i++;
+            continue;
+        }
+        
+        uint32_t codepoint = unit;
+        i++;
+        if (unit >= 0xD800 && unit <= 0xDBFF && i < length) {
+            uint32_t low = static_cast<uint32_t>(src[i]) & 0xFFFF;
+            if (low >= 0xDC00 && low <= 0xDFFF) {
+                codepoint = 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00);
+                i++;
+            } else {
+                codepoint = 0xFFFD;
+            }
+        } else if (unit >= 0xD800 && unit <= 0xDFFF) {
+            codepoint = 0xFFFD;
+        }
+        
+        if (codepoint < 0x800) {
+            dst[out++] = static_cast<char>(0xC0 | (codepoint >> 6));
+            dst[out++] = static_cast<char>(0x80 | (codepoint & 0x3F));
+        } else if (codepoint < 0x10000) {
+            dst[out++] = static_cast<char>(0xE0 | (codepoint >> 12));
+            dst[out++] = static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+            dst[out++] = static_cast<char>(0x80 | (codepoint & 0x3F));
+        } else {
+            dst[out++] = static_cast<char>(0xF0 | (codepoint >> 18));
+            dst[out++] = static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F));
+            dst[out++] = static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+            dst[out++] = static_cast<char>(0x80 | (codepoint & 0x3F));
+        }
     }
+    return out;
+}
+
+template <typename Char16>
+void utf16ToUtf8(const Char16* src, size_t length, std::string& out) {
+    out.resize(length * 3);
+    out.resize(utf16ToUtf8(src, length, &out[0]));
+}
+
+// Console preview of at most maxCodepoints characters: line breaks and tabs
+// become spaces and longer content ends with "...". Only the displayed
+// characters (plus one to detect truncation) are read, never the rest of
+// the payload, and multi-byte characters are never split. With escaped set,
+// data is read in its file form (escapeString) and decoded on the fly.
+// out must hold PREVIEW_BUFFER_SIZE(maxCodepoints) bytes; the result is
+// NUL-terminated and its length returned.
+#define PREVIEW_BUFFER_SIZE(maxCodepoints) ((maxCodepoints) * 4 + 1)
+
+size_t buildPreview(const char* data, size_t length, size_t maxCodepoints, bool escaped, char* out) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    size_t written = 0;
+    size_t cutBytes = 0;    // Preview size when the text must be truncated
+    size_t count = 0;
+    size_t i = 0;
     
-    std::string line;
-    while (std::getline(file, line)) {
-        // Load key configuration
-        if (line.substr(0, 10) == "KEY_SAVE1=") {
-            std::string value = line.substr(10);
-            KEY_SAVE1 = hexToInt(value);
+    while (i < length) {
+        if (count == maxCodepoints - 3) {
+            cutBytes = written;
         }
-        else if (line.substr(0, 10) == "KEY_SAVE2=") {
-            std::string value = line.substr(10);
-            KEY_SAVE2 = hexToInt(value);
+        if (count == maxCodepoints) {
+            // More characters remain: truncate and mark
+            memcpy(out + cutBytes, "...", 4);
+            return cutBytes + 3;
         }
-        else if (line.substr(0, 9) == "KEY_LOAD=") {
-            std::string value = line.substr(9);
-            KEY_LOAD = hexToInt(value);
+        
+        unsigned char c = bytes[i];
+        if (escaped && c == '\\' && i + 1 < length) {
+            char next = data[i + 1];
+            if (next == 'n' || next == 'r') { out[written++] = ' '; i += 2; count++; continue; }
+            if (next == '\\') { out[written++] = '\\'; i += 2; count++; continue; }
+            if (next == 'p') { out[written++] = '|'; i += 2; count++; continue; }
         }
-        else if (line.substr(0, 11) == "SLOT_CHARS=") {
-            std::string value = line.substr(11);
-            // Parse comma-separated characters
-            std::stringstream ss(value);
-            std::string token;
-            int idx = 0;
-            while (std::getline(ss, token, ',') && idx < 10) {
-                SLOT_CHARS[idx] = token;
-                idx++;
+        if (c == '\n' || c == '\r' || c == '\t') {
+            out[written++] = ' ';
+            i++;
+        } else if (c < 0x80) {
+            out[written++] = static_cast<char>(c);
+            i++;
+        } else {
+            // An invalid byte shows as U+FFFD, so the preview stays valid UTF-8
+            uint32_t codepoint;
+            size_t consumed = decodeUtf8(bytes, i, length, codepoint);
+            if (consumed == 1) {
+                memcpy(out + written, "\xEF\xBF\xBD", 3);
+                written += 3;
+            } else {
+                memcpy(out + written, data + i, consumed);
+                written += consumed;
             }
+            i += consumed;
         }
-        else if (line.substr(0, 4) == "SLOT") {
-            // We've reached the slots, stop
-            break;
-        }
+        count++;
     }
+    out[written] = '\0';
+    return written;
+}
+
+std::string buildPreview(const std::string& text, size_t maxCodepoints, bool escaped = false) {
+    std::string preview(PREVIEW_BUFFER_SIZE(maxCodepoints), '\0');
+    preview.resize(buildPreview(text.data(), text.size(), maxCodepoints, escaped, &preview[0]));
+    return preview;
+}
+
+// ========================================
+// SLOT ALIASES
+// ========================================
+// Slots can be given names made of letters and digits. Names live in a
+// trie: resolving one costs O(name length) whatever the number of slots,
+// and the subtree under a prefix gives completion while keys are held.
+// Only the action worker touches the trie once the hook is installed.
+
+const int ALIAS_ALPHABET = 36;      // a-z then 0-9
+
+struct AliasTrieNode {
+    int children[ALIAS_ALPHABET];
+    int aliasCount = 0;             // Names ending in this subtree
+    std::string slot;               // Target slot if a name ends here
     
-    file.close();
+    AliasTrieNode() {
+        std::fill(children, children + ALIAS_ALPHABET, -1);
+    }
+};
+
+std::vector<AliasTrieNode> g_aliasTrie(1);          // Node 0 is the root
+std::map<std::string, std::string> g_slotAliases;   // Slot -> name, for display
+
+int aliasCharIndex(char c) {
+    c = (char)tolower((unsigned char)c);
+    if (c >= 'a' && c <= 'z') return c - 'a';
+    if (c >= '0' && c <= '9') return 26 + (c - '0');
+    return -1;
 }
 
-void initializeSaveFile() {
-    std::ifstream testFile(SAVE_FILE);
-    if (testFile.is_open()) {
-        testFile.close();
-        // Load configuration from existing file
-        loadKeyConfiguration();
+bool isValidAlias(const std::string& name) {
+    if (name.empty()) {
+        return false;
+    }
+    for (char c : name) {
+        if (aliasCharIndex(c) < 0) return false;
+    }
+    return true;
+}
+
+int findAliasNode(const std::string& prefix) {
+    int node = 0;
+    for (char c : prefix) {
+        int index = aliasCharIndex(c);
+        if (index < 0) return -1;
+        node = g_aliasTrie[node].children[index];
+        if (node < 0) return -1;
+    }
+    return node;
+}
+
+void removeAlias(const std::string& name) {
+    // Its nodes stay in the trie, with no name left below them
+    int node = findAliasNode(name);
+    if (node < 0 || g_aliasTrie[node].slot.empty()) {
+        return;
+    }
+    g_slotAliases.erase(g_aliasTrie[node].slot);
+    g_aliasTrie[node].slot.clear();
+    node = 0;
+    g_aliasTrie[0].aliasCount--;
+    for (char c : name) {
+        node = g_aliasTrie[node].children[aliasCharIndex(c)];
+        g_aliasTrie[node].aliasCount--;
+    }
+}
+
+void insertAlias(const std::string& alias, const std::string& slotNum) {
+    if (!isValidAlias(alias)) {
         return;
     }
+    std::string name = alias;
+    std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return (char)tolower(c); });
     
-    // Create file with default configuration and 10 empty slots
-    std::ofstream file(SAVE_FILE, std::ios::out | std::ios::trunc);
-    if (!file.is_open()) {
-        std::cerr << "ERROR: Unable to create save file" << std::endl;
-        MessageBoxA(NULL, "Unable to create save file!", "Error", MB_ICONERROR);
+    // A slot has one name: a new one renames it
+    auto previous = g_slotAliases.find(slotNum);
+    if (previous != g_slotAliases.end() && previous->second != name) {
+        removeAlias(previous->second);
+    }
+    
+    int existing = findAliasNode(name);
+    if (existing >= 0 && !g_aliasTrie[existing].slot.empty()) {
+        // Known name: only its target changes
+        g_slotAliases.erase(g_aliasTrie[existing].slot);
+        g_aliasTrie[existing].slot = slotNum;
+        g_slotAliases[slotNum] = name;
         return;
     }
     
-    // Write key configuration
-    file << "# ========================================" << std::endl;
-    file << "# KEY CONFIGURATION" << std::endl;
-    file << "# ========================================" << std::endl;
-    file << "# Three formats are accepted:" << std::endl;
-    file << "#   1. SINGLE LETTER     : KEY_SAVE1=A      (simplest!)" << std::endl;
-    file << "#   2. HEXADECIMAL CODE  : KEY_SAVE1=0x41   (technical format)" << std::endl;
-    file << "#   3. DECIMAL CODE      : KEY_SAVE1=65     (alternative format)" << std::endl;
-    file << "#" << std::endl;
-    file << "# Examples of simple letters:" << std::endl;
-    file << "#   Letters : A, B, C, D ... Z" << std::endl;
-    file << "#   Digits  : 0, 1, 2 ... 9 (warning: not for SAVE/LOAD!)" << std::endl;
-    file << "#   Symbols : [ ] \\ ; ' , . / - = `" << std::endl;
-    file << "#" << std::endl;
-    file << "# Concrete examples:" << std::endl;
-    file << "#   To use the A key : KEY_SAVE1=A" << std::endl;
-    file << "#   To use the [ key : KEY_SAVE1=[" << std::endl;
-    file << "#   To use the ; key : KEY_SAVE1=;" << std::endl;
-    file << "#" << std::endl;
-    file << "# Common VK codes (if hexadecimal format needed):" << std::endl;
-    file << "#   Letters A-Z : 0x41 to 0x5A" << std::endl;
-    file << "#   Digits 0-9  : 0x30 to 0x39" << std::endl;
-    file << "#   $ or ;      : 0xBA" << std::endl;
-    file << "#   ^ or '      : 0xDE" << std::endl;
-    file << "#   L or ]      : 0xDD" << std::endl;
-    file << "#   [ or {      : 0xDB" << std::endl;
-    file << "#" << std::endl;
-    file << "# Save key 1 (default: $ = 0xBA)" << std::endl;
-    file << "KEY_SAVE1=" << intToHex(KEY_SAVE1) << std::endl;
-    file << "#" << std::endl;
-    file << "# Save key 2 (default: L = 0xDD)" << std::endl;
-    file << "KEY_SAVE2=" << intToHex(KEY_SAVE2) << std::endl;
-    file << "#" << std::endl;
-    file << "# Load key (default: ^ = 0xDE)" << std::endl;
-    file << "KEY_LOAD=" << intToHex(KEY_LOAD) << std::endl;
-    file << "#" << std::endl;
-    file << "# Characters displayed for slots 1-10 (keys with Shift)" << std::endl;
-    file << "# You can change them to match your keyboard" << std::endl;
-    file << "SLOT_CHARS=&,é,\",',\\(,-,è,_,ç,à" << std::endl;
-    file << "#" << std::endl;
-    file << "# ========================================" << std::endl;
-    file << "# CLIPBOARD SLOTS" << std::endl;
-    file << "# ========================================" << std::endl;
-    file << "#" << std::endl;
+    int node = 0;
+    g_aliasTrie[0].aliasCount++;
+    for (char c : name) {
+        int index = aliasCharIndex(c);
+        if (g_aliasTrie[node].children[index] < 0) {
+            g_aliasTrie[node].children[index] = (int)g_aliasTrie.size();
+            g_aliasTrie.emplace_back();
+        }
+        node = g_aliasTrie[node].children[index];
+        g_aliasTrie[node].aliasCount++;
+    }
+    g_aliasTrie[node].slot = slotNum;
+    g_slotAliases[slotNum] = name;
+}
+
+bool resolveAlias(const std::string& name, std::string& slotNum) {
+    int node = findAliasNode(name);
+    if (node < 0 || g_aliasTrie[node].slot.empty()) {
+        return false;
+    }
+    slotNum = g_aliasTrie[node].slot;
+    return true;
+}
+
+int completeAlias(const std::string& prefix, std::string& name, std::string& slotNum) {
+    // Returns the number of names starting with prefix; when it is exactly
+    // one, name and slotNum receive it
+    int node = findAliasNode(prefix);
+    if (node < 0) {
+        return 0;
+    }
+    int matches = g_aliasTrie[node].aliasCount;
+    if (matches != 1) {
+        return matches;
+    }
     
-    // Create 10 empty slots
-    for (int i = 1; i <= 10; i++) {
-        file << "SLOT" << i << "|" << std::endl;
+    // Single name below: follow the only branch down to it
+    name = prefix;
+    while (g_aliasTrie[node].slot.empty()) {
+        for (int index = 0; index < ALIAS_ALPHABET; index++) {
+            int child = g_aliasTrie[node].children[index];
+            if (child >= 0 && g_aliasTrie[child].aliasCount > 0) {
+                name += (char)(index < 26 ? 'a' + index : '0' + (index - 26));
+                node = child;
+                break;
+            }
+        }
     }
+    slotNum = g_aliasTrie[node].slot;
+    return 1;
+}
+
+void clearAliases() {
+    g_aliasTrie.assign(1, AliasTrieNode());
+    g_slotAliases.clear();
+}
+
+std::string aliasOfSlot(const std::string& slotNum) {
+    auto it = g_slotAliases.find(slotNum);
+    return it == g_slotAliases.end() ? "" : it->second;
+}
+
+// ========================================
+// SNIPPET TEMPLATES
+// ========================================
+// A slot saved with SAVE+T is a template: {date}, {time}, {clip} (current
+// clipboard text) and {counter} are replaced when it is loaded, and {{
+// and }} give a literal { and }. The text is parsed once into a list of operations
+// whose literals point into the source, so expansion is one pass of
+// memcpy into a buffer sized beforehand.
+
+enum TemplateOpKind {
+    TEMPLATE_LITERAL,
+    TEMPLATE_DATE,
+    TEMPLATE_TIME,
+    TEMPLATE_CLIP,
+    TEMPLATE_COUNTER
+};
+
+struct TemplateOp {
+    TemplateOpKind kind;
+    size_t offset;          // Literal: position in the source
+    size_t length;
+};
+
+struct CompiledTemplate {
+    std::shared_ptr<const std::string> source;
+    std::vector<TemplateOp> ops;
+    size_t literalBytes = 0;
+    bool usesClipboard = false;
+    unsigned long counter = 0;  // Per session
+};
+
+std::set<std::string> g_templateSlots;                  // Persisted as TEMPLATE|slot
+std::map<std::string, CompiledTemplate> g_compiledTemplates;
+
+CompiledTemplate compileTemplate(const std::shared_ptr<const std::string>& source) {
+    static const struct { const char* name; TemplateOpKind kind; } placeholders[] = {
+        {"{date}", TEMPLATE_DATE}, {"{time}", TEMPLATE_TIME}, {"{clip}", TEMPLATE_CLIP}, {"{counter}", TEMPLATE_COUNTER}
+    };
     
-    file.close();
+    CompiledTemplate compiled;
+    compiled.source = source;
+    const std::string& text = *source;
+    size_t literalStart = 0;
+    
+    auto flushLiteral = [&](size_t end) {
+        if (end > literalStart) {
+            compiled.ops.push_back({TEMPLATE_LITERAL, literalStart, end - literalStart});
+            compiled.literalBytes += end - literalStart;
+        }
+    };
+    
+    size_t i = text.find_first_of("{}");
+    while (i != std::string::npos) {
+        size_t next = i + 1;
+        if (text.compare(i, 2, "{{") == 0 || text.compare(i, 2, "}}") == 0) {
+            // Escaped brace: keep one
+            flushLiteral(i + 1);
+            literalStart = next = i + 2;
+        } else if (text[i] == '{') {
+            for (const auto& placeholder : placeholders) {
+                size_t length = strlen(placeholder.name);
+                if (text.compare(i, length, placeholder.name) == 0) {
+                    flushLiteral(i);
+                    compiled.ops.push_back({placeholder.kind, 0, 0});
+                    compiled.usesClipboard = compiled.usesClipboard || placeholder.kind == TEMPLATE_CLIP;
+                    literalStart = next = i + length;
+                    break;
+                }
+            }
+        }
+        i = text.find_first_of("{}", next);
+    }
+    flushLiteral(text.size());
+    return compiled;
 }
 
-std::string readSlotFromFile(const std::string& slotNum) {
-    std::ifstream file(SAVE_FILE);
-    if (!file.is_open()) {
-        return "";
+std::string expandTemplate(CompiledTemplate& compiled, const std::string& clipboard) {
+    char date[16];
+    char timeOfDay[16];
+    char counter[24];
+    time_t now = time(nullptr);
+    struct tm local = *localtime(&now);
+    size_t dateLength = strftime(date, sizeof(date), "%Y-%m-%d", &local);
+    size_t timeLength = strftime(timeOfDay, sizeof(timeOfDay), "%H:%M:%S", &local);
+    size_t counterLength = (size_t)snprintf(counter, sizeof(counter), "%lu", ++compiled.counter);
+    
+    // Exact size first, then a single copy pass
+    size_t total = compiled.literalBytes;
+    for (const auto& op : compiled.ops) {
+        switch (op.kind) {
+            case TEMPLATE_LITERAL: break;
+            case TEMPLATE_DATE:    total += dateLength; break;
+            case TEMPLATE_TIME:    total += timeLength; break;
+            case TEMPLATE_CLIP:    total += clipboard.size(); break;
+            case TEMPLATE_COUNTER: total += counterLength; break;
+        }
     }
     
-    std::string line;
-    std::string targetPrefix = "SLOT" + slotNum + "|";
+    std::string result(total, '\0');
+    char* out = &result[0];
+    const char* source = compiled.source->data();
+    for (const auto& op : compiled.ops) {
+        switch (op.kind) {
+            case TEMPLATE_LITERAL: memcpy(out, source + op.offset, op.length); out += op.length; break;
+            case TEMPLATE_DATE:    memcpy(out, date, dateLength); out += dateLength; break;
+            case TEMPLATE_TIME:    memcpy(out, timeOfDay, timeLength); out += timeLength; break;
+            case TEMPLATE_CLIP:    memcpy(out, clipboard.data(), clipboard.size()); out += clipboard.size(); break;
+            case TEMPLATE_COUNTER: memcpy(out, counter, counterLength); out += counterLength; break;
+        }
+    }
+    return result;
+}
+
+void setTemplateMark(std::vector<std::string>& configLines, const std::string& slotNum, bool isTemplate) {
+    // Keeps the TEMPLATE|slot lines of the file in sync with g_templateSlots
+    std::string markLine = "TEMPLATE|" + slotNum;
+    auto it = std::find(configLines.begin(), configLines.end(), markLine);
+    if (isTemplate && it == configLines.end()) {
+        configLines.push_back(markLine);
+    } else if (!isTemplate && it != configLines.end()) {
+        configLines.erase(it);
+    }
+    if (isTemplate) {
+        g_templateSlots.insert(slotNum);
+    } else {
+        g_templateSlots.erase(slotNum);
+    }
+    g_compiledTemplates.erase(slotNum);
+}
+
+// ========================================
+// PASTE TRANSFORMS
+// ========================================
+// TRANSFORM|<slot>|<steps> cleans a slot up on every LOAD of it, and
+// TRANSFORM|chord|<steps> on LOAD + X only. Steps are separated by '|':
+//   trim    leading and trailing whitespace of the whole text
+//   crlf    CRLF line breaks to LF
+//   rstrip  spaces and tabs at the end of each line
+//   upper   upper case (ASCII and Latin-1 letters), lower: lower case
+//   s/regex/replacement/[i]   replacement in each line ($1... for groups)
+// A chain is compiled once when the configuration is read (regexes
+// included) and runs as a pipeline of stages: the text goes through all of
+// them in one pass, each stage handing its output spans to the next.
+
+enum TransformKind {
+    TRANSFORM_TRIM,
+    TRANSFORM_CRLF,
+    TRANSFORM_RSTRIP,
+    TRANSFORM_UPPER,
+    TRANSFORM_LOWER,
+    TRANSFORM_REPLACE
+};
+
+struct TransformStep {
+    TransformKind kind;
+    std::shared_ptr<const std::regex> pattern;   // TRANSFORM_REPLACE only
+    std::string replacement;
+};
+
+typedef std::vector<TransformStep> TransformChain;
+
+std::map<std::string, TransformChain> g_slotTransforms;   // TRANSFORM|slot|...
+TransformChain g_chordTransform;                          // TRANSFORM|chord|...
+
+bool parseTransformChain(const std::string& text, TransformChain& chain, std::string& error) {
+    // A replacement may contain '|' (regex alternation): it ends at its
+    // third delimiter, not at the next '|'
+    static const struct { const char* name; TransformKind kind; } names[] = {
+        {"trim", TRANSFORM_TRIM}, {"crlf", TRANSFORM_CRLF}, {"rstrip", TRANSFORM_RSTRIP},
+        {"upper", TRANSFORM_UPPER}, {"lower", TRANSFORM_LOWER}
+    };
     
-    while (std::getline(file, line)) {
-        // Ignore configuration lines and comments
-        if (line.empty() || line[0] == '#' || line.substr(0, 4) == "KEY_" || line.substr(0, 10) == "SLOT_CHARS") {
+    chain.clear();
+    size_t pos = 0;
+    while (pos < text.size()) {
+        if (text[pos] == 's' && pos + 1 < text.size() && !isalnum((unsigned char)text[pos + 1])) {
+            char delimiter = text[pos + 1];
+            std::string parts[2];
+            size_t i = pos + 2;
+            for (int part = 0; part < 2; part++) {
+                while (i < text.size() && text[i] != delimiter) {
+                    if (text[i] == '\\' && i + 1 < text.size() && text[i + 1] == delimiter) {
+                        i++;
+                    }
+                    parts[part] += text[i++];
+                }
+                if (i == text.size()) {
+                    error = "unterminated " + text.substr(pos);
+                    return false;
+                }
+                i++;
+            }
+            auto flags = std::regex::ECMAScript | std::regex::optimize;
+            while (i < text.size() && text[i] != '|') {
+                if (text[i] != 'i') {
+                    error = std::string("unknown flag ") + text[i];
+                    return false;
+                }
+                flags |= std::regex::icase;
+                i++;
+            }
+            try {
+                chain.push_back({TRANSFORM_REPLACE, std::make_shared<const std::regex>(parts[0], flags), parts[1]});
+            } catch (const std::regex_error&) {
+                error = "invalid regex " + parts[0];
+                return false;
+            }
+            pos = i + 1;
             continue;
         }
         
-        if (line.substr(0, targetPrefix.length()) == targetPrefix) {
-            std::string content = line.substr(targetPrefix.length());
-            file.close();
-            return unescapeString(content);
+        size_t end = text.find('|', pos);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        std::string name = text.substr(pos, end - pos);
+        bool known = false;
+        for (const auto& entry : names) {
+            if (name == entry.name) {
+                chain.push_back({entry.kind, nullptr, ""});
+                known = true;
+                break;
+            }
+        }
+        if (!known) {
+            error = "unknown step " + name;
+            return false;
         }
+        pos = end + 1;
     }
-    
-    file.close();
-    return "";
+    return true;
 }
 
-bool writeSlotToFile(const std::string& slotNum, const std::string& content) {
-    // Read entire file
-    std::ifstream fileIn(SAVE_FILE);
-    if (!fileIn.is_open()) {
-        return false;
+void loadTransformLine(const std::string& line) {
+    // TRANSFORM|<slot or chord>|<steps>
+    size_t pipePos = line.find('|', 10);
+    if (pipePos == std::string::npos) {
+        return;
+    }
+    std::string target = line.substr(10, pipePos - 10);
+    TransformChain chain;
+    std::string error;
+    if (!parseTransformChain(line.substr(pipePos + 1), chain, error)) {
+        std::cerr << "ERROR: TRANSFORM|" << target << ": " << error << std::endl;
+        return;
+    }
+    if (target == "chord") {
+        g_chordTransform = chain;
+    } else {
+        g_slotTransforms[target] = chain;
     }
+}
+
+// One stage of a running pipeline: receives spans, passes its output on
+class TransformStage {
+public:
+    virtual ~TransformStage() {}
+    virtual void write(const char* data, size_t length) = 0;
     
-    std::vector<std::string> configLines;
-    std::map<std::string, std::string> slots;
-    std::string line;
+    virtual void finish() {
+        if (m_next) {
+            m_next->finish();
+        }
+    }
     
-    while (std::getline(fileIn, line)) {
-        // Save configuration lines
-        if (line.empty() || line[0] == '#' || line.substr(0, 4) == "KEY_" || line.substr(0, 10) == "SLOT_CHARS") {
-            configLines.push_back(line);
+    void setNext(TransformStage* next) {
+        m_next = next;
+    }
+    
+protected:
+    TransformStage* m_next = nullptr;
+};
+
+class StringSink : public TransformStage {
+public:
+    explicit StringSink(std::string& out) : m_out(out) {}
+    
+    void write(const char* data, size_t length) override {
+        m_out.append(data, length);
+    }
+    
+private:
+    std::string& m_out;
+};
+
+class CrlfStage : public TransformStage {
+public:
+    void write(const char* data, size_t length) override {
+        // A '\r' ending a span waits for the first byte of the next one
+        const char* end = data + length;
+        if (m_pendingCr && length > 0) {
+            m_pendingCr = false;
+            if (*data != '\n') {
+                m_next->write("\r", 1);
+            }
         }
-        else {
-            size_t pipePos = line.find('|');
-            if (pipePos != std::string::npos && line.substr(0, 4) == "SLOT") {
-                std::string key = line.substr(4, pipePos - 4);
-                std::string value = line.substr(pipePos + 1);
-                slots[key] = value;
+        while (data < end) {
+            const char* cr = static_cast<const char*>(memchr(data, '\r', end - data));
+            if (cr == nullptr) {
+                m_next->write(data, end - data);
+                return;
             }
+            m_next->write(data, cr - data);
+            if (cr + 1 == end) {
+                m_pendingCr = true;
+                return;
+            }
+            if (cr[1] != '\n') {
+                m_next->write("\r", 1);
+            }
+            data = cr + 1;
         }
     }
-    fileIn.close();
-    
-    // Update or add slot
-    slots[slotNum] = escapeString(content);
     
-    // Write entire file
-    std::ofstream fileOut(SAVE_FILE, std::ios::out | std::ios::trunc);
-    if (!fileOut.is_open()) {
-        return false;
+    void finish() override {
+        if (m_pendingCr) {
+            m_next->write("\r", 1);
+            m_pendingCr = false;
+        }
+        TransformStage::finish();
     }
     
-    // Write configuration lines
-    for (const auto& configLine : configLines) {
-        fileOut << configLine << std::endl;
+private:
+    bool m_pendingCr = false;
+};
+
+class CaseStage : public TransformStage {
+public:
+    explicit CaseStage(bool upper) : m_upper(upper) {}
+    
+    void write(const char* data, size_t length) override {
+        // Latin-1 letters are 0xC3 followed by 0x80-0x9E (upper) or
+        // 0xA0-0xBE (lower), except x and / signs at 0x97 and 0xB7
+        char buffer[4096];
+        while (length > 0) {
+            size_t count = std::min(length, sizeof(buffer));
+            for (size_t i = 0; i < count; i++) {
+                unsigned char c = (unsigned char)data[i];
+                if (m_afterLatin1Lead) {
+                    if (m_upper && c >= 0xA0 && c <= 0xBE && c != 0xB7) c -= 0x20;
+                    else if (!m_upper && c >= 0x80 && c <= 0x9E && c != 0x97) c += 0x20;
+                } else if (m_upper ? (c >= 'a' && c <= 'z') : (c >= 'A' && c <= 'Z')) {
+                    c ^= 0x20;
+                }
+                m_afterLatin1Lead = c == 0xC3;
+                buffer[i] = (char)c;
+            }
+            m_next->write(buffer, count);
+            data += count;
+            length -= count;
+        }
     }
     
-    // First write slots 1-10 in order
-    for (int i = 1; i <= 10; i++) {
-        std::string key = std::to_string(i);
-        if (slots.find(key) != slots.end()) {
-            fileOut << "SLOT" << key << "|" << slots[key] << std::endl;
+private:
+    bool m_upper;
+    bool m_afterLatin1Lead = false;
+};
+
+class TrailingSpaceStage : public TransformStage {
+public:
+    // wholeText: trim (whitespace before the first and after the last
+    // visible character); otherwise rstrip (spaces and tabs before each
+    // line break). A run of spaces is held back until it is known whether
+    // something visible follows it.
+    explicit TrailingSpaceStage(bool wholeText) : m_wholeText(wholeText), m_leading(wholeText) {}
+    
+    void write(const char* data, size_t length) override {
+        const char* end = data + length;
+        const char* flushed = data;
+        const char* spaceRun = nullptr;
+        for (const char* p = data; p < end; p++) {
+            char c = *p;
+            bool isBreak = c == '\n' || c == '\r';
+            if (c == ' ' || c == '\t' || (isBreak && m_wholeText)) {
+                if (m_leading) {
+                    flushed = p + 1;
+                } else if (spaceRun == nullptr) {
+                    spaceRun = p;
+                }
+                continue;
+            }
+            m_leading = false;
+            if (isBreak) {
+                // rstrip: the run before a line break is dropped
+                m_next->write(flushed, (spaceRun ? spaceRun : p) - flushed);
+                m_pending.clear();
+                flushed = p;
+            } else if (!m_pending.empty()) {
+                // Something visible follows the held run: it is kept, and
+                // nothing of this span has been passed on yet
+                m_next->write(m_pending.data(), m_pending.size());
+                m_pending.clear();
+            }
+            spaceRun = nullptr;
+        }
+        if (spaceRun) {
+            m_next->write(flushed, spaceRun - flushed);
+            m_pending.append(spaceRun, end - spaceRun);
         } else {
-            fileOut << "SLOT" << key << "|" << std::endl;
+            m_next->write(flushed, end - flushed);
         }
     }
     
-    // Then write all other slots (sorted numerically if possible)
-    std::vector<std::pair<std::string, std::string>> otherSlots;
-    for (const auto& slot : slots) {
-        try {
-            int num = std::stoi(slot.first);
-            if (num < 1 || num > 10) {
-                otherSlots.push_back(slot);
+    void finish() override {
+        m_pending.clear();
+        TransformStage::finish();
+    }
+    
+private:
+    bool m_wholeText;
+    bool m_leading;             // trim only: nothing visible seen yet
+    std::string m_pending;      // Spaces that ended the previous span
+};
+
+class ReplaceStage : public TransformStage {
+public:
+    ReplaceStage(const std::regex& pattern, const std::string& replacement)
+        : m_pattern(pattern), m_replacement(replacement) {}
+    
+    void write(const char* data, size_t length) override {
+        // Whole lines are replaced in place; only a line cut by the end of
+        // a span is copied
+        const char* end = data + length;
+        while (data < end) {
+            const char* newline = static_cast<const char*>(memchr(data, '\n', end - data));
+            if (newline == nullptr) {
+                m_line.append(data, end - data);
+                return;
             }
-        } catch (...) {
-            otherSlots.push_back(slot);
+            if (m_line.empty()) {
+                replaceLine(data, newline);
+            } else {
+                m_line.append(data, newline - data);
+                replaceLine(m_line.data(), m_line.data() + m_line.size());
+                m_line.clear();
+            }
+            m_next->write("\n", 1);
+            data = newline + 1;
         }
     }
     
-    // Sort other slots
-    std::sort(otherSlots.begin(), otherSlots.end(), [](const auto& a, const auto& b) {
-        try {
-            int numA = std::stoi(a.first);
-            int numB = std::stoi(b.first);
-            return numA < numB;
-        } catch (...) {
-            return a.first < b.first;
+    void finish() override {
+        if (!m_line.empty()) {
+            replaceLine(m_line.data(), m_line.data() + m_line.size());
+            m_line.clear();
         }
-    });
+        TransformStage::finish();
+    }
     
-    for (const auto& slot : otherSlots) {
-        fileOut << "SLOT" << slot.first << "|" << slot.second << std::endl;
+private:
+    void replaceLine(const char* begin, const char* end) {
+        // A CRLF line is matched without its '\r'
+        bool cr = end > begin && end[-1] == '\r';
+        m_output.clear();
+        std::regex_replace(std::back_inserter(m_output), begin, end - (cr ? 1 : 0), m_pattern, m_replacement);
+        if (cr) {
+            m_output += '\r';
+        }
+        m_next->write(m_output.data(), m_output.size());
     }
     
-    fileOut.close();
+    const std::regex& m_pattern;
+    const std::string& m_replacement;
+    std::string m_line;
+    std::string m_output;
+};
+
+std::vector<std::unique_ptr<TransformStage>> buildTransformPipeline(const std::vector<const TransformStep*>& steps,
+                                                                    std::string& result) {
+    // One stage per step, the last one appending to result
+    std::vector<std::unique_ptr<TransformStage>> stages;
+    for (const TransformStep* step : steps) {
+        switch (step->kind) {
+            case TRANSFORM_TRIM:    stages.emplace_back(new TrailingSpaceStage(true)); break;
+            case TRANSFORM_CRLF:    stages.emplace_back(new CrlfStage()); break;
+            case TRANSFORM_RSTRIP:  stages.emplace_back(new TrailingSpaceStage(false)); break;
+            case TRANSFORM_UPPER:   stages.emplace_back(new CaseStage(true)); break;
+            case TRANSFORM_LOWER:   stages.emplace_back(new CaseStage(false)); break;
+            case TRANSFORM_REPLACE: stages.emplace_back(new ReplaceStage(*step->pattern, step->replacement)); break;
+        }
+    }
+    stages.emplace_back(new StringSink(result));
+    for (size_t i = 0; i + 1 < stages.size(); i++) {
+        stages[i]->setNext(stages[i + 1].get());
+    }
+    return stages;
+}
+
+bool transformSlotContent(const std::string& slotNum, bool chordTransform, std::string& content) {
+    // Slot chain, then the chord chain; false (content untouched) if none
+    std::vector<const TransformStep*> steps;
+    auto slotChain = g_slotTransforms.find(slotNum);
+    if (slotChain != g_slotTransforms.end()) {
+        for (const auto& step : slotChain->second) steps.push_back(&step);
+    }
+    if (chordTransform) {
+        for (const auto& step : g_chordTransform) steps.push_back(&step);
+    }
+    if (steps.empty()) {
+        return false;
+    }
+    
+    PhaseScope phase("transform", content.size());
+    std::string result;
+    result.reserve(content.size());
+    auto stages = buildTransformPipeline(steps, result);
+    stages.front()->write(content.data(), content.size());
+    stages.front()->finish();
+    content.swap(result);
+    return true;
+}
+
+// ========================================
+// CONTENT CLASSIFICATION
+// ========================================
+// SAVE + A saves the clipboard into the next free slot of the bank of its
+// category. The category comes from the first CLASSIFY_PREFIX_BYTES of the
+// text (and its last bytes for JSON), so a 10 MB clipboard costs no more
+// than a short one. The prefix is scanned once, 16 bytes at a time (SSE2),
+// counting the byte classes the rules below look at; per-lane counters
+// are summed every 255 blocks. Every saved slot gets its category in the
+// slot metadata. Banks can be moved with AUTO_BANK|<category>|<first>-<last>.
+
+enum ContentCategory : uint8_t {
+    CATEGORY_NONE,     // Empty, or saved before classification existed
+    CATEGORY_URL,
+    CATEGORY_PATH,
+    CATEGORY_NUMBER,
+    CATEGORY_JSON,
+    CATEGORY_CODE,
+    CATEGORY_TEXT,
+    CATEGORY_COUNT
+};
+
+const char* const CATEGORY_NAMES[] = {"", "url", "path", "number", "json", "code", "text"};
+static_assert(sizeof(CATEGORY_NAMES) / sizeof(CATEGORY_NAMES[0]) == CATEGORY_COUNT, "one name per category");
+
+const size_t CLASSIFY_PREFIX_BYTES = 4096;
+const size_t CLASSIFY_NUMBER_MAX = 64;     // Longer digit runs are IDs or data, kept as text
+
+struct AutoBank {
+    unsigned long first;
+    unsigned long last;
+};
+
+AutoBank g_autoBanks[CATEGORY_COUNT] = {
+    {0, 0}, {100, 199}, {200, 299}, {300, 399}, {400, 499}, {500, 599}, {600, 699}
+};
+
+// Byte classes counted over the prefix
+enum ByteClass {
+    BYTE_DIGIT = 1,       // 0-9
+    BYTE_BLANK = 2,       // Space, tab, CR
+    BYTE_NEWLINE = 4,
+    BYTE_CODE = 8,        // ; { } ( ) = < >
+    BYTE_NUMERIC = 16,    // + - . , e E (signs, separators, exponent)
+    BYTE_SLASH = 32,      // / and backslash
+    BYTE_QUOTE = 64       // "
+};
+
+struct ByteClassCounts {
+    size_t digit = 0;
+    size_t blank = 0;
+    size_t newline = 0;
+    size_t code = 0;
+    size_t numeric = 0;
+    size_t slash = 0;
+    size_t quote = 0;
+};
+
+uint8_t byteClassOf(unsigned char c) {
+    if (c >= '0' && c <= '9') return BYTE_DIGIT;
+    switch (c) {
+        case ' ': case '\t': case '\r': return BYTE_BLANK;
+        case '\n': return BYTE_NEWLINE;
+        case ';': case '{': case '}': case '(': case ')': case '=': case '<': case '>': return BYTE_CODE;
+        case '+': case '-': case '.': case ',': case 'e': case 'E': return BYTE_NUMERIC;
+        case '/': case '\\': return BYTE_SLASH;
+        case '"': return BYTE_QUOTE;
+        default: return 0;
+    }
+}
+
+void countByteClassesPortable(const unsigned char* data, size_t length, ByteClassCounts& counts) {
+    for (size_t i = 0; i < length; i++) {
+        uint8_t cls = byteClassOf(data[i]);
+        counts.digit += (cls & BYTE_DIGIT) != 0;
+        counts.blank += (cls & BYTE_BLANK) != 0;
+        counts.newline += (cls & BYTE_NEWLINE) != 0;
+        counts.code += (cls & BYTE_CODE) != 0;
+        counts.numeric += (cls & BYTE_NUMERIC) != 0;
+        counts.slash += (cls & BYTE_SLASH) != 0;
+        counts.quote += (cls & BYTE_QUOTE) != 0;
+    }
+}
+
+#ifdef CLIPBOARD_HAVE_SSE2
+inline size_t sumByteLanes(__m128i lanes) {
+    __m128i sums = _mm_sad_epu8(lanes, _mm_setzero_si128());
+    return (size_t)_mm_cvtsi128_si32(sums) + (size_t)_mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+}
+
+inline __m128i bytesEqual(__m128i chunk, char c) {
+    return _mm_cmpeq_epi8(chunk, _mm_set1_epi8(c));
+}
+#endif
+
+void countByteClasses(const unsigned char* data, size_t length, ByteClassCounts& counts) {
+    size_t i = 0;
+#ifdef CLIPBOARD_HAVE_SSE2
+    // A matching lane is -1: subtracting the mask counts it in that lane
+    const __m128i zeroDigit = _mm_set1_epi8('0');
+    const __m128i nineDigit = _mm_set1_epi8('9');
+    while (i + 16 <= length) {
+        __m128i digit = _mm_setzero_si128(), blank = digit, newline = digit, code = digit;
+        __m128i numeric = digit, slash = digit, quote = digit;
+        for (int blocks = 0; blocks < 255 && i + 16 <= length; blocks++, i += 16) {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            __m128i clamped = _mm_min_epu8(_mm_max_epu8(chunk, zeroDigit), nineDigit);
+            digit = _mm_sub_epi8(digit, _mm_cmpeq_epi8(chunk, clamped));
+            blank = _mm_sub_epi8(blank, _mm_or_si128(bytesEqual(chunk, ' '),
+                                        _mm_or_si128(bytesEqual(chunk, '\t'), bytesEqual(chunk, '\r'))));
+            newline = _mm_sub_epi8(newline, bytesEqual(chunk, '\n'));
+            __m128i codeMask = _mm_or_si128(_mm_or_si128(bytesEqual(chunk, ';'), bytesEqual(chunk, '=')),
+                                            _mm_or_si128(bytesEqual(chunk, '<'), bytesEqual(chunk, '>')));
+            codeMask = _mm_or_si128(codeMask, _mm_or_si128(bytesEqual(chunk, '{'), bytesEqual(chunk, '}')));
+            // ( and ) differ in bit 0 only
+            codeMask = _mm_or_si128(codeMask, bytesEqual(_mm_or_si128(chunk, _mm_set1_epi8(1)), ')'));
+            code = _mm_sub_epi8(code, codeMask);
+            __m128i numericMask = _mm_or_si128(_mm_or_si128(bytesEqual(chunk, '+'), bytesEqual(chunk, '-')),
+                                               _mm_or_si128(bytesEqual(chunk, '.'), bytesEqual(chunk, ',')));
+            // e and E differ in bit 5 only
+            numericMask = _mm_or_si128(numericMask, bytesEqual(_mm_or_si128(chunk, _mm_set1_epi8(0x20)), 'e'));
+            numeric = _mm_sub_epi8(numeric, numericMask);
+            slash = _mm_sub_epi8(slash, _mm_or_si128(bytesEqual(chunk, '/'), bytesEqual(chunk, '\\')));
+            quote = _mm_sub_epi8(quote, bytesEqual(chunk, '"'));
+        }
+        counts.digit += sumByteLanes(digit);
+        counts.blank += sumByteLanes(blank);
+        counts.newline += sumByteLanes(newline);
+        counts.code += sumByteLanes(code);
+        counts.numeric += sumByteLanes(numeric);
+        counts.slash += sumByteLanes(slash);
+        counts.quote += sumByteLanes(quote);
+    }
+#endif
+    countByteClassesPortable(data + i, length - i, counts);
+}
+
+bool startsWithNoCase(const char* data, size_t length, const char* prefix) {
+    size_t prefixLength = strlen(prefix);
+    if (length < prefixLength) {
+        return false;
+    }
+    for (size_t i = 0; i < prefixLength; i++) {
+        if (tolower((unsigned char)data[i]) != prefix[i]) {
+            return false;
+        }
+    }
     return true;
 }
 
-void clearNonPrimarySlots() {
-    std::ifstream fileIn(SAVE_FILE);
-    if (!fileIn.is_open()) {
-        return;
-    }
+ContentCategory classifyContent(const char* data, size_t length) {
+    // Surrounding whitespace ignored; only the prefix is counted
+    auto isSpace = [](char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; };
+    while (length > 0 && isSpace(*data)) {
+        data++;
+        length--;
+    }
+    while (length > 0 && isSpace(data[length - 1])) {
+        length--;
+    }
+    if (length == 0) {
+        return CATEGORY_NONE;
+    }
+    size_t scanned = std::min(length, CLASSIFY_PREFIX_BYTES);
+    ByteClassCounts counts;
+    countByteClasses(reinterpret_cast<const unsigned char*>(data), scanned, counts);
+    bool singleLine = counts.newline == 0;
+    
+    // A single word starting with a scheme
+    static const char* const schemes[] = {"http://", "https://", "ftp://", "file://", "mailto:", "www."};
+    for (const char* scheme : schemes) {
+        if (startsWithNoCase(data, length, scheme)) {
+            if (singleLine && counts.blank == 0) {
+                return CATEGORY_URL;
+            }
+            break;
+        }
+    }
+    
+    // C:\..., C:/..., \\server\..., /usr/..., ~/..., ./... on one line
+    bool drive = length >= 3 && isalpha((unsigned char)data[0]) && data[1] == ':' && (data[2] == '\\' || data[2] == '/');
+    bool rooted = (data[0] == '\\' && length > 2 && data[1] == '\\') || (data[0] == '/' && (length == 1 || data[1] != '/')) ||
+                  (length > 1 && data[0] == '~' && data[1] == '/') ||
+                  (length > 1 && data[0] == '.' && (data[1] == '/' || data[1] == '\\' ||
+                                                    (length > 2 && data[1] == '.' && (data[2] == '/' || data[2] == '\\'))));
+    if ((drive || rooted) && singleLine && length == scanned && counts.blank * 8 <= length) {
+        return CATEGORY_PATH;
+    }
+    
+    // Digits with signs, separators and exponents only: 42, -1.5e3, 1 234,56
+    if (length <= CLASSIFY_NUMBER_MAX && counts.digit > 0 && counts.digit + counts.numeric + counts.blank == length) {
+        return CATEGORY_NUMBER;
+    }
+    
+    // Brackets that match at both ends, with strings or numbers inside
+    char last = data[length - 1];
+    if (((data[0] == '{' && last == '}') || (data[0] == '[' && last == ']')) && (counts.quote >= 2 || counts.digit > 0 || length == 2)) {
+        return CATEGORY_JSON;
+    }
+    
+    // Several lines dense in code punctuation
+    if (!singleLine && counts.code >= 4 && counts.code * 40 >= scanned) {
+        return CATEGORY_CODE;
+    }
+    return CATEGORY_TEXT;
+}
+
+ContentCategory classifyContent(const std::string& content) {
+    return classifyContent(content.data(), content.size());
+}
+
+void loadAutoBankLine(const std::string& line) {
+    // AUTO_BANK|<category>|<first>-<last>
+    size_t pipePos = line.find('|', 10);
+    std::string name = line.substr(10, pipePos == std::string::npos ? std::string::npos : pipePos - 10);
+    std::string block = pipePos == std::string::npos ? "" : line.substr(pipePos + 1);
+    size_t dash = block.find('-');
+    for (int category = CATEGORY_URL; category < CATEGORY_COUNT; category++) {
+        if (name != CATEGORY_NAMES[category]) {
+            continue;
+        }
+        try {
+            unsigned long first = std::stoul(block.substr(0, dash));
+            unsigned long last = dash == std::string::npos ? first : std::stoul(block.substr(dash + 1));
+            if (first >= 1 && first <= last && last <= RANGE_SLOT_MAX) {
+                g_autoBanks[category] = {first, last};
+                return;
+            }
+        } catch (...) {
+        }
+        break;
+    }
+    std::cerr << "ERROR: Invalid AUTO_BANK line: " << line << std::endl;
+}
+
+// ========================================
+// STORE ENCRYPTION
+// ========================================
+// With CLIPBOARD_ENCRYPT=1 each slot record is sealed on its own with
+// AES-256-GCM, so a LOAD opens only the record it reads. The slot number is
+// authenticated with the record: a record moved to another slot fails to
+// open. AES-NI and PCLMULQDQ are used when the CPU has them, a table-driven
+// implementation otherwise. The key lives next to the save file, protected
+// by DPAPI on Windows (a plain 0600 key file elsewhere, for tests).
+//
+// Record: "\e" base64(nonce[12] | ciphertext | tag[16])
+
+const size_t GCM_NONCE_SIZE = 12;
+const size_t GCM_TAG_SIZE = 16;
+
+struct GcmKey {
+    uint32_t roundKeys[60];             // AES-256 schedule, 15 round keys
+    uint8_t roundKeyBytes[240];         // Same, in byte order (AES-NI)
+    uint64_t tableHigh[16];             // 4-bit GHASH tables (portable path)
+    uint64_t tableLow[16];
+    uint8_t hashKey[16];                // H = AES(key, 0)
+    bool hardware;
+};
+
+bool g_encryptStore = false;
+bool g_storeKeyReady = false;
+GcmKey g_storeKey;
+
+struct AesTables {
+    uint8_t sbox[256];
+    uint32_t te[4][256];
+    
+    AesTables() {
+        // S-box from the multiplicative inverse and the affine map, walking
+        // GF(2^8) by powers of 3 (p) and 3^-1 (q)
+        auto rotate = [](uint8_t x, int shift) { return (uint8_t)((x << shift) | (x >> (8 - shift))); };
+        uint8_t p = 1, q = 1;
+        do {
+            p = (uint8_t)(p ^ (p << 1) ^ ((p & 0x80) ? 0x1B : 0));
+            q ^= (uint8_t)(q << 1);
+            q ^= (uint8_t)(q << 2);
+            q ^= (uint8_t)(q << 4);
+            if (q & 0x80) q ^= 0x09;
+            sbox[p] = (uint8_t)(q ^ rotate(q, 1) ^ rotate(q, 2) ^ rotate(q, 3) ^ rotate(q, 4) ^ 0x63);
+        } while (p != 1);
+        sbox[0] = 0x63;
+        
+        for (int i = 0; i < 256; i++) {
+            uint32_t s = sbox[i];
+            uint32_t s2 = ((s << 1) ^ ((s & 0x80) ? 0x1B : 0)) & 0xFF;
+            uint32_t word = (s2 << 24) | (s << 16) | (s << 8) | (s2 ^ s);
+            for (int t = 0; t < 4; t++) {
+                te[t][i] = word;
+                word = (word >> 8) | (word << 24);
+            }
+        }
+    }
+};
+
+const AesTables& aesTables() {
+    static const AesTables tables;
+    return tables;
+}
+
+inline uint32_t loadBe32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+inline void storeBe32(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24); p[1] = (uint8_t)(v >> 16); p[2] = (uint8_t)(v >> 8); p[3] = (uint8_t)v;
+}
+
+inline uint64_t loadBe64(const uint8_t* p) {
+    return ((uint64_t)loadBe32(p) << 32) | loadBe32(p + 4);
+}
+
+inline void storeBe64(uint8_t* p, uint64_t v) {
+    storeBe32(p, (uint32_t)(v >> 32));
+    storeBe32(p + 4, (uint32_t)v);
+}
+
+void aesEncryptBlock(const GcmKey& key, const uint8_t in[16], uint8_t out[16]) {
+    const AesTables& t = aesTables();
+    const uint32_t* rk = key.roundKeys;
+    uint32_t s0 = loadBe32(in) ^ rk[0], s1 = loadBe32(in + 4) ^ rk[1];
+    uint32_t s2 = loadBe32(in + 8) ^ rk[2], s3 = loadBe32(in + 12) ^ rk[3];
+    
+    for (int round = 1; round < 14; round++) {
+        rk += 4;
+        uint32_t t0 = t.te[0][s0 >> 24] ^ t.te[1][(s1 >> 16) & 0xFF] ^ t.te[2][(s2 >> 8) & 0xFF] ^ t.te[3][s3 & 0xFF] ^ rk[0];
+        uint32_t t1 = t.te[0][s1 >> 24] ^ t.te[1][(s2 >> 16) & 0xFF] ^ t.te[2][(s3 >> 8) & 0xFF] ^ t.te[3][s0 & 0xFF] ^ rk[1];
+        uint32_t t2 = t.te[0][s2 >> 24] ^ t.te[1][(s3 >> 16) & 0xFF] ^ t.te[2][(s0 >> 8) & 0xFF] ^ t.te[3][s1 & 0xFF] ^ rk[2];
+        uint32_t t3 = t.te[0][s3 >> 24] ^ t.te[1][(s0 >> 16) & 0xFF] ^ t.te[2][(s1 >> 8) & 0xFF] ^ t.te[3][s2 & 0xFF] ^ rk[3];
+        s0 = t0; s1 = t1; s2 = t2; s3 = t3;
+    }
+    
+    rk += 4;
+    const uint8_t* sb = t.sbox;
+    storeBe32(out, (((uint32_t)sb[s0 >> 24] << 24) | ((uint32_t)sb[(s1 >> 16) & 0xFF] << 16) | ((uint32_t)sb[(s2 >> 8) & 0xFF] << 8) | sb[s3 & 0xFF]) ^ rk[0]);
+    storeBe32(out + 4, (((uint32_t)sb[s1 >> 24] << 24) | ((uint32_t)sb[(s2 >> 16) & 0xFF] << 16) | ((uint32_t)sb[(s3 >> 8) & 0xFF] << 8) | sb[s0 & 0xFF]) ^ rk[1]);
+    storeBe32(out + 8, (((uint32_t)sb[s2 >> 24] << 24) | ((uint32_t)sb[(s3 >> 16) & 0xFF] << 16) | ((uint32_t)sb[(s0 >> 8) & 0xFF] << 8) | sb[s1 & 0xFF]) ^ rk[2]);
+    storeBe32(out + 12, (((uint32_t)sb[s3 >> 24] << 24) | ((uint32_t)sb[(s0 >> 16) & 0xFF] << 16) | ((uint32_t)sb[(s1 >> 8) & 0xFF] << 8) | sb[s2 & 0xFF]) ^ rk[3]);
+}
+
+void ghashMultiply(const GcmKey& key, uint8_t x[16]) {
+    // x = x * H, 4 bits at a time (Shoup's method)
+    static const uint64_t reduce[16] = {
+        0x0000, 0x1C20, 0x3840, 0x2460, 0x7080, 0x6CA0, 0x48C0, 0x54E0,
+        0xE100, 0xFD20, 0xD940, 0xC560, 0x9180, 0x8DA0, 0xA9C0, 0xB5E0
+    };
+    uint8_t low = x[15] & 0x0F;
+    uint64_t zh = key.tableHigh[low];
+    uint64_t zl = key.tableLow[low];
+    
+    for (int i = 15; i >= 0; i--) {
+        low = x[i] & 0x0F;
+        uint8_t high = x[i] >> 4;
+        if (i != 15) {
+            uint8_t rem = (uint8_t)(zl & 0x0F);
+            zl = (zh << 60) | (zl >> 4);
+            zh = (zh >> 4) ^ (reduce[rem] << 48) ^ key.tableHigh[low];
+            zl ^= key.tableLow[low];
+        }
+        uint8_t rem = (uint8_t)(zl & 0x0F);
+        zl = (zh << 60) | (zl >> 4);
+        zh = (zh >> 4) ^ (reduce[rem] << 48) ^ key.tableHigh[high];
+        zl ^= key.tableLow[high];
+    }
+    storeBe64(x, zh);
+    storeBe64(x + 8, zl);
+}
+
+void ghashPortable(const GcmKey& key, uint8_t state[16], const uint8_t* data, size_t length) {
+    while (length > 0) {
+        size_t chunk = length < 16 ? length : 16;
+        for (size_t i = 0; i < chunk; i++) {
+            state[i] ^= data[i];
+        }
+        ghashMultiply(key, state);
+        data += chunk;
+        length -= chunk;
+    }
+}
+
+void ctrPortable(const GcmKey& key, uint8_t counter[16], const uint8_t* in, uint8_t* out, size_t length) {
+    uint8_t stream[16];
+    uint32_t block = loadBe32(counter + 12);
+    while (length > 0) {
+        storeBe32(counter + 12, block++);
+        aesEncryptBlock(key, counter, stream);
+        size_t chunk = length < 16 ? length : 16;
+        for (size_t i = 0; i < chunk; i++) {
+            out[i] = in[i] ^ stream[i];
+        }
+        in += chunk;
+        out += chunk;
+        length -= chunk;
+    }
+    storeBe32(counter + 12, block);
+}
+
+#ifdef CLIPBOARD_HAVE_AESNI
+__attribute__((target("aes,ssse3")))
+void ctrHardware(const GcmKey& key, uint8_t counter[16], const uint8_t* in, uint8_t* out, size_t length) {
+    __m128i rk[15];
+    for (int i = 0; i < 15; i++) {
+        rk[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(key.roundKeyBytes + 16 * i));
+    }
+    
+    // Four counter blocks in flight hide the AESENC latency
+    uint32_t block = loadBe32(counter + 12);
+    uint8_t counters[64];
+    for (int i = 0; i < 4; i++) {
+        memcpy(counters + 16 * i, counter, 12);
+    }
+    
+    while (length >= 64) {
+        for (int i = 0; i < 4; i++) {
+            storeBe32(counters + 16 * i + 12, block++);
+        }
+        __m128i b0 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(counters)), rk[0]);
+        __m128i b1 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(counters + 16)), rk[0]);
+        __m128i b2 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(counters + 32)), rk[0]);
+        __m128i b3 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(counters + 48)), rk[0]);
+        for (int round = 1; round < 14; round++) {
+            b0 = _mm_aesenc_si128(b0, rk[round]);
+            b1 = _mm_aesenc_si128(b1, rk[round]);
+            b2 = _mm_aesenc_si128(b2, rk[round]);
+            b3 = _mm_aesenc_si128(b3, rk[round]);
+        }
+        b0 = _mm_aesenclast_si128(b0, rk[14]);
+        b1 = _mm_aesenclast_si128(b1, rk[14]);
+        b2 = _mm_aesenclast_si128(b2, rk[14]);
+        b3 = _mm_aesenclast_si128(b3, rk[14]);
+        
+        const __m128i* src = reinterpret_cast<const __m128i*>(in);
+        __m128i* dst = reinterpret_cast<__m128i*>(out);
+        _mm_storeu_si128(dst, _mm_xor_si128(b0, _mm_loadu_si128(src)));
+        _mm_storeu_si128(dst + 1, _mm_xor_si128(b1, _mm_loadu_si128(src + 1)));
+        _mm_storeu_si128(dst + 2, _mm_xor_si128(b2, _mm_loadu_si128(src + 2)));
+        _mm_storeu_si128(dst + 3, _mm_xor_si128(b3, _mm_loadu_si128(src + 3)));
+        in += 64;
+        out += 64;
+        length -= 64;
+    }
+    
+    while (length > 0) {
+        storeBe32(counters + 12, block++);
+        __m128i b = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(counters)), rk[0]);
+        for (int round = 1; round < 14; round++) {
+            b = _mm_aesenc_si128(b, rk[round]);
+        }
+        b = _mm_aesenclast_si128(b, rk[14]);
+        
+        uint8_t stream[16];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(stream), b);
+        size_t chunk = length < 16 ? length : 16;
+        for (size_t i = 0; i < chunk; i++) {
+            out[i] = in[i] ^ stream[i];
+        }
+        in += chunk;
+        out += chunk;
+        length -= chunk;
+    }
+    storeBe32(counter + 12, block);
+}
+
+__attribute__((target("pclmul,ssse3")))
+inline __m128i ghashMultiplyHardware(__m128i a, __m128i b) {
+    // Carry-less multiply and reduction on byte-reversed operands
+    // (Intel white paper "Carry-Less Multiplication and Its Usage for
+    // Computing the GCM Mode", algorithm 5)
+    __m128i lo = _mm_clmulepi64_si128(a, b, 0x00);
+    __m128i mid = _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x10), _mm_clmulepi64_si128(a, b, 0x01));
+    __m128i hi = _mm_clmulepi64_si128(a, b, 0x11);
+    lo = _mm_xor_si128(lo, _mm_slli_si128(mid, 8));
+    hi = _mm_xor_si128(hi, _mm_srli_si128(mid, 8));
+    
+    // Shift the 256-bit product left by one bit (bit-reflected operands)
+    __m128i loCarry = _mm_srli_epi32(lo, 31);
+    __m128i hiCarry = _mm_srli_epi32(hi, 31);
+    lo = _mm_slli_epi32(lo, 1);
+    hi = _mm_slli_epi32(hi, 1);
+    __m128i crossCarry = _mm_srli_si128(loCarry, 12);
+    hiCarry = _mm_slli_si128(hiCarry, 4);
+    loCarry = _mm_slli_si128(loCarry, 4);
+    lo = _mm_or_si128(lo, loCarry);
+    hi = _mm_or_si128(_mm_or_si128(hi, hiCarry), crossCarry);
+    
+    // Reduce modulo x^128 + x^7 + x^2 + x + 1
+    __m128i a1 = _mm_xor_si128(_mm_xor_si128(_mm_slli_epi32(lo, 31), _mm_slli_epi32(lo, 30)), _mm_slli_epi32(lo, 25));
+    __m128i a2 = _mm_srli_si128(a1, 4);
+    lo = _mm_xor_si128(lo, _mm_slli_si128(a1, 12));
+    __m128i b1 = _mm_xor_si128(_mm_xor_si128(_mm_srli_epi32(lo, 1), _mm_srli_epi32(lo, 2)), _mm_srli_epi32(lo, 7));
+    b1 = _mm_xor_si128(b1, a2);
+    lo = _mm_xor_si128(lo, b1);
+    return _mm_xor_si128(hi, lo);
+}
+
+__attribute__((target("pclmul,ssse3")))
+void ghashHardware(const GcmKey& key, uint8_t state[16], const uint8_t* data, size_t length) {
+    const __m128i reverse = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    __m128i h = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(key.hashKey)), reverse);
+    __m128i y = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), reverse);
+    
+    while (length > 0) {
+        __m128i x;
+        if (length >= 16) {
+            x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+            data += 16;
+            length -= 16;
+        } else {
+            uint8_t tail[16] = {0};
+            memcpy(tail, data, length);
+            x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tail));
+            length = 0;
+        }
+        y = ghashMultiplyHardware(_mm_xor_si128(y, _mm_shuffle_epi8(x, reverse)), h);
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state), _mm_shuffle_epi8(y, reverse));
+}
+
+bool cpuHasAesHardware() {
+    return __builtin_cpu_supports("aes") && __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3");
+}
+#endif
+
+void gcmInit(GcmKey& key, const uint8_t secret[32], bool allowHardware = true) {
+    // AES-256 key schedule
+    const uint8_t* sbox = aesTables().sbox;
+    uint32_t* w = key.roundKeys;
+    uint32_t rcon = 0x01;
+    for (int i = 0; i < 8; i++) {
+        w[i] = loadBe32(secret + 4 * i);
+    }
+    for (int i = 8; i < 60; i++) {
+        uint32_t t = w[i - 1];
+        if (i % 8 == 0) {
+            t = (t << 8) | (t >> 24);
+            t = ((uint32_t)sbox[t >> 24] << 24) | ((uint32_t)sbox[(t >> 16) & 0xFF] << 16) |
+                ((uint32_t)sbox[(t >> 8) & 0xFF] << 8) | sbox[t & 0xFF];
+            t ^= rcon << 24;
+            rcon <<= 1;
+        } else if (i % 8 == 4) {
+            t = ((uint32_t)sbox[t >> 24] << 24) | ((uint32_t)sbox[(t >> 16) & 0xFF] << 16) |
+                ((uint32_t)sbox[(t >> 8) & 0xFF] << 8) | sbox[t & 0xFF];
+        }
+        w[i] = w[i - 8] ^ t;
+    }
+    for (int i = 0; i < 60; i++) {
+        storeBe32(key.roundKeyBytes + 4 * i, w[i]);
+    }
+    
+    // H and its 4-bit multiples
+    uint8_t zero[16] = {0};
+    aesEncryptBlock(key, zero, key.hashKey);
+    uint64_t vh = loadBe64(key.hashKey);
+    uint64_t vl = loadBe64(key.hashKey + 8);
+    key.tableHigh[0] = key.tableLow[0] = 0;
+    key.tableHigh[8] = vh;
+    key.tableLow[8] = vl;
+    for (int i = 4; i > 0; i >>= 1) {
+        uint64_t carry = (vl & 1) ? 0xE100000000000000ULL : 0;
+        vl = (vh << 63) | (vl >> 1);
+        vh = (vh >> 1) ^ carry;
+        key.tableHigh[i] = vh;
+        key.tableLow[i] = vl;
+    }
+    for (int i = 2; i <= 8; i *= 2) {
+        for (int j = 1; j < i; j++) {
+            key.tableHigh[i + j] = key.tableHigh[i] ^ key.tableHigh[j];
+            key.tableLow[i + j] = key.tableLow[i] ^ key.tableLow[j];
+        }
+    }
+    
+#ifdef CLIPBOARD_HAVE_AESNI
+    key.hardware = allowHardware && cpuHasAesHardware();
+#else
+    key.hardware = false;
+#endif
+}
+
+void gcmCrypt(const GcmKey& key, const uint8_t nonce[GCM_NONCE_SIZE], const std::string& aad,
+              const uint8_t* in, size_t length, uint8_t* out, bool encrypt, uint8_t tag[GCM_TAG_SIZE]) {
+    // Counter mode from J0 + 1, GHASH over aad | ciphertext | lengths;
+    // tag = GHASH ^ AES(J0)
+    uint8_t counter[16];
+    memcpy(counter, nonce, GCM_NONCE_SIZE);
+    storeBe32(counter + 12, 1);
+    uint8_t tagMask[16];
+    aesEncryptBlock(key, counter, tagMask);
+    storeBe32(counter + 12, 2);
+    
+    auto ghash = [&key](uint8_t* state, const uint8_t* data, size_t size) {
+#ifdef CLIPBOARD_HAVE_AESNI
+        if (key.hardware) { ghashHardware(key, state, data, size); return; }
+#endif
+        ghashPortable(key, state, data, size);
+    };
+    auto ctr = [&key, &counter](const uint8_t* src, uint8_t* dst, size_t size) {
+#ifdef CLIPBOARD_HAVE_AESNI
+        if (key.hardware) { ctrHardware(key, counter, src, dst, size); return; }
+#endif
+        ctrPortable(key, counter, src, dst, size);
+    };
+    
+    uint8_t state[16] = {0};
+    ghash(state, reinterpret_cast<const uint8_t*>(aad.data()), aad.size());
+    if (encrypt) {
+        ctr(in, out, length);
+        ghash(state, out, length);
+    } else {
+        ghash(state, in, length);
+        ctr(in, out, length);
+    }
+    
+    uint8_t lengths[16];
+    storeBe64(lengths, (uint64_t)aad.size() * 8);
+    storeBe64(lengths + 8, (uint64_t)length * 8);
+    ghash(state, lengths, 16);
+    for (int i = 0; i < 16; i++) {
+        tag[i] = state[i] ^ tagMask[i];
+    }
+}
+
+bool randomBytes(uint8_t* out, size_t length) {
+#ifdef _WIN32
+    static HCRYPTPROV provider = []() {
+        HCRYPTPROV handle = 0;
+        return CryptAcquireContextA(&handle, NULL, NULL, PROV_RSA_FULL, CRYPT_VERIFYCONTEXT) ? handle : 0;
+    }();
+    return provider != 0 && CryptGenRandom(provider, (DWORD)length, out);
+#else
+    static FILE* source = fopen("/dev/urandom", "rb");
+    return source != nullptr && fread(out, 1, length, source) == length;
+#endif
+}
+
+const char BASE64_ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+void base64Encode(const uint8_t* data, size_t length, std::string& out) {
+    size_t start = out.size();
+    out.resize(start + (length + 2) / 3 * 4);
+    char* dst = &out[start];
+    size_t i = 0;
+    for (; i + 3 <= length; i += 3) {
+        uint32_t v = ((uint32_t)data[i] << 16) | ((uint32_t)data[i + 1] << 8) | data[i + 2];
+        *dst++ = BASE64_ALPHABET[v >> 18];
+        *dst++ = BASE64_ALPHABET[(v >> 12) & 63];
+        *dst++ = BASE64_ALPHABET[(v >> 6) & 63];
+        *dst++ = BASE64_ALPHABET[v & 63];
+    }
+    if (i < length) {
+        uint32_t v = (uint32_t)data[i] << 16;
+        if (i + 1 < length) v |= (uint32_t)data[i + 1] << 8;
+        *dst++ = BASE64_ALPHABET[v >> 18];
+        *dst++ = BASE64_ALPHABET[(v >> 12) & 63];
+        *dst++ = i + 1 < length ? BASE64_ALPHABET[(v >> 6) & 63] : '=';
+        *dst++ = '=';
+    }
+}
+
+bool base64Decode(const char* text, size_t length, std::vector<uint8_t>& out) {
+    static const std::vector<int8_t> values = []() {
+        std::vector<int8_t> table(256, -1);
+        for (int i = 0; i < 64; i++) {
+            table[(uint8_t)BASE64_ALPHABET[i]] = (int8_t)i;
+        }
+        return table;
+    }();
+    
+    if (length % 4 != 0) {
+        return false;
+    }
+    out.clear();
+    out.reserve(length / 4 * 3);
+    for (size_t i = 0; i < length; i += 4) {
+        int v[4];
+        int padding = 0;
+        for (int j = 0; j < 4; j++) {
+            char c = text[i + j];
+            if (c == '=' && i + 4 == length && j >= 2) {
+                v[j] = 0;
+                padding++;
+            } else if ((v[j] = values[(uint8_t)c]) < 0 || padding > 0) {
+                return false;
+            }
+        }
+        uint32_t word = ((uint32_t)v[0] << 18) | ((uint32_t)v[1] << 12) | ((uint32_t)v[2] << 6) | (uint32_t)v[3];
+        out.push_back((uint8_t)(word >> 16));
+        if (padding < 2) out.push_back((uint8_t)(word >> 8));
+        if (padding < 1) out.push_back((uint8_t)word);
+    }
+    return true;
+}
+
+bool isSealedValue(const std::string& stored) {
+    // Escaped text never has a backslash followed by 'e'
+    return stored.size() >= 2 && stored[0] == '\\' && stored[1] == 'e';
+}
+
+std::string sealRecord(const GcmKey& key, const std::string& slotNum, const std::string& content,
+                       const uint8_t* fixedNonce = nullptr) {
+    // fixedNonce is for known-answer checks only: a nonce must never repeat
+    std::vector<uint8_t> record(GCM_NONCE_SIZE + content.size() + GCM_TAG_SIZE);
+    uint8_t* nonce = record.data();
+    if (fixedNonce != nullptr) {
+        memcpy(nonce, fixedNonce, GCM_NONCE_SIZE);
+    } else if (!randomBytes(nonce, GCM_NONCE_SIZE)) {
+        // Never reuse a nonce: fall back to time and a process counter
+        static uint32_t fallbackCounter = 0;
+        uint64_t now = (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+        storeBe64(nonce, now);
+        storeBe32(nonce + 8, ++fallbackCounter);
+    }
+    gcmCrypt(key, nonce, "SLOT" + slotNum, reinterpret_cast<const uint8_t*>(content.data()), content.size(),
+             record.data() + GCM_NONCE_SIZE, true, record.data() + GCM_NONCE_SIZE + content.size());
+    
+    std::string stored = "\\e";
+    base64Encode(record.data(), record.size(), stored);
+    return stored;
+}
+
+bool openRecord(const GcmKey& key, const std::string& slotNum, const std::string& stored, std::string& content) {
+    std::vector<uint8_t> record;
+    if (!base64Decode(stored.data() + 2, stored.size() - 2, record) || record.size() < GCM_NONCE_SIZE + GCM_TAG_SIZE) {
+        return false;
+    }
+    size_t length = record.size() - GCM_NONCE_SIZE - GCM_TAG_SIZE;
+    content.resize(length);
+    uint8_t tag[GCM_TAG_SIZE];
+    gcmCrypt(key, record.data(), "SLOT" + slotNum, record.data() + GCM_NONCE_SIZE, length,
+             reinterpret_cast<uint8_t*>(&content[0]), false, tag);
+    
+    // Constant-time tag comparison
+    uint8_t difference = 0;
+    for (size_t i = 0; i < GCM_TAG_SIZE; i++) {
+        difference |= tag[i] ^ record[GCM_NONCE_SIZE + length + i];
+    }
+    if (difference != 0) {
+        content.clear();
+        return false;
+    }
+    return true;
+}
+
+bool loadStoreKey(bool create) {
+    // The key file sits next to the save file; without it sealed records
+    // cannot be opened
+    std::string path = SAVE_FILE + ".key";
+    uint8_t secret[32];
+    bool ok = false;
+    
+    std::ifstream in(path, std::ios::binary);
+    std::string blob((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+    
+    if (!blob.empty()) {
+#ifdef _WIN32
+        DATA_BLOB input = {(DWORD)blob.size(), reinterpret_cast<BYTE*>(&blob[0])};
+        DATA_BLOB output;
+        if (CryptUnprotectData(&input, NULL, NULL, NULL, NULL, 0, &output)) {
+            ok = output.cbData == sizeof(secret);
+            if (ok) {
+                memcpy(secret, output.pbData, sizeof(secret));
+            }
+            SecureZeroMemory(output.pbData, output.cbData);
+            LocalFree(output.pbData);
+        }
+#else
+        ok = blob.size() == sizeof(secret);
+        if (ok) {
+            memcpy(secret, blob.data(), sizeof(secret));
+        }
+#endif
+    } else if (create && randomBytes(secret, sizeof(secret))) {
+#ifdef _WIN32
+        // Only this Windows user can unprotect the key
+        DATA_BLOB input = {(DWORD)sizeof(secret), secret};
+        DATA_BLOB output;
+        if (CryptProtectData(&input, L"Clipboard Manager store key", NULL, NULL, NULL, 0, &output)) {
+            std::ofstream out(path, std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<const char*>(output.pbData), output.cbData);
+            ok = out.good();
+            LocalFree(output.pbData);
+        }
+#else
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        if (fd >= 0) {
+            ok = write(fd, secret, sizeof(secret)) == (ssize_t)sizeof(secret);
+            close(fd);
+        }
+#endif
+    }
+    
+    if (ok) {
+        gcmInit(g_storeKey, secret);
+        g_storeKeyReady = true;
+    }
+    std::fill(secret, secret + sizeof(secret), 0);
+    return ok;
+}
+
+// ========================================
+// SAVE FILE MANAGEMENT
+// ========================================
+
+std::string escapeString(const std::string& str) {
+    PhaseScope phase("escapeString", str.size());
+    std::string result;
+    for (char c : str) {
+        if (c == '\n') result += "\\n";
+        else if (c == '\r') result += "\\r";
+        else if (c == '\\') result += "\\\\";
+        else if (c == '|') result += "\\p";
+        else result += c;
+    }
+    return result;
+}
+
+std::string unescapeString(const std::string& str) {
+    std::string result;
+    for (size_t i = 0; i < str.length(); i++) {
+        if (str[i] == '\\' && i + 1 < str.length()) {
+            if (str[i + 1] == 'n') { result += '\n'; i++; }
+            else if (str[i + 1] == 'r') { result += '\r'; i++; }
+            else if (str[i + 1] == '\\') { result += '\\'; i++; }
+            else if (str[i + 1] == 'p') { result += '|'; i++; }
+            else result += str[i];
+        } else {
+            result += str[i];
+        }
+    }
+    return result;
+}
+
+std::string encodeStoredValue(const std::string& slotNum, const std::string& content) {
+    // Form written to the file: escaped text, or a sealed record
+    if (g_encryptStore && g_storeKeyReady && !content.empty()) {
+        PhaseScope phase("sealRecord", content.size());
+        return sealRecord(g_storeKey, slotNum, content);
+    }
+    return escapeString(content);
+}
+
+bool decodeStoredValue(const std::string& slotNum, const std::string& stored, std::string& content) {
+    // False if a sealed record cannot be opened (missing key, tampered or
+    // moved record); content is then empty
+    if (!isSealedValue(stored)) {
+        content = unescapeString(stored);
+        return true;
+    }
+    content.clear();
+    return g_storeKeyReady && openRecord(g_storeKey, slotNum, stored, content);
+}
+
+bool isConfigLine(const std::string& line) {
+    // Comments, blank lines and settings are kept verbatim when the file is rewritten
+    return line.empty() || line[0] == '#' || line.substr(0, 4) == "KEY_" || line.substr(0, 10) == "SLOT_CHARS" ||
+           line.substr(0, 10) == "CLIPBOARD_" || line.substr(0, 6) == "ALIAS|" || line.substr(0, 9) == "TEMPLATE|" ||
+           line.substr(0, 10) == "TRANSFORM|" || line.substr(0, 10) == "AUTO_BANK|" ||
+           line.substr(0, 9) == "SYNC_DIR=" || line.substr(0, 10) == "TYPE_RATE=" ||
+           line.substr(0, 5) == "IDLE_" || line.substr(0, 6) == "DELTA_";
+}
+
+void loadKeyConfiguration() {
+    std::ifstream file(SAVE_FILE);
+    if (!file.is_open()) {
+        return;
+    }
+    
+    std::string line;
+    while (std::getline(file, line)) {
+        // Load key configuration
+        if (line.substr(0, 10) == "KEY_SAVE1=") {
+            std::string value = line.substr(10);
+            KEY_SAVE1 = hexToInt(value) & 0xFF;
+        }
+        else if (line.substr(0, 10) == "KEY_SAVE2=") {
+            std::string value = line.substr(10);
+            KEY_SAVE2 = hexToInt(value) & 0xFF;
+        }
+        else if (line.substr(0, 9) == "KEY_LOAD=") {
+            std::string value = line.substr(9);
+            KEY_LOAD = hexToInt(value) & 0xFF;
+        }
+        else if (line.substr(0, 11) == "SLOT_CHARS=") {
+            std::string value = line.substr(11);
+            // Parse comma-separated characters
+            std::stringstream ss(value);
+            std::string token;
+            int idx = 0;
+            while (std::getline(ss, token, ',') && idx < 10) {
+                SLOT_CHARS[idx] = token;
+                idx++;
+            }
+        }
+        else if (line.substr(0, 21) == "CLIPBOARD_TIMEOUT_MS=") {
+            try {
+                CLIPBOARD_TIMEOUT_MS = std::stoul(line.substr(21));
+            } catch (...) {
+                std::cerr << "ERROR: Invalid CLIPBOARD_TIMEOUT_MS value" << std::endl;
+            }
+        }
+        else if (line.substr(0, 18) == "CLIPBOARD_ENCRYPT=") {
+            g_encryptStore = line.substr(18) == "1";
+        }
+        else if (line.substr(0, 9) == "SYNC_DIR=") {
+            SYNC_DIR = line.substr(9);
+        }
+        else if (line.substr(0, 12) == "DELTA_STORE=") {
+            g_deltaStore = line.substr(12) == "1";
+        }
+        else if (line.substr(0, 10) == "TYPE_RATE=") {
+            try {
+                TYPE_RATE = std::stoul(line.substr(10));
+            } catch (...) {
+                std::cerr << "ERROR: Invalid TYPE_RATE value" << std::endl;
+            }
+        }
+        else if (line.substr(0, 20) == "IDLE_MAINTENANCE_MS=") {
+            try {
+                IDLE_MAINTENANCE_MS = std::stoul(line.substr(20));
+            } catch (...) {
+                std::cerr << "ERROR: Invalid IDLE_MAINTENANCE_MS value" << std::endl;
+            }
+        }
+        else if (line.substr(0, 6) == "ALIAS|") {
+            // ALIAS|name|slot
+            size_t pipePos = line.find('|', 6);
+            if (pipePos != std::string::npos) {
+                insertAlias(line.substr(6, pipePos - 6), line.substr(pipePos + 1));
+            }
+        }
+        else if (line.substr(0, 9) == "TEMPLATE|") {
+            g_templateSlots.insert(line.substr(9));
+        }
+        else if (line.substr(0, 10) == "TRANSFORM|") {
+            loadTransformLine(line);
+        }
+        else if (line.substr(0, 10) == "AUTO_BANK|") {
+            loadAutoBankLine(line);
+        }
+        else if (line.substr(0, 4) == "SLOT") {
+            // We've reached the slots, stop
+            break;
+        }
+    }
+    
+    file.close();
+}
+
+void initializeSaveFile() {
+    std::ifstream testFile(SAVE_FILE);
+    if (testFile.is_open()) {
+        testFile.close();
+        // Load configuration from existing file
+        loadKeyConfiguration();
+        return;
+    }
+    
+    // Create file with default configuration and 10 empty slots
+    std::ofstream file(SAVE_FILE, std::ios::out | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "ERROR: Unable to create save file" << std::endl;
+#ifdef _WIN32
+        MessageBoxA(NULL, "Unable to create save file!", "Error", MB_ICONERROR);
+#endif
+        return;
+    }
+    
+    // Write key configuration
+    file << "# ========================================" << std::endl;
+    file << "# KEY CONFIGURATION" << std::endl;
+    file << "# ========================================" << std::endl;
+    file << "# Three formats are accepted:" << std::endl;
+    file << "#   1. SINGLE LETTER     : KEY_SAVE1=A      (simplest!)" << std::endl;
+    file << "#   2. HEXADECIMAL CODE  : KEY_SAVE1=0x41   (technical format)" << std::endl;
+    file << "#   3. DECIMAL CODE      : KEY_SAVE1=65     (alternative format)" << std::endl;
+    file << "#" << std::endl;
+    file << "# Examples of simple letters:" << std::endl;
+    file << "#   Letters : A, B, C, D ... Z" << std::endl;
+    file << "#   Digits  : 0, 1, 2 ... 9 (warning: not for SAVE/LOAD!)" << std::endl;
+    file << "#   Symbols : [ ] \\ ; ' , . / - = `" << std::endl;
+    file << "#" << std::endl;
+    file << "# Concrete examples:" << std::endl;
+    file << "#   To use the A key : KEY_SAVE1=A" << std::endl;
+    file << "#   To use the [ key : KEY_SAVE1=[" << std::endl;
+    file << "#   To use the ; key : KEY_SAVE1=;" << std::endl;
+    file << "#" << std::endl;
+    file << "# Common VK codes (if hexadecimal format needed):" << std::endl;
+    file << "#   Letters A-Z : 0x41 to 0x5A" << std::endl;
+    file << "#   Digits 0-9  : 0x30 to 0x39" << std::endl;
+    file << "#   $ or ;      : 0xBA" << std::endl;
+    file << "#   ^ or '      : 0xDE" << std::endl;
+    file << "#   L or ]      : 0xDD" << std::endl;
+    file << "#   [ or {      : 0xDB" << std::endl;
+    file << "#" << std::endl;
+    file << "# Save key 1 (default: $ = 0xBA)" << std::endl;
+    file << "KEY_SAVE1=" << intToHex(KEY_SAVE1) << std::endl;
+    file << "#" << std::endl;
+    file << "# Save key 2 (default: L = 0xDD)" << std::endl;
+    file << "KEY_SAVE2=" << intToHex(KEY_SAVE2) << std::endl;
+    file << "#" << std::endl;
+    file << "# Load key (default: ^ = 0xDE)" << std::endl;
+    file << "KEY_LOAD=" << intToHex(KEY_LOAD) << std::endl;
+    file << "#" << std::endl;
+    file << "# Characters displayed for slots 1-10 (keys with Shift)" << std::endl;
+    file << "# You can change them to match your keyboard" << std::endl;
+    file << "SLOT_CHARS=&,é,\",',\\(,-,è,_,ç,à" << std::endl;
+    file << "#" << std::endl;
+    file << "# Maximum wait (ms) when another application holds the clipboard" << std::endl;
+    file << "CLIPBOARD_TIMEOUT_MS=" << CLIPBOARD_TIMEOUT_MS << std::endl;
+    file << "#" << std::endl;
+    file << "# Encrypt slot contents in this file (1 = yes, 0 = no)" << std::endl;
+    file << "CLIPBOARD_ENCRYPT=" << (g_encryptStore ? 1 : 0) << std::endl;
+    file << "#" << std::endl;
+    file << "# Folder shared with your other machines to sync slots (empty = no sync)" << std::endl;
+    file << "SYNC_DIR=" << SYNC_DIR << std::endl;
+    file << "#" << std::endl;
+    file << "# Direct typing speed with LOAD + K, in characters per second (0 = no limit)" << std::endl;
+    file << "TYPE_RATE=" << TYPE_RATE << std::endl;
+    file << "#" << std::endl;
+    file << "# Idle time (ms) before checking and compacting this file in the background (0 = never)" << std::endl;
+    file << "IDLE_MAINTENANCE_MS=" << IDLE_MAINTENANCE_MS << std::endl;
+    file << "#" << std::endl;
+    file << "# Store slots that are small edits of another slot as differences (1 = yes, 0 = no)" << std::endl;
+    file << "DELTA_STORE=" << (g_deltaStore ? 1 : 0) << std::endl;
+    file << "#" << std::endl;
+    file << "# Clean-up applied when a slot is loaded:" << std::endl;
+    file << "#   TRANSFORM|<slot>|<steps>   on every LOAD of the slot" << std::endl;
+    file << "#   TRANSFORM|chord|<steps>    on LOAD + X + slot" << std::endl;
+    file << "# Steps separated by | : trim, crlf, rstrip, upper, lower, s/regex/replacement/ (i = ignore case)" << std::endl;
+    file << "#   Ex: TRANSFORM|chord|crlf|rstrip|trim" << std::endl;
+    file << "#" << std::endl;
+    file << "# Slots filled by SAVE + A, per content category (url, path, number, json, code, text)" << std::endl;
+    file << "#   Defaults: url 100-199, path 200-299, number 300-399, json 400-499, code 500-599, text 600-699" << std::endl;
+    file << "#   Ex: AUTO_BANK|url|1000-1999" << std::endl;
+    file << "#" << std::endl;
+    file << "# ========================================" << std::endl;
+    file << "# CLIPBOARD SLOTS" << std::endl;
+    file << "# ========================================" << std::endl;
+    file << "#" << std::endl;
+    
+    // Create 10 empty slots
+    for (int i = 1; i <= 10; i++) {
+        file << "SLOT" << i << "|" << std::endl;
+    }
+    
+    file.close();
+}
+
+// ========================================
+// RECORD CHECKSUMS
+// ========================================
+// Every slot line ends with the CRC32C of everything before it:
+//   SLOT<key>|<value>|<crc32c, 8 hex digits>
+// A line with a wrong checksum (partial write, bad edit) is damaged and
+// moved to a quarantine file instead of being loaded. A line without a
+// checksum (written by hand) is accepted as is, and gets one on the next
+// rewrite. SSE4.2 computes the CRC when available, slicing-by-8 otherwise.
+
+const size_t RECORD_CHECKSUM_SIZE = 9;      // '|' and 8 hex digits
+
+struct Crc32cTables {
+    uint32_t table[8][256];
+    
+    Crc32cTables() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc >> 1) ^ ((crc & 1) ? 0x82F63B78 : 0);
+            }
+            table[0][i] = crc;
+        }
+        for (int k = 1; k < 8; k++) {
+            for (int i = 0; i < 256; i++) {
+                table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xFF];
+            }
+        }
+    }
+};
+
+uint32_t crc32cSoftware(const uint8_t* data, size_t length) {
+    static const Crc32cTables tables;
+    const auto& t = tables.table;
+    uint32_t crc = 0xFFFFFFFF;
+    while (length >= 8) {
+        uint32_t low = crc ^ ((uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24));
+        uint32_t high = (uint32_t)data[4] | ((uint32_t)data[5] << 8) | ((uint32_t)data[6] << 16) | ((uint32_t)data[7] << 24);
+        crc = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF] ^ t[5][(low >> 16) & 0xFF] ^ t[4][low >> 24] ^
+              t[3][high & 0xFF] ^ t[2][(high >> 8) & 0xFF] ^ t[1][(high >> 16) & 0xFF] ^ t[0][high >> 24];
+        data += 8;
+        length -= 8;
+    }
+    while (length-- > 0) {
+        crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xFF];
+    }
+    return ~crc;
+}
+
+#ifdef CLIPBOARD_HAVE_AESNI
+__attribute__((target("sse4.2")))
+uint32_t crc32cHardware(const uint8_t* data, size_t length) {
+#if defined(__x86_64__)
+    uint64_t crc = 0xFFFFFFFF;
+    while (length >= 8) {
+        uint64_t word;
+        memcpy(&word, data, 8);
+        crc = _mm_crc32_u64(crc, word);
+        data += 8;
+        length -= 8;
+    }
+    uint32_t crc32 = (uint32_t)crc;
+#else
+    uint32_t crc32 = 0xFFFFFFFF;
+#endif
+    while (length >= 4) {
+        uint32_t word;
+        memcpy(&word, data, 4);
+        crc32 = _mm_crc32_u32(crc32, word);
+        data += 4;
+        length -= 4;
+    }
+    while (length-- > 0) {
+        crc32 = _mm_crc32_u8(crc32, *data++);
+    }
+    return ~crc32;
+}
+#endif
+
+bool crc32cHasHardware() {
+#ifdef CLIPBOARD_HAVE_AESNI
+    static const bool available = __builtin_cpu_supports("sse4.2");
+    return available;
+#else
+    return false;
+#endif
+}
+
+uint32_t crc32c(const char* data, size_t length) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+#ifdef CLIPBOARD_HAVE_AESNI
+    if (crc32cHasHardware()) {
+        return crc32cHardware(bytes, length);
+    }
+#endif
+    return crc32cSoftware(bytes, length);
+}
+
+void formatChecksum(char* out, uint32_t crc) {
+    // '|' and 8 lowercase hex digits
+    static const char digits[] = "0123456789abcdef";
+    out[0] = '|';
+    for (int i = 8; i >= 1; i--) {
+        out[i] = digits[crc & 0xF];
+        crc >>= 4;
+    }
+}
+
+enum RecordStatus {
+    RECORD_VERIFIED,
+    RECORD_UNCHECKED,       // No checksum (written by hand)
+    RECORD_DAMAGED
+};
+
+RecordStatus checkSlotRecord(const char* line, size_t length, size_t& keyEnd, size_t& valueEnd) {
+    // Splits SLOT<key>|<value>[|<crc32c>]: the key is [4, keyEnd) and the
+    // value [keyEnd + 1, valueEnd). Escaped values never contain '|', so a
+    // '|' RECORD_CHECKSUM_SIZE bytes from the end can only start a checksum,
+    // and a checked value is never scanned twice.
+    if (length < 5 || memcmp(line, "SLOT", 4) != 0) {
+        return RECORD_DAMAGED;
+    }
+    const char* pipe = static_cast<const char*>(memchr(line + 4, '|', length - 4));
+    if (pipe == nullptr) {
+        return RECORD_DAMAGED;
+    }
+    keyEnd = pipe - line;
+    
+    if (length >= keyEnd + 1 + RECORD_CHECKSUM_SIZE && line[length - RECORD_CHECKSUM_SIZE] == '|') {
+        valueEnd = length - RECORD_CHECKSUM_SIZE;
+        uint32_t expected = 0;
+        for (size_t i = valueEnd + 1; i < length; i++) {
+            char c = line[i];
+            uint32_t digit;
+            if (c >= '0' && c <= '9') digit = c - '0';
+            else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+            else return RECORD_DAMAGED;
+            expected = (expected << 4) | digit;
+        }
+        return crc32c(line, valueEnd) == expected ? RECORD_VERIFIED : RECORD_DAMAGED;
+    }
+    
+    // No checksum: any other '|' means a broken line
+    valueEnd = length;
+    return memchr(pipe + 1, '|', length - keyEnd - 1) == nullptr ? RECORD_UNCHECKED : RECORD_DAMAGED;
+}
+
+struct StoreCheck {
+    size_t records = 0;
+    size_t unchecked = 0;
+    size_t damaged = 0;
+};
+
+void verifyStoreBuffer(const char* data, size_t length, StoreCheck& check) {
+    // One pass over the file image: memchr for the line ends and a CRC per
+    // slot line, nothing is copied
+    const char* end = data + length;
+    while (data < end) {
+        const char* newline = static_cast<const char*>(memchr(data, '\n', end - data));
+        const char* lineEnd = newline ? newline : end;
+        size_t lineLength = lineEnd - data;
+        if (lineLength > 0 && data[lineLength - 1] == '\r') {
+            lineLength--;
+        }
+        
+        // Slot lines are recognized without building a string; setting
+        // prefixes are at most 10 characters long
+        bool slotLine = lineLength >= 5 && memcmp(data, "SLOT", 4) == 0 && data[4] != '_';
+        if (slotLine || !isConfigLine(std::string(data, std::min<size_t>(lineLength, 10)))) {
+            size_t keyEnd, valueEnd;
+            RecordStatus status = checkSlotRecord(data, lineLength, keyEnd, valueEnd);
+            check.records++;
+            if (status == RECORD_UNCHECKED) check.unchecked++;
+            if (status == RECORD_DAMAGED) check.damaged++;
+        }
+        data = lineEnd + 1;
+    }
+}
+
+bool verifyStoreFile(StoreCheck& check) {
+    // Read in large blocks and verified in memory; a line cut by the end
+    // of a block is carried over to the next one
+    const size_t blockSize = 16 << 20;
+    std::ifstream file(SAVE_FILE, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    
+    std::string buffer;
+    size_t carried = 0;
+    while (true) {
+        buffer.resize(carried + blockSize);
+        file.read(&buffer[carried], blockSize);
+        size_t filled = carried + (size_t)file.gcount();
+        if ((size_t)file.gcount() < blockSize) {
+            verifyStoreBuffer(buffer.data(), filled, check);
+            return true;
+        }
+        
+        size_t lastNewline = buffer.rfind('\n', filled - 1);
+        if (lastNewline == std::string::npos) {
+            carried = filled;
+            continue;
+        }
+        verifyStoreBuffer(buffer.data(), lastNewline + 1, check);
+        carried = filled - lastNewline - 1;
+        memmove(&buffer[0], &buffer[lastNewline + 1], carried);
+    }
+}
+
+// ========================================
+// SLOT TABLE
+// ========================================
+// The slots of the store while it is read or rewritten. Keys and values
+// (in their stored form) are packed in append-only arenas, and each slot is
+// a 24-byte record of offsets and lengths, sorted by key. Going over all
+// slots scans the record array and the arena instead of walking map nodes
+// and separate heap strings. A replaced or erased value stays in the arena
+// as garbage until compaction copies the live values to a fresh arena.
+
+const size_t SLOT_TABLE_COMPACT_MIN_BYTES = 1 << 20;   // Garbage worth a compaction
+
+class SlotTable {
+public:
+    struct Entry {
+        const char* keyData;
+        size_t keyLength;
+        const char* valueData;
+        size_t valueLength;
+        
+        std::string key() const {
+            return std::string(keyData, keyLength);
+        }
+        std::string value() const {
+            return std::string(valueData, valueLength);
+        }
+    };
+    
+    class Iterator {
+    public:
+        Iterator(const SlotTable* table, size_t index) : m_table(table), m_index(index) {}
+        Entry operator*() const {
+            return m_table->entry(m_index);
+        }
+        Iterator& operator++() {
+            m_index++;
+            return *this;
+        }
+        bool operator!=(const Iterator& other) const {
+            return m_index != other.m_index;
+        }
+    private:
+        const SlotTable* m_table;
+        size_t m_index;
+    };
+    
+    Iterator begin() const {
+        return Iterator(this, 0);
+    }
+    Iterator end() const {
+        return Iterator(this, m_records.size());
+    }
+    size_t size() const {
+        return m_records.size();
+    }
+    bool empty() const {
+        return m_records.empty();
+    }
+    
+    Entry entry(size_t index) const {
+        const Record& record = m_records[index];
+        return {m_keys.data() + record.keyOffset, record.keyLength, m_values.data() + record.valueOffset, record.valueLength};
+    }
+    
+    void reserve(size_t slotCount, size_t valueBytes) {
+        m_records.reserve(slotCount);
+        m_values.reserve(valueBytes);
+    }
+    
+    bool contains(const std::string& key) const {
+        size_t index = lowerBound(key.data(), key.size());
+        return index < m_records.size() && keyEquals(m_records[index], key.data(), key.size());
+    }
+    
+    bool findEntry(const std::string& key, Entry& found) const {
+        size_t index = lowerBound(key.data(), key.size());
+        if (index == m_records.size() || !keyEquals(m_records[index], key.data(), key.size())) {
+            return false;
+        }
+        found = entry(index);
+        return true;
+    }
+    
+    bool find(const std::string& key, std::string& value) const {
+        size_t index = lowerBound(key.data(), key.size());
+        if (index == m_records.size() || !keyEquals(m_records[index], key.data(), key.size())) {
+            return false;
+        }
+        value.assign(m_values, m_records[index].valueOffset, m_records[index].valueLength);
+        return true;
+    }
+    
+    void set(const std::string& key, const char* data, size_t length) {
+        size_t offset = m_values.size();
+        m_values.append(data, length);
+        
+        size_t index = lowerBound(key.data(), key.size());
+        if (index < m_records.size() && keyEquals(m_records[index], key.data(), key.size())) {
+            m_garbage += m_records[index].valueLength;
+            m_records[index].valueOffset = offset;
+            m_records[index].valueLength = length;
+            compactIfWasteful();
+            return;
+        }
+        m_records.insert(m_records.begin() + index, {(uint32_t)m_keys.size(), (uint32_t)key.size(), offset, length});
+        m_keys.append(key);
+    }
+    
+    void set(const std::string& key, const std::string& value) {
+        set(key, value.data(), value.size());
+    }
+    
+    void append(const char* key, size_t keyLength, const char* data, size_t length) {
+        // Loading: records come in file order, sortKeys() orders them once
+        m_records.push_back({(uint32_t)m_keys.size(), (uint32_t)keyLength, m_values.size(), length});
+        m_keys.append(key, keyLength);
+        m_values.append(data, length);
+    }
+    
+    void sortKeys() {
+        // A key present twice keeps its last value, as the file parser
+        // always did
+        std::stable_sort(m_records.begin(), m_records.end(), [this](const Record& a, const Record& b) {
+            return compareKeys(a, m_keys.data() + b.keyOffset, b.keyLength) < 0;
+        });
+        size_t kept = 0;
+        for (size_t i = 0; i < m_records.size(); i++) {
+            if (i + 1 < m_records.size() && keyEquals(m_records[i + 1], m_keys.data() + m_records[i].keyOffset, m_records[i].keyLength)) {
+                m_garbage += m_records[i].valueLength;
+                continue;
+            }
+            m_records[kept++] = m_records[i];
+        }
+        m_records.resize(kept);
+    }
+    
+    bool erase(const std::string& key) {
+        size_t index = lowerBound(key.data(), key.size());
+        if (index == m_records.size() || !keyEquals(m_records[index], key.data(), key.size())) {
+            return false;
+        }
+        m_garbage += m_records[index].valueLength + m_records[index].keyLength;
+        m_records.erase(m_records.begin() + index);
+        compactIfWasteful();
+        return true;
+    }
+    
+    void compact() {
+        // Live keys and values are copied in key order, so that a full
+        // iteration reads both arenas front to back
+        std::string keys;
+        std::string values;
+        keys.reserve(m_keys.size());
+        values.reserve(m_values.size() - std::min(m_garbage, m_values.size()));
+        for (auto& record : m_records) {
+            uint32_t keyOffset = (uint32_t)keys.size();
+            keys.append(m_keys, record.keyOffset, record.keyLength);
+            record.keyOffset = keyOffset;
+            size_t valueOffset = values.size();
+            values.append(m_values, record.valueOffset, record.valueLength);
+            record.valueOffset = valueOffset;
+        }
+        m_keys.swap(keys);
+        m_values.swap(values);
+        m_garbage = 0;
+    }
+    
+    size_t memoryUsage() const {
+        return m_records.capacity() * sizeof(Record) + m_keys.capacity() + m_values.capacity();
+    }
+    
+private:
+    struct Record {
+        uint32_t keyOffset;
+        uint32_t keyLength;
+        size_t valueOffset;
+        size_t valueLength;
+    };
+    
+    int compareKeys(const Record& record, const char* key, size_t length) const {
+        // Same order as std::string (unsigned bytes, then length)
+        int order = memcmp(m_keys.data() + record.keyOffset, key, std::min<size_t>(record.keyLength, length));
+        if (order != 0) {
+            return order;
+        }
+        return record.keyLength < length ? -1 : (record.keyLength > length ? 1 : 0);
+    }
+    
+    bool keyEquals(const Record& record, const char* key, size_t length) const {
+        return record.keyLength == length && memcmp(m_keys.data() + record.keyOffset, key, length) == 0;
+    }
+    
+    size_t lowerBound(const char* key, size_t length) const {
+        size_t low = 0;
+        size_t high = m_records.size();
+        while (low < high) {
+            size_t middle = (low + high) / 2;
+            if (compareKeys(m_records[middle], key, length) < 0) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        return low;
+    }
+    
+    void compactIfWasteful() {
+        if (m_garbage >= SLOT_TABLE_COMPACT_MIN_BYTES && m_garbage > (m_values.size() + m_keys.size()) / 2) {
+            compact();
+        }
+    }
+    
+    std::vector<Record> m_records;
+    std::string m_keys;
+    std::string m_values;
+    size_t m_garbage = 0;
+};
+
+// ========================================
+// SHARED SLOT REGION
+// ========================================
+// The running instance (the owner) publishes every slot, as stored in the
+// file (escaped or sealed), in a named shared-memory region. Other instances and tools read it without
+// copying and send their changes to the owner instead of rewriting the
+// file themselves. A seqlock protects the region: the sequence is odd while
+// the owner writes, and a reader retries if it changed during its read.
+//
+// Layout: SharedSlotHeader | SharedSlotEntry[slotCount] (sorted by key) |
+//         keys and payloads
+
+#ifdef _WIN32
+#define SHARED_REGION_NAME "Local\\ClipboardManagerSlots"
+#else
+#define SHARED_REGION_NAME "/ClipboardManagerSlots"
+#endif
+
+const uint32_t SHARED_REGION_MAGIC = 0x534D4243;    // "CBMS"
+const uint32_t SHARED_REGION_VERSION = 2;
+const size_t SHARED_REGION_SIZE = 16 * 1024 * 1024;
+const uint64_t SHARED_NOT_PUBLISHED = ~0ULL;         // Payload did not fit: read the file
+const int SHARED_READ_MAX_TRIES = 10000;             // Owner stuck mid-publish (died?): read the file
+
+// Mutations sent to the owner (WM_COPYDATA dwData)
+const unsigned long SHARED_OP_SET = 1;
+const unsigned long SHARED_OP_CLEAR = 2;
+
+struct SharedSlotHeader {
+    uint32_t magic;
+    uint32_t version;
+    std::atomic<uint32_t> sequence;
+    uint32_t ownerProcessId;
+    uint64_t capacity;          // Bytes available after the header
+    uint32_t slotCount;
+    uint32_t reserved;
+};
+
+struct SharedSlotEntry {
+    uint64_t keyOffset;         // From the start of the region
+    uint64_t valueOffset;       // SHARED_NOT_PUBLISHED if not in the region
+    uint32_t keyLength;
+    uint32_t reserved;
+    uint64_t valueLength;
+};
+
+struct SharedSlotRegion {
+    char* base = nullptr;
+    size_t size = 0;
+    bool owner = false;
+    const char* name = SHARED_REGION_NAME;
+#ifdef _WIN32
+    HANDLE mapping = NULL;
+#else
+    int fd = -1;
+#endif
+};
+
+SharedSlotRegion g_sharedSlots;
+
+void closeSharedSlots(SharedSlotRegion& region) {
+    if (region.base == nullptr) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(region.base);
+    CloseHandle(region.mapping);
+    region.mapping = NULL;
+#else
+    munmap(region.base, region.size);
+    close(region.fd);
+    region.fd = -1;
+    if (region.owner) {
+        shm_unlink(region.name);
+    }
+#endif
+    region.base = nullptr;
+    region.owner = false;
+}
+
+bool openSharedSlots(SharedSlotRegion& region, bool create, const char* name = SHARED_REGION_NAME) {
+    // name is only changed by the self checks, which must not meet a running owner
+    region.name = name;
+#ifdef _WIN32
+    if (create) {
+        region.mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0,
+                                            (DWORD)SHARED_REGION_SIZE, name);
+    } else {
+        region.mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name);
+    }
+    if (region.mapping == NULL) {
+        return false;
+    }
+    region.base = static_cast<char*>(MapViewOfFile(region.mapping, create ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ,
+                                                   0, 0, SHARED_REGION_SIZE));
+    if (region.base == nullptr) {
+        CloseHandle(region.mapping);
+        region.mapping = NULL;
+        return false;
+    }
+#else
+    region.fd = create ? shm_open(name, O_RDWR | O_CREAT, 0600) : shm_open(name, O_RDONLY, 0);
+    if (region.fd < 0) {
+        return false;
+    }
+    if (create && ftruncate(region.fd, SHARED_REGION_SIZE) != 0) {
+        close(region.fd);
+        region.fd = -1;
+        return false;
+    }
+    void* view = mmap(nullptr, SHARED_REGION_SIZE, create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, region.fd, 0);
+    if (view == MAP_FAILED) {
+        close(region.fd);
+        region.fd = -1;
+        return false;
+    }
+    region.base = static_cast<char*>(view);
+#endif
+    region.size = SHARED_REGION_SIZE;
+    region.owner = create;
+    
+    if (create) {
+        SharedSlotHeader* header = new (region.base) SharedSlotHeader();
+        header->magic = SHARED_REGION_MAGIC;
+        header->version = SHARED_REGION_VERSION;
+        header->sequence.store(0, std::memory_order_release);
+#ifdef _WIN32
+        header->ownerProcessId = GetCurrentProcessId();
+#else
+        header->ownerProcessId = (uint32_t)getpid();
+#endif
+        header->capacity = region.size - sizeof(SharedSlotHeader);
+        header->slotCount = 0;
+    } else {
+        const SharedSlotHeader* header = reinterpret_cast<const SharedSlotHeader*>(region.base);
+        if (header->magic != SHARED_REGION_MAGIC || header->version != SHARED_REGION_VERSION) {
+            closeSharedSlots(region);
+            return false;
+        }
+    }
+    return true;
+}
+
+void publishSharedSlots(SharedSlotRegion& region, const SlotTable& storedSlots) {
+    // Owner only: rewrites the whole region inside one seqlock write section
+    if (!region.owner || region.base == nullptr) {
+        return;
+    }
+    SharedSlotHeader* header = reinterpret_cast<SharedSlotHeader*>(region.base);
+    SharedSlotEntry* entries = reinterpret_cast<SharedSlotEntry*>(region.base + sizeof(SharedSlotHeader));
+    
+    size_t count = storedSlots.size();
+    size_t tableEnd = sizeof(SharedSlotHeader) + count * sizeof(SharedSlotEntry);
+    if (tableEnd > region.size) {
+        count = (region.size - sizeof(SharedSlotHeader)) / sizeof(SharedSlotEntry);
+        tableEnd = sizeof(SharedSlotHeader) + count * sizeof(SharedSlotEntry);
+    }
+    
+    uint32_t sequence = header->sequence.load(std::memory_order_relaxed);
+    header->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    
+    size_t offset = tableEnd;
+    size_t index = 0;
+    for (const auto& slot : storedSlots) {
+        if (index == count) break;
+        SharedSlotEntry& entry = entries[index++];
+        
+        entry.keyLength = (uint32_t)slot.keyLength;
+        entry.keyOffset = offset;
+        if (offset + slot.keyLength > region.size) {
+            // Out of room: the key itself cannot be published
+            index--;
+            break;
+        }
+        memcpy(region.base + offset, slot.keyData, slot.keyLength);
+        offset += slot.keyLength;
+        
+        entry.valueLength = slot.valueLength;
+        if (offset + slot.valueLength <= region.size) {
+            entry.valueOffset = offset;
+            memcpy(region.base + offset, slot.valueData, slot.valueLength);
+            offset += slot.valueLength;
+        } else {
+            entry.valueOffset = SHARED_NOT_PUBLISHED;
+        }
+    }
+    header->slotCount = (uint32_t)index;
+    
+    std::atomic_thread_fence(std::memory_order_release);
+    header->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+template <typename Visitor>
+bool visitSharedSlot(const SharedSlotRegion& region, const std::string& slotNum, Visitor visit) {
+    // Calls visit(data, length) directly on the shared bytes. visit may run
+    // again if the owner published meanwhile, and must only copy or scan.
+    // Returns false if the slot is absent or not published, or if no stable
+    // read was possible in SHARED_READ_MAX_TRIES (read the file).
+    if (region.base == nullptr) {
+        return false;
+    }
+    const SharedSlotHeader* header = reinterpret_cast<const SharedSlotHeader*>(region.base);
+    const SharedSlotEntry* entries = reinterpret_cast<const SharedSlotEntry*>(region.base + sizeof(SharedSlotHeader));
+    
+    for (int tries = 0; tries < SHARED_READ_MAX_TRIES; tries++) {
+        uint32_t before = header->sequence.load(std::memory_order_acquire);
+        if (before & 1) {
+            std::this_thread::yield();
+            continue;
+        }
+        
+        // Binary search on the sorted keys
+        bool found = false;
+        bool published = false;
+        size_t low = 0;
+        size_t high = std::min<size_t>(header->slotCount, (region.size - sizeof(SharedSlotHeader)) / sizeof(SharedSlotEntry));
+        while (low < high) {
+            size_t middle = (low + high) / 2;
+            const SharedSlotEntry& entry = entries[middle];
+            if (entry.keyOffset + entry.keyLength > region.size) break;    // Torn read
+            int order = slotNum.compare(0, std::string::npos, region.base + entry.keyOffset, entry.keyLength);
+            if (order == 0) {
+                found = true;
+                if (entry.valueOffset != SHARED_NOT_PUBLISHED && entry.valueOffset + entry.valueLength <= region.size) {
+                    published = true;
+                    visit(region.base + entry.valueOffset, (size_t)entry.valueLength);
+                }
+                break;
+            }
+            if (order < 0) {
+                high = middle;
+            } else {
+                low = middle + 1;
+            }
+        }
+        
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (header->sequence.load(std::memory_order_relaxed) == before) {
+            return found && published;
+        }
+    }
+    return false;
+}
+
+bool readSharedSlot(const SharedSlotRegion& region, const std::string& slotNum, std::string& content) {
+    std::string stored;
+    if (!visitSharedSlot(region, slotNum, [&stored](const char* data, size_t length) {
+        stored.assign(data, length);
+    })) {
+        return false;
+    }
+    return decodeStoredValue(slotNum, stored, content);
+}
+
+#ifdef _WIN32
+bool sendSlotMutation(unsigned long op, const std::string& slotNum, const std::string& content) {
+    // Non-owners never rewrite the file: the owner applies the change
+    HWND owner = FindWindowA(WINDOW_CLASS_NAME, NULL);
+    if (owner == NULL) {
+        return false;
+    }
+    std::string message = slotNum;
+    message += '\0';
+    message += content;
+    
+    COPYDATASTRUCT data;
+    data.dwData = op;
+    data.cbData = (DWORD)message.size();
+    data.lpData = &message[0];
+    return SendMessageA(owner, WM_COPYDATA, 0, (LPARAM)&data) != 0;
+}
+#endif
+
+// ========================================
+// SLOT VERSION HISTORY
+// ========================================
+// Each slot keeps its last SLOT_HISTORY_DEPTH replaced contents in a
+// fixed ring, and payloads are shared (never copied) between versions and
+// undo entries.
+// Only the action worker touches this state.
+
+const size_t SLOT_HISTORY_DEPTH = 8;
+const size_t UNDO_DEPTH = 16;
+const size_t HISTORY_FILE_MAX_RECORDS = 500;
+
+struct SlotVersions {
+    // Ring of the newest SLOT_HISTORY_DEPTH contents: a new version takes
+    // the place of the oldest one, one pointer copy whatever the depth
+    std::shared_ptr<const std::string> contents[SLOT_HISTORY_DEPTH];
+    size_t next = 0;
+    size_t count = 0;
+    
+    void push(const std::shared_ptr<const std::string>& content) {
+        contents[next] = content;
+        next = (next + 1) % SLOT_HISTORY_DEPTH;
+        count = std::min(count + 1, SLOT_HISTORY_DEPTH);
+    }
+};
+
+struct UndoEntry {
+    // Slot and content before the action (null: the slot did not exist)
+    typedef std::vector<std::pair<std::string, std::shared_ptr<const std::string>>> Changes;
+    std::string description;
+    Changes changes;
+};
+
+std::map<std::string, SlotVersions> g_slotVersions;
+std::deque<UndoEntry> g_undoStack;
+std::atomic<size_t> g_historyFileRecords(0);
+
+void trimHistoryFile() {
+    // Keep only the newest HISTORY_FILE_MAX_RECORDS records
+    std::ifstream fileIn(HISTORY_FILE);
+    std::deque<std::string> records;
+    std::string line;
+    while (std::getline(fileIn, line)) {
+        records.push_back(line);
+        if (records.size() > HISTORY_FILE_MAX_RECORDS) {
+            records.pop_front();
+        }
+    }
+    fileIn.close();
+    
+    std::ofstream fileOut(HISTORY_FILE, std::ios::out | std::ios::trunc);
+    for (const auto& record : records) {
+        fileOut << record << "\n";
+    }
+    g_historyFileRecords = records.size();
+}
+
+void recordVersion(const std::string& slotNum, const std::shared_ptr<const std::string>& content) {
+    // Empty or missing contents are not worth a version
+    if (!content || content->empty()) {
+        return;
+    }
+    PhaseScope phase("recordVersion");
+    g_slotVersions[slotNum].push(content);
+    
+    // Bounded on-disk copy, trimmed once it doubles its limit
+    std::ofstream file(HISTORY_FILE, std::ios::out | std::ios::app);
+    if (file.is_open()) {
+        file << (long long)time(nullptr) << "|" << slotNum << "|" << encodeStoredValue(slotNum, *content) << "\n";
+        file.close();
+        if (++g_historyFileRecords > 2 * HISTORY_FILE_MAX_RECORDS) {
+            trimHistoryFile();
+        }
+    }
+}
+
+void loadSlotHistory() {
+    // Rebuild the in-memory versions from the on-disk history
+    std::ifstream file(HISTORY_FILE);
+    if (!file.is_open()) {
+        return;
+    }
+    
+    std::string line;
+    while (std::getline(file, line)) {
+        g_historyFileRecords++;
+        size_t firstPipe = line.find('|');
+        size_t secondPipe = firstPipe == std::string::npos ? std::string::npos : line.find('|', firstPipe + 1);
+        if (secondPipe == std::string::npos) {
+            continue;
+        }
+        std::string slotNum = line.substr(firstPipe + 1, secondPipe - firstPipe - 1);
+        std::string content;
+        if (!decodeStoredValue(slotNum, line.substr(secondPipe + 1), content)) {
+            continue;
+        }
+        g_slotVersions[slotNum].push(std::make_shared<const std::string>(std::move(content)));
+    }
+    file.close();
+}
+
+size_t slotVersionCount(const std::string& slotNum) {
+    auto it = g_slotVersions.find(slotNum);
+    return it == g_slotVersions.end() ? 0 : it->second.count;
+}
+
+void pushUndo(const std::string& description, const UndoEntry::Changes& changes) {
+    if (changes.empty()) {
+        return;
+    }
+    g_undoStack.push_back({description, changes});
+    if (g_undoStack.size() > UNDO_DEPTH) {
+        g_undoStack.pop_front();
+    }
+}
+
+// ========================================
+// SLOT FINGERPRINTS
+// ========================================
+// Hash and size of what each slot holds, plus the clipboard sequence number
+// seen when it was last saved. A SAVE of an unchanged clipboard is detected
+// from these and skipped without rewriting the store.
+
+struct SlotFingerprint {
+    uint64_t hash;
+    size_t size;
+    unsigned long sequence;     // Clipboard sequence at the last SAVE, 0 if unknown
+};
+
+// Store file as we last wrote it: an edit by hand invalidates every
+// fingerprint. The write time is kept to the file system's precision (a
+// same-size edit within the second must be seen), and the identity tells
+// a file replaced by another (an editor saving through a rename).
+struct StoreStamp {
+    long long size = -1;
+    long long modified = 0;             // Nanoseconds on POSIX, 100 ns units on Windows
+    unsigned long long identity = 0;    // Inode, or volume and file index
+    
+    bool operator==(const StoreStamp& other) const {
+        return size == other.size && modified == other.modified && identity == other.identity;
+    }
+};
+
+struct SaveStats {
+    unsigned long written = 0;
+    unsigned long skipped = 0;
+    unsigned long clipboardReadsSkipped = 0;   // Skipped on the sequence number alone
+    unsigned long long bytesSaved = 0;         // Store bytes not rewritten
+};
+
+std::map<std::string, SlotFingerprint> g_slotFingerprints;
+StoreStamp g_storeStamp;
+
+// Superseded lines (appends) and deleted slots, dropped by the next full rewrite
+std::atomic<size_t> g_storeStaleRecords(0);
+SaveStats g_saveStats;
+
+uint64_t hashContent(const char* data, size_t length) {
+    // 8 bytes per step with a multiply-xorshift mix: equal hashes are
+    // only trusted together with an equal size
+    uint64_t hash = 0x9E3779B97F4A7C15ULL ^ length;
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        word *= 0xFF51AFD7ED558CCDULL;
+        word ^= word >> 32;
+        hash = (hash ^ word) * 0x9E3779B97F4A7C15ULL;
+        hash = (hash << 29) | (hash >> 35);
+    }
+    if (i < length) {
+        uint64_t word = 0;
+        memcpy(&word, data + i, length - i);
+        word *= 0xFF51AFD7ED558CCDULL;
+        word ^= word >> 32;
+        hash = (hash ^ word) * 0x9E3779B97F4A7C15ULL;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+StoreStamp currentStoreStamp() {
+    StoreStamp stamp;
+#ifdef _WIN32
+    // Attributes only: no read access, and no sharing mode is denied
+    HANDLE file = CreateFileA(SAVE_FILE.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                              OPEN_EXISTING, 0, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return stamp;
+    }
+    BY_HANDLE_FILE_INFORMATION info;
+    if (GetFileInformationByHandle(file, &info)) {
+        stamp.size = (long long)(((unsigned long long)info.nFileSizeHigh << 32) | info.nFileSizeLow);
+        stamp.modified = (long long)(((unsigned long long)info.ftLastWriteTime.dwHighDateTime << 32) |
+                                     info.ftLastWriteTime.dwLowDateTime);
+        stamp.identity = ((unsigned long long)info.dwVolumeSerialNumber << 40) ^
+                         ((unsigned long long)info.nFileIndexHigh << 32) ^ info.nFileIndexLow;
+    }
+    CloseHandle(file);
+#else
+    struct stat info;
+    if (stat(SAVE_FILE.c_str(), &info) == 0) {
+        stamp.size = (long long)info.st_size;
+#ifdef __APPLE__
+        stamp.modified = (long long)info.st_mtimespec.tv_sec * 1000000000LL + info.st_mtimespec.tv_nsec;
+#else
+        stamp.modified = (long long)info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec;
+#endif
+        stamp.identity = (unsigned long long)info.st_ino;
+    }
+#endif
+    return stamp;
+}
+
+void setFingerprint(const std::string& slotNum, const std::string& content) {
+    g_slotFingerprints[slotNum] = {hashContent(content.data(), content.size()), content.size(), 0};
+}
+
+void forgetSlotCaches(const std::string& slotNum) {
+    g_slotFingerprints.erase(slotNum);
+    g_compiledTemplates.erase(slotNum);
+}
+
+// ========================================
+// SLOT METADATA
+// ========================================
+// When each numbered slot got its content and was last used, how many
+// times it was loaded, its size, the application it was copied from and
+// the category of its content.
+// The table is columnar: one array per attribute and one row per slot, so
+// ordering or filtering all slots reads only the columns involved (the
+// last-use times of a million slots are 8 MB). A slot number finds its row
+// through a hash map, and a dropped row is replaced by the last one. Rows
+// changed by an action are appended to <store>.meta when the action ends,
+// and the journal is rewritten from the columns once most of it is
+// outdated. Only the action worker touches the table.
+
+enum SlotView {
+    VIEW_NUMBER,      // Slot number order
+    VIEW_RECENT,      // Most recently used first
+    VIEW_FREQUENT,    // Most loaded first
+    VIEW_UNUSED       // Only the slots unused for g_unusedDays days, oldest first
+};
+
+// Order of the additional slots in the console (console commands)
+std::atomic<int> g_slotView(VIEW_NUMBER);
+std::atomic<unsigned long> g_unusedDays(90);
+
+const size_t METADATA_SOURCE_MAX = 65535;
+
+class SlotMetadataTable {
+public:
+    // Columns, one entry per row
+    std::vector<uint32_t> slot;
+    std::vector<int64_t> created;      // Time the slot got its content, 0 if unknown
+    std::vector<int64_t> lastUsed;     // Last SAVE or LOAD
+    std::vector<uint32_t> uses;        // LOAD and TYPE count
+    std::vector<uint64_t> size;        // Content bytes
+    std::vector<uint16_t> source;      // Index in sources, 0 if unknown
+    std::vector<uint8_t> category;     // ContentCategory
+    
+    std::vector<std::string> sources = {""};
+    
+    size_t count() const {
+        return slot.size();
+    }
+    
+    bool find(uint32_t number, uint32_t& row) const {
+        auto it = m_rows.find(number);
+        if (it == m_rows.end()) {
+            return false;
+        }
+        row = it->second;
+        return true;
+    }
+    
+    uint32_t row(uint32_t number) {
+        // Row of the slot, added empty if needed
+        auto inserted = m_rows.emplace(number, (uint32_t)slot.size());
+        if (inserted.second) {
+            slot.push_back(number);
+            created.push_back(0);
+            lastUsed.push_back(0);
+            uses.push_back(0);
+            size.push_back(0);
+            source.push_back(0);
+            category.push_back(CATEGORY_NONE);
+        }
+        return inserted.first->second;
+    }
+    
+    bool drop(uint32_t number) {
+        auto it = m_rows.find(number);
+        if (it == m_rows.end()) {
+            return false;
+        }
+        uint32_t index = it->second;
+        uint32_t last = (uint32_t)slot.size() - 1;
+        m_rows.erase(it);
+        if (index != last) {
+            moveRow(last, index);
+            m_rows[slot[index]] = index;
+        }
+        resize(last);
+        return true;
+    }
+    
+    uint16_t internSource(const std::string& name) {
+        if (name.empty()) {
+            return 0;
+        }
+        auto it = m_sourceIndex.find(name);
+        if (it != m_sourceIndex.end()) {
+            return it->second;
+        }
+        if (sources.size() > METADATA_SOURCE_MAX) {
+            return 0;
+        }
+        setSource((uint16_t)sources.size(), name);
+        return (uint16_t)(sources.size() - 1);
+    }
+    
+    void setSource(uint16_t index, const std::string& name) {
+        if (index >= sources.size()) {
+            sources.resize(index + 1);
+        }
+        sources[index] = name;
+        m_sourceIndex[name] = index;
+    }
+    
+    void moveRow(uint32_t from, uint32_t to) {
+        slot[to] = slot[from];
+        created[to] = created[from];
+        lastUsed[to] = lastUsed[from];
+        uses[to] = uses[from];
+        size[to] = size[from];
+        source[to] = source[from];
+        category[to] = category[from];
+    }
+    
+    void resize(size_t rows) {
+        slot.resize(rows);
+        created.resize(rows);
+        lastUsed.resize(rows);
+        uses.resize(rows);
+        size.resize(rows);
+        source.resize(rows);
+        category.resize(rows);
+    }
+    
+    void reindex() {
+        // After slot numbers were changed in place
+        m_rows.clear();
+        m_rows.reserve(slot.size());
+        for (uint32_t i = 0; i < slot.size(); i++) {
+            m_rows[slot[i]] = i;
+        }
+    }
+    
+    void clear() {
+        resize(0);
+        m_rows.clear();
+        sources.assign(1, "");
+        m_sourceIndex.clear();
+    }
+    
+    // Journal state: slots changed since the last flush (dropped ones
+    // included), or the whole table after a bulk change
+    std::vector<uint32_t> changed;
+    bool rewrite = false;
+    size_t sourcesWritten = 1;
+    size_t journalLines = 0;
+    
+private:
+    std::unordered_map<uint32_t, uint32_t> m_rows;
+    std::map<std::string, uint16_t> m_sourceIndex;
+};
+
+SlotMetadataTable g_slotMetadata;
+
+bool parseSlotNumber(const char* key, size_t length, unsigned long& number) {
+    // Only the canonical spelling of a number belongs to a range ("12", not "012")
+    if (length == 0 || length > 9 || (key[0] == '0' && length > 1)) {
+        return false;
+    }
+    number = 0;
+    for (size_t i = 0; i < length; i++) {
+        if (key[i] < '0' || key[i] > '9') {
+            return false;
+        }
+        number = number * 10 + (key[i] - '0');
+    }
+    return number > 0;
+}
+
+bool metadataSlot(const std::string& slotNum, uint32_t& number) {
+    // Slots named by hand in the file ("notes", "012") have no metadata
+    unsigned long parsed;
+    if (!parseSlotNumber(slotNum.data(), slotNum.size(), parsed)) {
+        return false;
+    }
+    number = (uint32_t)parsed;
+    return true;
+}
+
+void dropSlotMetadata(const std::string& slotNum) {
+    uint32_t number;
+    if (metadataSlot(slotNum, number) && g_slotMetadata.drop(number)) {
+        g_slotMetadata.changed.push_back(number);
+    }
+}
+
+void noteSlotWritten(const std::string& slotNum, size_t bytes, const std::string* content = nullptr) {
+    // New content (SAVE, undo, sync): an emptied slot has no metadata left.
+    // Without the content (unchanged SAVE) the category is kept.
+    uint32_t number;
+    if (!metadataSlot(slotNum, number)) {
+        return;
+    }
+    if (bytes == 0) {
+        dropSlotMetadata(slotNum);
+        return;
+    }
+    SlotMetadataTable& table = g_slotMetadata;
+    uint32_t row = table.row(number);
+    int64_t now = (int64_t)time(nullptr);
+    if (table.created[row] == 0) {
+        table.created[row] = now;
+    }
+    table.lastUsed[row] = now;
+    table.size[row] = bytes;
+    if (content) {
+        table.category[row] = classifyContent(*content);
+    }
+    table.changed.push_back(number);
+}
+
+void noteSlotSource(const std::string& slotNum, const std::string& application) {
+    uint32_t number;
+    uint32_t row;
+    if (metadataSlot(slotNum, number) && g_slotMetadata.find(number, row)) {
+        g_slotMetadata.source[row] = g_slotMetadata.internSource(application);
+        g_slotMetadata.changed.push_back(number);
+    }
+}
+
+void noteSlotLoaded(const std::string& slotNum, size_t bytes) {
+    // A slot saved before metadata existed gets a row with an unknown creation time
+    uint32_t number;
+    if (!metadataSlot(slotNum, number)) {
+        return;
+    }
+    SlotMetadataTable& table = g_slotMetadata;
+    uint32_t row = table.row(number);
+    table.lastUsed[row] = (int64_t)time(nullptr);
+    if (table.uses[row] != UINT32_MAX) {
+        table.uses[row]++;
+    }
+    table.size[row] = bytes;
+    table.changed.push_back(number);
+}
+
+void applyRangeToMetadata(const RangeOp& op) {
+    // Same plan as the slots: rows follow their content, a copy starts with
+    // no use, and the rows of overwritten or deleted slots are dropped
+    SlotMetadataTable& table = g_slotMetadata;
+    unsigned long blockSize = op.last - op.first + 1;
+    auto inBlock = [blockSize](unsigned long number, unsigned long start) {
+        return number >= start && number - start < blockSize;
+    };
+    
+    SlotMetadataTable copies;
+    int64_t now = (int64_t)time(nullptr);
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < table.count(); i++) {
+        unsigned long number = table.slot[i];
+        bool inSource = inBlock(number, op.first);
+        bool inTarget = op.kind != RANGE_DELETE && inBlock(number, op.target);
+        if (op.kind == RANGE_COPY && inSource) {
+            uint32_t copy = copies.row((uint32_t)(number - op.first + op.target));
+            copies.created[copy] = now;
+            copies.lastUsed[copy] = now;
+            copies.size[copy] = table.size[i];
+            copies.source[copy] = table.source[i];
+            copies.category[copy] = table.category[i];
+        }
+        if (inSource && (op.kind == RANGE_MOVE || op.kind == RANGE_SWAP)) {
+            number = number - op.first + op.target;
+        } else if (inTarget && op.kind == RANGE_SWAP) {
+            number = number - op.target + op.first;
+        } else if (inTarget || (inSource && op.kind == RANGE_DELETE)) {
+            continue;
+        }
+        table.moveRow(i, kept);
+        table.slot[kept++] = (uint32_t)number;
+    }
+    table.resize(kept);
+    for (uint32_t i = 0; i < copies.count(); i++) {
+        table.resize(kept + 1);
+        table.slot[kept] = copies.slot[i];
+        table.created[kept] = copies.created[i];
+        table.lastUsed[kept] = copies.lastUsed[i];
+        table.uses[kept] = 0;
+        table.size[kept] = copies.size[i];
+        table.source[kept] = copies.source[i];
+        table.category[kept] = copies.category[i];
+        kept++;
+    }
+    table.reindex();
+    table.rewrite = true;
+}
+
+void sortPackedRows(std::vector<uint64_t>& packed) {
+    // Stable LSD radix sort of key << 32 | row on the key, 11 bits per pass
+    // (a digit shared by all rows skips its pass): half the time of a
+    // comparison sort on a million rows
+    std::vector<uint64_t> buffer(packed.size());
+    for (int shift = 32; shift < 64; shift += 11) {
+        size_t offsets[2048] = {0};
+        for (uint64_t value : packed) {
+            offsets[(value >> shift) & 2047]++;
+        }
+        if (packed.empty() || offsets[(packed[0] >> shift) & 2047] == packed.size()) {
+            continue;
+        }
+        size_t total = 0;
+        for (size_t& offset : offsets) {
+            size_t count = offset;
+            offset = total;
+            total += count;
+        }
+        for (uint64_t value : packed) {
+            buffer[offsets[(value >> shift) & 2047]++] = value;
+        }
+        packed.swap(buffer);
+    }
+}
+
+std::vector<uint32_t> slotMetadataView(const SlotMetadataTable& table, SlotView view, int64_t now, unsigned long days) {
+    // Rows in view order, sorted on the seconds since their last use (and
+    // on their load count first for the most loaded view). The unused
+    // filter and the sort keys read only the columns involved.
+    const int64_t* lastUsed = table.lastUsed.data();
+    const uint32_t* uses = table.uses.data();
+    int64_t cutoff = now - (int64_t)days * 86400;
+    std::vector<uint64_t> packed;
+    packed.reserve(table.count());
+    for (uint32_t i = 0; i < table.count(); i++) {
+        if (view == VIEW_UNUSED && lastUsed[i] >= cutoff) {
+            continue;
+        }
+        uint64_t age = (uint64_t)std::min<int64_t>(std::max<int64_t>(now - lastUsed[i], 0), UINT32_MAX);
+        packed.push_back((view == VIEW_UNUSED ? UINT32_MAX - age : age) << 32 | i);
+    }
+    if (view != VIEW_NUMBER) {
+        sortPackedRows(packed);
+    }
+    if (view == VIEW_FREQUENT) {
+        // Stable: equal counts stay in recent order
+        for (uint64_t& value : packed) {
+            uint32_t row = (uint32_t)value;
+            value = (uint64_t)(UINT32_MAX - uses[row]) << 32 | row;
+        }
+        sortPackedRows(packed);
+    }
+    
+    std::vector<uint32_t> rows(packed.size());
+    for (size_t i = 0; i < packed.size(); i++) {
+        rows[i] = (uint32_t)packed[i];
+    }
+    return rows;
+}
+
+size_t countUnusedSlots(const SlotMetadataTable& table, int64_t now, unsigned long days) {
+    int64_t cutoff = now - (int64_t)days * 86400;
+    const int64_t* lastUsed = table.lastUsed.data();
+    size_t count = 0;
+    for (size_t i = 0; i < table.count(); i++) {
+        count += lastUsed[i] < cutoff;
+    }
+    return count;
+}
+
+std::string formatSlotUsage(const SlotMetadataTable& table, uint32_t row, int64_t now) {
+    // "5 loads, used 3 h ago, from notepad.exe"
+    int64_t age = std::max<int64_t>(0, now - table.lastUsed[row]);
+    char text[160];
+    int length;
+    if (age < 120) {
+        length = snprintf(text, sizeof(text), "%u load(s), used %lld s ago", table.uses[row], (long long)age);
+    } else if (age < 7200) {
+        length = snprintf(text, sizeof(text), "%u load(s), used %lld min ago", table.uses[row], (long long)(age / 60));
+    } else if (age < 172800) {
+        length = snprintf(text, sizeof(text), "%u load(s), used %lld h ago", table.uses[row], (long long)(age / 3600));
+    } else {
+        length = snprintf(text, sizeof(text), "%u load(s), used %lld days ago", table.uses[row], (long long)(age / 86400));
+    }
+    std::string usage(text, std::min<size_t>(length, sizeof(text) - 1));
+    if (table.source[row] != 0) {
+        usage += ", from " + table.sources[table.source[row]];
+    }
+    return usage;
+}
+
+std::string slotMetadataLine(const SlotMetadataTable& table, uint32_t row) {
+    // S|slot|created|last used|uses|size|source|category
+    char line[128];
+    snprintf(line, sizeof(line), "S|%u|%lld|%lld|%u|%llu|%u|%u", table.slot[row], (long long)table.created[row],
+             (long long)table.lastUsed[row], table.uses[row], (unsigned long long)table.size[row], table.source[row],
+             table.category[row]);
+    return line;
+}
+
+void loadSlotMetadata() {
+    // Later lines of the journal replace earlier ones
+    SlotMetadataTable& table = g_slotMetadata;
+    table.clear();
+    table.changed.clear();
+    table.rewrite = false;
+    table.journalLines = 0;
+    std::ifstream file(SAVE_FILE + ".meta");
+    std::string line;
+    while (std::getline(file, line)) {
+        table.journalLines++;
+        const char* text = line.c_str();
+        char* end;
+        if (line.compare(0, 4, "SRC|") == 0) {
+            unsigned long index = strtoul(text + 4, &end, 10);
+            if (*end == '|' && index > 0 && index <= METADATA_SOURCE_MAX) {
+                table.setSource((uint16_t)index, end + 1);
+            }
+        } else if (line.compare(0, 2, "D|") == 0) {
+            table.drop((uint32_t)strtoul(text + 2, nullptr, 10));
+        } else if (line.compare(0, 2, "S|") == 0) {
+            // Lines written before categories existed have no last field
+            unsigned long long fields[7] = {0};
+            const char* field = text + 2;
+            int parsed = 0;
+            for (; parsed < 7; parsed++) {
+                fields[parsed] = strtoull(field, &end, 10);
+                if (end == field) {
+                    break;
+                }
+                if (*end != '|') {
+                    parsed++;
+                    break;
+                }
+                field = end + 1;
+            }
+            if (parsed < 6 || fields[0] == 0 || fields[0] > RANGE_SLOT_MAX) {
+                continue;
+            }
+            uint32_t row = table.row((uint32_t)fields[0]);
+            table.created[row] = (int64_t)fields[1];
+            table.lastUsed[row] = (int64_t)fields[2];
+            table.uses[row] = (uint32_t)std::min<unsigned long long>(fields[3], UINT32_MAX);
+            table.size[row] = fields[4];
+            table.source[row] = fields[5] < table.sources.size() ? (uint16_t)fields[5] : 0;
+            table.category[row] = fields[6] < CATEGORY_COUNT ? (uint8_t)fields[6] : (uint8_t)CATEGORY_NONE;
+        }
+    }
+    table.sourcesWritten = table.sources.size();
+}
+
+bool flushSlotMetadata() {
+    // Appends the rows changed by the last action, or rewrites the journal
+    // from the columns once more than half of it is outdated
+    SlotMetadataTable& table = g_slotMetadata;
+    if (table.changed.empty() && !table.rewrite && table.sourcesWritten == table.sources.size()) {
+        return true;
+    }
+    PhaseScope phase("flushSlotMetadata");
+    std::sort(table.changed.begin(), table.changed.end());
+    table.changed.erase(std::unique(table.changed.begin(), table.changed.end()), table.changed.end());
+    
+    size_t live = table.count() + table.sources.size() - 1;
+    size_t added = table.changed.size() + table.sources.size() - table.sourcesWritten;
+    bool append = !table.rewrite && table.journalLines + added <= 2 * live + 64;
+    
+    std::string text;
+    size_t firstSource = append ? table.sourcesWritten : 1;
+    for (size_t i = firstSource; i < table.sources.size(); i++) {
+        text += "SRC|" + std::to_string(i) + "|" + table.sources[i] + "\n";
+    }
+    if (append) {
+        for (uint32_t number : table.changed) {
+            uint32_t row;
+            text += table.find(number, row) ? slotMetadataLine(table, row) : "D|" + std::to_string(number);
+            text += "\n";
+        }
+    } else {
+        text.reserve(text.size() + table.count() * 40);
+        for (uint32_t row = 0; row < table.count(); row++) {
+            text += slotMetadataLine(table, row);
+            text += "\n";
+        }
+    }
+    
+    std::ofstream file(SAVE_FILE + ".meta", std::ios::out | std::ios::binary | (append ? std::ios::app : std::ios::trunc));
+    file.write(text.data(), text.size());
+    table.journalLines = append ? table.journalLines + added : live;
+    table.changed.clear();
+    table.rewrite = false;
+    table.sourcesWritten = table.sources.size();
+    return file.good();
+}
+
+// ========================================
+// PRIMARY SLOT CACHE
+// ========================================
+// Slots 1-10 take most LOADs, so they are kept ready to publish: as the
+// UTF-16 text SetClipboardData takes, with their TRANSFORM steps applied.
+// A LOAD of one is then a single copy into the clipboard block instead of
+// a file scan, an unescape and a conversion. Every store file we write
+// refreshes the cache, re-rendering only the slots whose stored form
+// changed. It is trusted while the file is still the one it was built
+// from: after an edit by hand, the next LOAD rebuilds it from one read.
+
+const size_t PRIMARY_CACHE_MAX_BYTES = 16 << 20;   // Larger slots take the file path
+
+struct PrimarySlotCache {
+    bool ready = false;
+    uint64_t storedHash = 0;       // Stored form (escaped or sealed) it was rendered from
+    size_t storedSize = 0;
+    size_t slotBytes = 0;          // Content before the TRANSFORM steps
+    bool transformed = false;
+    std::string text;              // What the clipboard receives
+    std::vector<uint16_t> units;   // The same, in UTF-16 without terminator
+};
+
+struct LoadLatency {
+    unsigned long count = 0;
+    unsigned long cached = 0;
+    double totalUs = 0;
+    double maxUs = 0;
+};
+
+PrimarySlotCache g_primaryCache[10];
+StoreStamp g_primaryCacheStamp;
+LoadLatency g_primaryLoads;      // Slots 1-10
+LoadLatency g_additionalLoads;   // Every other slot
+
+void renderPrimarySlot(int index, const char* stored, size_t length) {
+    PrimarySlotCache& cache = g_primaryCache[index];
+    uint64_t hash = hashContent(stored, length);
+    if (cache.ready && cache.storedSize == length && cache.storedHash == hash) {
+        return;
+    }
+    PhaseScope phase("renderPrimarySlot", length);
+    cache = PrimarySlotCache();
+    cache.storedHash = hash;
+    cache.storedSize = length;
+    std::string key = std::to_string(index + 1);
+    std::string content;
+    if (length > PRIMARY_CACHE_MAX_BYTES || !decodeStoredValue(key, std::string(stored, length), content)) {
+        return;
+    }
+    cache.slotBytes = content.size();
+    cache.transformed = transformSlotContent(key, false, content);
+    cache.units.resize(content.size());
+    cache.units.resize(utf8ToUtf16(content.data(), content.size(), cache.units.data()));
+    cache.text = std::move(content);
+    cache.ready = true;
+}
+
+void refreshPrimaryCache(const char* const* values, const size_t* lengths) {
+    // values[i] is the stored form of slot i + 1 (null: empty)
+    for (int i = 0; i < 10; i++) {
+        renderPrimarySlot(i, values[i] ? values[i] : "", values[i] ? lengths[i] : 0);
+    }
+    g_primaryCacheStamp = currentStoreStamp();
+}
+
+void refreshPrimaryCache(const SlotTable& slots) {
+    const char* values[10] = {nullptr};
+    size_t lengths[10] = {0};
+    for (int i = 0; i < 10; i++) {
+        SlotTable::Entry entry;
+        if (slots.findEntry(std::to_string(i + 1), entry)) {
+            values[i] = entry.valueData;
+            lengths[i] = entry.valueLength;
+        }
+    }
+    refreshPrimaryCache(values, lengths);
+}
+
+void dropPrimaryCache() {
+    for (auto& cache : g_primaryCache) {
+        cache = PrimarySlotCache();
+    }
+    g_primaryCacheStamp = StoreStamp();
+}
+
+void noteLoadLatency(bool primary, bool cached, std::chrono::steady_clock::time_point start) {
+    LoadLatency& loads = primary ? g_primaryLoads : g_additionalLoads;
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    loads.count++;
+    loads.cached += cached ? 1 : 0;
+    loads.totalUs += us;
+    loads.maxUs = std::max(loads.maxUs, us);
+}
+
+std::string formatLoadLatency(const LoadLatency& loads, bool primary) {
+    char text[96];
+    int length = snprintf(text, sizeof(text), "%lu", loads.count);
+    if (primary) {
+        length += snprintf(text + length, sizeof(text) - length, " (%lu from cache)", loads.cached);
+    }
+    snprintf(text + length, sizeof(text) - length, ", avg %.0f us / max %.0f us",
+             loads.count ? loads.totalUs / loads.count : 0.0, loads.maxUs);
+    return text;
+}
+
+// ========================================
+// SLOT SNAPSHOTS
+// ========================================
+// Readers in this process (console display, search) see the slots through
+// an immutable snapshot of the table, replaced as a whole after every
+// store write. A reader never takes a lock: it announces the epoch it
+// starts in, loads the current snapshot and withdraws its announcement
+// when done. The writer swaps the new snapshot in and frees a replaced one
+// only once no reader announced at or before the swap is left, so
+// publishing never waits for readers either. Other processes keep reading
+// the shared slot region under its seqlock.
+
+struct SlotSnapshot {
+    SlotTable slots;        // Stored form (escaped or sealed), sorted by key
+    StoreStamp stamp;       // Store file it was taken from
+    uint64_t version;
+};
+
+// One announcement per reading thread, each on its own cache line so that
+// readers never write to a shared line
+const size_t SNAPSHOT_MAX_READERS = 64;
+
+struct alignas(64) SnapshotReaderSlot {
+    std::atomic<uint64_t> epoch{0};      // 0: not reading
+    std::atomic<bool> claimed{false};
+    unsigned depth = 0;                  // Nested reads, owner thread only
+};
+
+SnapshotReaderSlot g_snapshotReaders[SNAPSHOT_MAX_READERS];
+std::atomic<unsigned> g_snapshotOverflowReaders(0);   // Threads without a slot: nothing is freed meanwhile
+std::atomic<const SlotSnapshot*> g_slotSnapshot(nullptr);
+std::atomic<uint64_t> g_snapshotEpoch(1);
+
+std::mutex g_snapshotWriteMutex;
+std::vector<std::pair<uint64_t, const SlotSnapshot*>> g_retiredSnapshots;   // Epoch of the swap, snapshot
+uint64_t g_snapshotVersion = 0;
+
+struct SnapshotReaderClaim {
+    SnapshotReaderSlot* slot = nullptr;
+    
+    SnapshotReaderClaim() {
+        for (auto& candidate : g_snapshotReaders) {
+            bool expected = false;
+            if (candidate.claimed.compare_exchange_strong(expected, true)) {
+                slot = &candidate;
+                return;
+            }
+        }
+    }
+    ~SnapshotReaderClaim() {
+        if (slot) {
+            slot->claimed.store(false, std::memory_order_release);
+        }
+    }
+};
+
+class SnapshotReader {
+public:
+    SnapshotReader() {
+        static thread_local SnapshotReaderClaim claim;
+        m_slot = claim.slot;
+        if (m_slot == nullptr) {
+            g_snapshotOverflowReaders.fetch_add(1);
+        } else if (m_slot->depth++ == 0) {
+            m_slot->epoch.store(g_snapshotEpoch.load());
+        }
+        m_snapshot = g_slotSnapshot.load();
+    }
+    ~SnapshotReader() {
+        if (m_slot == nullptr) {
+            g_snapshotOverflowReaders.fetch_sub(1);
+        } else if (--m_slot->depth == 0) {
+            m_slot->epoch.store(0, std::memory_order_release);
+        }
+    }
+    SnapshotReader(const SnapshotReader&) = delete;
+    SnapshotReader& operator=(const SnapshotReader&) = delete;
+    
+    // Null until the first store write (or startup read) is published
+    const SlotSnapshot* get() const {
+        return m_snapshot;
+    }
+    
+private:
+    SnapshotReaderSlot* m_slot;
+    const SlotSnapshot* m_snapshot;
+};
+
+void reclaimSnapshots() {
+    // Caller holds g_snapshotWriteMutex. A snapshot swapped out at epoch E
+    // can still be in use by a reader that announced E or less.
+    if (g_snapshotOverflowReaders.load() > 0) {
+        return;
+    }
+    uint64_t oldest = UINT64_MAX;
+    for (const auto& reader : g_snapshotReaders) {
+        uint64_t epoch = reader.epoch.load();
+        if (epoch != 0) {
+            oldest = std::min(oldest, epoch);
+        }
+    }
+    size_t kept = 0;
+    for (const auto& retired : g_retiredSnapshots) {
+        if (retired.first < oldest) {
+            delete retired.second;
+        } else {
+            g_retiredSnapshots[kept++] = retired;
+        }
+    }
+    g_retiredSnapshots.resize(kept);
+}
+
+void publishSlotSnapshot(const SlotTable& slots) {
+    // Live records only, copied in key order: the snapshot holds no garbage
+    PhaseScope phase("publishSlotSnapshot");
+    SlotSnapshot* snapshot = new SlotSnapshot();
+    size_t bytes = 0;
+    for (const auto& slot : slots) {
+        bytes += slot.valueLength;
+    }
+    snapshot->slots.reserve(slots.size(), bytes);
+    for (const auto& slot : slots) {
+        snapshot->slots.append(slot.keyData, slot.keyLength, slot.valueData, slot.valueLength);
+    }
+    snapshot->stamp = currentStoreStamp();
+    
+    std::lock_guard<std::mutex> lock(g_snapshotWriteMutex);
+    snapshot->version = ++g_snapshotVersion;
+    const SlotSnapshot* replaced = g_slotSnapshot.exchange(snapshot);
+    uint64_t epoch = g_snapshotEpoch.fetch_add(1);
+    if (replaced) {
+        g_retiredSnapshots.push_back({epoch, replaced});
+    }
+    reclaimSnapshots();
+}
+
+// Configuration lines of the store as last read or written, so that the
+// action worker can rewrite it from the snapshot without reading it again
+std::vector<std::string> g_storeConfigLines;
+
+bool copyPublishedStore(std::vector<std::string>& configLines, SlotTable& slots) {
+    // False if the file changed since the snapshot was taken (edited by
+    // hand, or never published): read it instead
+    SnapshotReader reader;
+    const SlotSnapshot* snapshot = reader.get();
+    if (snapshot == nullptr || !(snapshot->stamp == currentStoreStamp())) {
+        return false;
+    }
+    configLines = g_storeConfigLines;
+    slots = snapshot->slots;
+    return true;
+}
+
+size_t searchSlots(const std::string& needle, std::vector<std::string>& matches, size_t& sealed) {
+    // Case-insensitive (ASCII) search of the slot contents in the current
+    // snapshot, from any thread. Returns the number of slots searched.
+    SnapshotReader reader;
+    const SlotSnapshot* snapshot = reader.get();
+    if (snapshot == nullptr) {
+        return 0;
+    }
+    std::string lowered = needle;
+    std::transform(lowered.begin(), lowered.end(), lowered.begin(), ::tolower);
+    std::string content;
+    for (const auto& slot : snapshot->slots) {
+        if (slot.valueLength == 0) {
+            continue;
+        }
+        std::string stored = slot.value();
+        if (isSealedValue(stored)) {
+            sealed++;
+            continue;
+        }
+        content = unescapeString(stored);
+        std::transform(content.begin(), content.end(), content.begin(), ::tolower);
+        if (content.find(lowered) != std::string::npos) {
+            matches.push_back(slot.key());
+        }
+    }
+    return snapshot->slots.size();
+}
+
+// ========================================
+// PARALLEL SERIALIZATION
+// ========================================
+// A full store rewrite formats its lines into large pre-sized chunks on a
+// small pool of threads, then writes each chunk with a single call. The
+// next batch of chunks is formatted while the current one is written, so
+// rewriting a very large store is bound by the disk. Small stores are
+// formatted on the calling thread; both paths produce the same bytes.
+
+const size_t SERIALIZE_CHUNK_BYTES = 4 << 20;          // Bytes per formatted chunk
+const size_t PARALLEL_SERIALIZE_THRESHOLD = 8 << 20;   // Smaller stores stay single-threaded
+
+// Indices of one parallel job, taken by the pool threads and the caller
+struct ParallelJob {
+    std::function<void(size_t)> body;
+    size_t count = 0;
+    std::atomic<size_t> next{0};
+    size_t finished = 0;                    // Guarded by the pool mutex
+};
+
+class WorkerPool {
+public:
+    explicit WorkerPool(size_t threadCount) {
+        for (size_t i = 0; i < threadCount; i++) {
+            // Detached: the pool lives until the process exits
+            std::thread([this]() { workerLoop(); }).detach();
+        }
+        m_threadCount = threadCount;
+    }
+    
+    size_t threadCount() const {
+        return m_threadCount;
+    }
+    
+    std::shared_ptr<ParallelJob> submit(size_t count, std::function<void(size_t)> body) {
+        auto job = std::make_shared<ParallelJob>();
+        job->body = std::move(body);
+        job->count = count;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_jobs.push_back(job);
+        }
+        m_wake.notify_all();
+        return job;
+    }
+    
+    void wait(const std::shared_ptr<ParallelJob>& job) {
+        // The caller works on its own job instead of sleeping
+        runIndices(*job);
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [&job]() { return job->finished == job->count; });
+    }
+    
+    void run(size_t count, std::function<void(size_t)> body) {
+        wait(submit(count, std::move(body)));
+    }
+    
+private:
+    void runIndices(ParallelJob& job) {
+        size_t completed = 0;
+        size_t index;
+        while ((index = job.next.fetch_add(1)) < job.count) {
+            job.body(index);
+            completed++;
+        }
+        if (completed > 0) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            job.finished += completed;
+            if (job.finished == job.count) {
+                m_done.notify_all();
+            }
+        }
+    }
+    
+    void workerLoop() {
+        g_phaseThreadName = "store pool";
+        while (true) {
+            std::shared_ptr<ParallelJob> job;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_wake.wait(lock, [this]() {
+                    while (!m_jobs.empty() && m_jobs.front()->next.load() >= m_jobs.front()->count) {
+                        m_jobs.pop_front();
+                    }
+                    return !m_jobs.empty();
+                });
+                job = m_jobs.front();
+            }
+            runIndices(*job);
+        }
+    }
+    
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    std::deque<std::shared_ptr<ParallelJob>> m_jobs;
+    size_t m_threadCount = 0;
+};
+
+WorkerPool& workerPool() {
+    // Started on first use; never destroyed (its threads are detached)
+    // The caller of a job works too, hence one thread less than the cores
+    unsigned cores = std::thread::hardware_concurrency();
+    static WorkerPool* pool = new WorkerPool(std::max(1u, std::min(4u, cores > 1 ? cores - 1 : 1)));
+    return *pool;
+}
+
+// One store line: a configuration line verbatim, or SLOT<key>|<value>
+struct StoreLine {
+    const char* key;            // Null for a configuration line
+    size_t keyLength;
+    const char* value;
+    size_t valueLength;
+    
+    size_t size() const {
+        return (key ? 4 + keyLength + 1 + RECORD_CHECKSUM_SIZE : 0) + valueLength + 1;
+    }
+};
+
+struct StoreChunk {
+    size_t first;
+    size_t last;
+    size_t bytes;
+};
+
+void formatStoreLines(const std::vector<StoreLine>& lines, const StoreChunk& chunk, std::string& out) {
+    // Sized once, then filled with memcpy
+    PhaseScope phase("formatStoreLines", chunk.bytes);
+    out.resize(chunk.bytes);
+    char* dst = &out[0];
+    for (size_t i = chunk.first; i < chunk.last; i++) {
+        const StoreLine& line = lines[i];
+        char* lineStart = dst;
+        if (line.key) {
+            memcpy(dst, "SLOT", 4);
+            dst += 4;
+            memcpy(dst, line.key, line.keyLength);
+            dst += line.keyLength;
+            *dst++ = '|';
+        }
+        memcpy(dst, line.value, line.valueLength);
+        dst += line.valueLength;
+        if (line.key) {
+            // The checksum is computed here, on the pool threads
+            formatChecksum(dst, crc32c(lineStart, dst - lineStart));
+            dst += RECORD_CHECKSUM_SIZE;
+        }
+        *dst++ = '\n';
+    }
+}
+
+bool writeStoreLines(std::ofstream& fileOut, const std::vector<StoreLine>& lines) {
+    // Chunks of about SERIALIZE_CHUNK_BYTES, cut on line boundaries
+    std::vector<StoreChunk> chunks;
+    size_t total = 0;
+    StoreChunk current = {0, 0, 0};
+    for (size_t i = 0; i < lines.size(); i++) {
+        size_t size = lines[i].size();
+        current.bytes += size;
+        current.last = i + 1;
+        total += size;
+        if (current.bytes >= SERIALIZE_CHUNK_BYTES) {
+            chunks.push_back(current);
+            current = {i + 1, i + 1, 0};
+        }
+    }
+    if (current.last > current.first) {
+        chunks.push_back(current);
+    }
+    
+    if (total < PARALLEL_SERIALIZE_THRESHOLD) {
+        std::string buffer;
+        for (const auto& chunk : chunks) {
+            formatStoreLines(lines, chunk, buffer);
+            fileOut.write(buffer.data(), buffer.size());
+        }
+        return fileOut.good();
+    }
+    
+    // Batch n + 1 is formatted by the pool while batch n is written
+    WorkerPool& pool = workerPool();
+    size_t batchSize = pool.threadCount() + 1;
+    std::vector<std::string> batches[2];
+    
+    auto formatBatch = [&](size_t start, std::vector<std::string>& buffers) {
+        size_t count = std::min(batchSize, chunks.size() - start);
+        buffers.resize(count);
+        return pool.submit(count, [&lines, &chunks, &buffers, start](size_t index) {
+            formatStoreLines(lines, chunks[start + index], buffers[index]);
+        });
+    };
+    
+    std::shared_ptr<ParallelJob> pending = formatBatch(0, batches[0]);
+    for (size_t start = 0, batch = 0; start < chunks.size(); start += batchSize, batch ^= 1) {
+        pool.wait(pending);
+        if (start + batchSize < chunks.size()) {
+            pending = formatBatch(start + batchSize, batches[batch ^ 1]);
+        }
+        for (const auto& buffer : batches[batch]) {
+            fileOut.write(buffer.data(), buffer.size());
+        }
+    }
+    return fileOut.good();
+}
+
+// ========================================
+// DELTA STORAGE
+// ========================================
+// With DELTA_STORE=1, an additional slot that is a small edit of another
+// slot is written to the file as a delta against that base slot:
+//   SLOT<key>|\d<base key length>:<base key><ops>|<crc32c>
+// The ops rebuild the stored (escaped) form from the stored form of the
+// base: C<offset>,<length>; copies bytes of the base and I<length>:<bytes>
+// inserts new ones. Escaped text never starts with \d, and the ops contain
+// neither '|' nor line breaks. Bases are found with MinHash: every value
+// gets a sketch of DELTA_SKETCH_SIZE minimums over its 8-byte shingles,
+// values sharing a band of DELTA_BAND_ROWS minimums are candidates, and
+// the one with the most equal minimums is tried. A base always comes
+// earlier in the file and chains stop at DELTA_MAX_DEPTH, so a LOAD reads
+// at most DELTA_MAX_DEPTH more records. Only the file holds deltas: they
+// are resolved as it is read, and everything else (slot table, snapshots,
+// shared region, sync) keeps full values. Sealed values are never deltas.
+// Sketches and deltas are cached per slot until its value or base changes.
+
+const size_t DELTA_MIN_BYTES = 128;           // Smaller values are not worth a delta
+const size_t DELTA_MAX_BYTES = 1 << 20;       // Larger ones would slow every rewrite
+const int DELTA_MAX_DEPTH = 3;
+const int DELTA_SKETCH_SIZE = 16;
+const int DELTA_BAND_ROWS = 2;
+const int DELTA_MIN_MATCHES = 8;              // Of DELTA_SKETCH_SIZE minimums
+const size_t DELTA_BLOCK = 16;                // Shortest copy
+const size_t DELTA_BUCKET_MAX = 8;            // Most recent values kept per band
+
+struct DeltaSketch {
+    uint64_t hash = 0;
+    size_t size = 0;
+    uint64_t mins[DELTA_SKETCH_SIZE];
+};
+
+struct DeltaEncoding {
+    uint64_t hash = 0;
+    size_t size = 0;
+    std::string base;
+    uint64_t baseHash = 0;
+    size_t baseSize = 0;
+    std::string delta;       // Empty: no delta worth it against that base
+};
+
+struct DeltaStats {
+    size_t slots = 0;         // Written as deltas by the last rewrite
+    uint64_t fullBytes = 0;   // Their stored forms
+    uint64_t deltaBytes = 0;  // What was written instead
+};
+
+// Written under g_actionRunMutex, like the file
+std::unordered_map<std::string, DeltaSketch> g_deltaSketches;
+std::unordered_map<std::string, DeltaEncoding> g_deltaEncodings;
+std::unordered_map<std::string, std::vector<std::string>> g_deltaDependents;   // Base -> slots stored against it
+DeltaStats g_deltaStats;
+
+inline bool isDeltaValue(const char* data, size_t length) {
+    return length >= 2 && data[0] == '\\' && data[1] == 'd';
+}
+
+inline uint64_t deltaBlockHash(const char* data) {
+    uint64_t a, b;
+    memcpy(&a, data, 8);
+    memcpy(&b, data + 8, 8);
+    uint64_t hash = (a * 0x9E3779B97F4A7C15ULL) ^ (b * 0xFF51AFD7ED558CCDULL);
+    return hash ^ (hash >> 29);
+}
+
+void computeDeltaSketch(const char* data, size_t length, DeltaSketch& sketch) {
+    // One hash per 8-byte shingle, remixed once per minimum
+    static const uint64_t salts[DELTA_SKETCH_SIZE] = {
+        0x243F6A8885A308D3ULL, 0x13198A2E03707344ULL, 0xA4093822299F31D0ULL, 0x082EFA98EC4E6C89ULL,
+        0x452821E638D01377ULL, 0xBE5466CF34E90C6CULL, 0xC0AC29B7C97C50DDULL, 0x3F84D5B5B5470917ULL,
+        0x9216D5D98979FB1BULL, 0xD1310BA698DFB5ACULL, 0x2FFD72DBD01ADFB7ULL, 0xB8E1AFED6A267E96ULL,
+        0xBA7C9045F12C7F99ULL, 0x24A19947B3916CF7ULL, 0x0801F2E2858EFC16ULL, 0x636920D871574E69ULL
+    };
+    std::fill(sketch.mins, sketch.mins + DELTA_SKETCH_SIZE, UINT64_MAX);
+    for (size_t i = 0; i + 8 <= length; i++) {
+        uint64_t shingle;
+        memcpy(&shingle, data + i, 8);
+        shingle *= 0xFF51AFD7ED558CCDULL;
+        shingle ^= shingle >> 32;
+        for (int k = 0; k < DELTA_SKETCH_SIZE; k++) {
+            uint64_t value = (shingle ^ salts[k]) * 0x9E3779B97F4A7C15ULL;
+            value ^= value >> 31;
+            sketch.mins[k] = std::min(sketch.mins[k], value);
+        }
+    }
+}
+
+void appendDeltaNumber(std::string& out, size_t value) {
+    char digits[24];
+    int length = snprintf(digits, sizeof(digits), "%zu", value);
+    out.append(digits, length);
+}
+
+std::string encodeDelta(const std::string& baseKey, const char* base, size_t baseLength, const char* target, size_t targetLength) {
+    // Greedy: DELTA_BLOCK-byte blocks of the base are indexed every 8
+    // bytes, each target position is looked up, and a match is extended
+    // both ways
+    std::string out = "\\d";
+    appendDeltaNumber(out, baseKey.size());
+    out += ':';
+    out += baseKey;
+    
+    size_t tableSize = 1;
+    while (tableSize < baseLength / 4 + 16) {
+        tableSize <<= 1;
+    }
+    std::vector<uint32_t> table(tableSize, UINT32_MAX);
+    for (size_t p = 0; p + DELTA_BLOCK <= baseLength; p += 8) {
+        uint32_t& bucket = table[deltaBlockHash(base + p) & (tableSize - 1)];
+        if (bucket == UINT32_MAX) {
+            bucket = (uint32_t)p;
+        }
+    }
+    
+    size_t literalStart = 0;
+    size_t i = 0;
+    auto flushLiteral = [&](size_t end) {
+        if (end > literalStart) {
+            out += 'I';
+            appendDeltaNumber(out, end - literalStart);
+            out += ':';
+            out.append(target + literalStart, end - literalStart);
+        }
+    };
+    while (i + DELTA_BLOCK <= targetLength) {
+        uint32_t p = table[deltaBlockHash(target + i) & (tableSize - 1)];
+        if (p == UINT32_MAX || memcmp(base + p, target + i, DELTA_BLOCK) != 0) {
+            i++;
+            continue;
+        }
+        size_t start = i;
+        size_t from = p;
+        while (start > literalStart && from > 0 && target[start - 1] == base[from - 1]) {
+            start--;
+            from--;
+        }
+        size_t length = i - start + DELTA_BLOCK;
+        while (start + length < targetLength && from + length < baseLength && target[start + length] == base[from + length]) {
+            length++;
+        }
+        flushLiteral(start);
+        out += 'C';
+        appendDeltaNumber(out, from);
+        out += ',';
+        appendDeltaNumber(out, length);
+        out += ';';
+        i = start + length;
+        literalStart = i;
+    }
+    flushLiteral(targetLength);
+    return out;
+}
+
+bool parseDeltaBase(const char* data, size_t length, std::string& baseKey, size_t& opsStart) {
+    // \d<base key length>:<base key>
+    size_t keyLength = 0;
+    size_t i = 2;
+    while (i < length && data[i] >= '0' && data[i] <= '9' && keyLength < length) {
+        keyLength = keyLength * 10 + (data[i++] - '0');
+    }
+    if (i == 2 || i >= length || data[i] != ':' || keyLength == 0 || keyLength > length - i - 1) {
+        return false;
+    }
+    baseKey.assign(data + i + 1, keyLength);
+    opsStart = i + 1 + keyLength;
+    return true;
+}
+
+bool applyDelta(const std::string& base, const char* data, size_t length, std::string& out) {
+    // False on a malformed or out of range op
+    std::string baseKey;
+    size_t i;
+    if (!parseDeltaBase(data, length, baseKey, i)) {
+        return false;
+    }
+    auto number = [data, length, &i](size_t& value) {
+        size_t start = i;
+        value = 0;
+        while (i < length && data[i] >= '0' && data[i] <= '9' && value <= RANGE_SLOT_MAX * 100ULL) {
+            value = value * 10 + (data[i++] - '0');
+        }
+        return i > start;
+    };
+    out.clear();
+    while (i < length) {
+        char op = data[i++];
+        size_t first, count;
+        if (op == 'C') {
+            if (!number(first) || i >= length || data[i++] != ',' || !number(count) || i >= length || data[i++] != ';' ||
+                first > base.size() || count > base.size() - first) {
+                return false;
+            }
+            out.append(base, first, count);
+        } else if (op == 'I') {
+            if (!number(count) || i >= length || data[i++] != ':' || count > length - i) {
+                return false;
+            }
+            out.append(data + i, count);
+            i += count;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+const DeltaSketch& deltaSketch(const std::string& key, const char* data, size_t length, uint64_t hash) {
+    DeltaSketch& sketch = g_deltaSketches[key];
+    if (sketch.hash != hash || sketch.size != length) {
+        computeDeltaSketch(data, length, sketch);
+        sketch.hash = hash;
+        sketch.size = length;
+    }
+    return sketch;
+}
+
+void encodeStoreDeltas(std::vector<StoreLine>& lines, size_t firstCandidate, std::deque<std::string>& encoded) {
+    // Slot lines from firstCandidate on may become deltas against any
+    // earlier slot line; their values are replaced by strings kept in encoded
+    g_deltaStats = DeltaStats();
+    g_deltaDependents.clear();
+    if (!g_deltaStore) {
+        g_deltaSketches.clear();
+        g_deltaEncodings.clear();
+        return;
+    }
+    PhaseScope phase("encodeStoreDeltas");
+    
+    struct Candidate {
+        std::string key;
+        uint64_t hash;
+        const DeltaSketch* sketch;
+        int depth;
+        // The full stored form, kept once the line itself becomes a delta
+        const char* value;
+        size_t valueLength;
+    };
+    std::vector<Candidate> candidates(lines.size());
+    std::unordered_map<std::string, size_t> lineOfKey;
+    std::unordered_map<uint64_t, std::vector<uint32_t>> bands;
+    std::unordered_set<std::string> liveKeys;
+    
+    for (size_t i = 0; i < lines.size(); i++) {
+        StoreLine& line = lines[i];
+        if (!line.key || line.valueLength < DELTA_MIN_BYTES || line.valueLength > DELTA_MAX_BYTES ||
+            (line.value[0] == '\\' && line.value[1] == 'e')) {
+            continue;
+        }
+        Candidate& candidate = candidates[i];
+        candidate.key.assign(line.key, line.keyLength);
+        candidate.hash = hashContent(line.value, line.valueLength);
+        candidate.sketch = &deltaSketch(candidate.key, line.value, line.valueLength, candidate.hash);
+        candidate.depth = 0;
+        candidate.value = line.value;
+        candidate.valueLength = line.valueLength;
+        liveKeys.insert(candidate.key);
+        lineOfKey[candidate.key] = i;
+        
+        if (i >= firstCandidate) {
+            // The cached delta if its base is unchanged and still earlier,
+            // else the most similar earlier value
+            DeltaEncoding& encoding = g_deltaEncodings[candidate.key];
+            size_t baseLine = SIZE_MAX;
+            auto cachedBase = lineOfKey.find(encoding.base);
+            if (encoding.hash == candidate.hash && encoding.size == line.valueLength && cachedBase != lineOfKey.end() &&
+                cachedBase->second < i && candidates[cachedBase->second].hash == encoding.baseHash &&
+                candidates[cachedBase->second].valueLength == encoding.baseSize && candidates[cachedBase->second].depth < DELTA_MAX_DEPTH) {
+                baseLine = cachedBase->second;
+            } else {
+                int bestMatches = DELTA_MIN_MATCHES - 1;
+                for (int band = 0; band < DELTA_SKETCH_SIZE; band += DELTA_BAND_ROWS) {
+                    auto bucket = bands.find(hashContent(reinterpret_cast<const char*>(candidate.sketch->mins + band),
+                                                         DELTA_BAND_ROWS * sizeof(uint64_t)) + band);
+                    if (bucket == bands.end()) {
+                        continue;
+                    }
+                    for (uint32_t other : bucket->second) {
+                        if (candidates[other].depth >= DELTA_MAX_DEPTH) {
+                            continue;
+                        }
+                        int matches = 0;
+                        for (int k = 0; k < DELTA_SKETCH_SIZE; k++) {
+                            matches += candidate.sketch->mins[k] == candidates[other].sketch->mins[k];
+                        }
+                        // Equally similar: the shorter chain
+                        if (matches > bestMatches || (matches == bestMatches && baseLine != SIZE_MAX &&
+                                                      candidates[other].depth < candidates[baseLine].depth)) {
+                            bestMatches = matches;
+                            baseLine = other;
+                        }
+                    }
+                }
+                encoding = DeltaEncoding();
+                encoding.hash = candidate.hash;
+                encoding.size = line.valueLength;
+                if (baseLine != SIZE_MAX) {
+                    const Candidate& base = candidates[baseLine];
+                    encoding.base = base.key;
+                    encoding.baseHash = base.hash;
+                    encoding.baseSize = base.valueLength;
+                    encoding.delta = encodeDelta(encoding.base, base.value, base.valueLength, line.value, line.valueLength);
+                    if (encoding.delta.size() * 4 > line.valueLength * 3) {
+                        encoding.delta.clear();
+                    }
+                }
+            }
+            if (baseLine != SIZE_MAX && !encoding.delta.empty()) {
+                candidate.depth = candidates[baseLine].depth + 1;
+                g_deltaDependents[encoding.base].push_back(candidate.key);
+                g_deltaStats.slots++;
+                g_deltaStats.fullBytes += line.valueLength;
+                g_deltaStats.deltaBytes += encoding.delta.size();
+                encoded.push_back(encoding.delta);
+                line.value = encoded.back().data();
+                line.valueLength = encoded.back().size();
+            }
+        }
+        
+        // Every value can be the base of a later one
+        for (int band = 0; band < DELTA_SKETCH_SIZE; band += DELTA_BAND_ROWS) {
+            std::vector<uint32_t>& bucket = bands[hashContent(reinterpret_cast<const char*>(candidate.sketch->mins + band),
+                                                               DELTA_BAND_ROWS * sizeof(uint64_t)) + band];
+            if (bucket.size() == DELTA_BUCKET_MAX) {
+                bucket.erase(bucket.begin());
+            }
+            bucket.push_back((uint32_t)i);
+        }
+    }
+    
+    // Slots gone since the last rewrite
+    for (auto it = g_deltaSketches.begin(); it != g_deltaSketches.end();) {
+        it = liveKeys.count(it->first) ? std::next(it) : g_deltaSketches.erase(it);
+    }
+    for (auto it = g_deltaEncodings.begin(); it != g_deltaEncodings.end();) {
+        it = liveKeys.count(it->first) ? std::next(it) : g_deltaEncodings.erase(it);
+    }
+}
+
+bool resolveStoreDeltas(SlotTable& slots, std::vector<std::string>& unresolved) {
+    // Replaces every delta of a table read from the file by its full
+    // stored form. Deltas whose base is missing, too deep or malformed are
+    // removed from the table and listed. False if there was no delta.
+    std::vector<size_t> deltas;
+    for (size_t i = 0; i < slots.size(); i++) {
+        SlotTable::Entry slot = slots.entry(i);
+        if (isDeltaValue(slot.valueData, slot.valueLength)) {
+            deltas.push_back(i);
+        }
+    }
+    g_deltaDependents.clear();
+    if (deltas.empty()) {
+        return false;
+    }
+    PhaseScope phase("resolveStoreDeltas");
+    
+    std::unordered_map<std::string, std::string> resolved;
+    std::function<bool(const std::string&, int, std::string&)> resolve =
+        [&](const std::string& key, int depth, std::string& value) {
+        auto done = resolved.find(key);
+        if (done != resolved.end()) {
+            value = done->second;
+            return true;
+        }
+        SlotTable::Entry slot;
+        if (depth > DELTA_MAX_DEPTH || !slots.findEntry(key, slot)) {
+            return false;
+        }
+        if (!isDeltaValue(slot.valueData, slot.valueLength)) {
+            value = slot.value();
+            return true;
+        }
+        std::string baseKey;
+        size_t opsStart;
+        std::string base;
+        if (!parseDeltaBase(slot.valueData, slot.valueLength, baseKey, opsStart) || !resolve(baseKey, depth + 1, base) ||
+            !applyDelta(base, slot.valueData, slot.valueLength, value)) {
+            return false;
+        }
+        g_deltaDependents[baseKey].push_back(key);
+        resolved[key] = value;
+        return true;
+    };
+    
+    // The table is only changed once every delta is resolved
+    std::vector<std::pair<std::string, std::string>> results;
+    std::vector<std::string> failed;
+    for (size_t index : deltas) {
+        SlotTable::Entry slot = slots.entry(index);
+        std::string key = slot.key();
+        std::string value;
+        if (resolve(key, 0, value)) {
+            results.push_back({key, value});
+        } else {
+            unresolved.push_back("SLOT" + key + "|" + slot.value());
+            failed.push_back(key);
+        }
+    }
+    for (const auto& result : results) {
+        slots.set(result.first, result.second);
+    }
+    for (const auto& key : failed) {
+        slots.erase(key);
+    }
+    return true;
+}
+
+void appendDeltaDependents(std::vector<std::string>& keys) {
+    // Slots about to get a new record at the end of the file: the deltas
+    // stored against them (and against those) are appended in full too
+    std::unordered_set<std::string> listed(keys.begin(), keys.end());
+    for (size_t i = 0; i < keys.size(); i++) {
+        auto dependents = g_deltaDependents.find(keys[i]);
+        if (dependents == g_deltaDependents.end()) {
+            continue;
+        }
+        for (const auto& dependent : dependents->second) {
+            if (listed.insert(dependent).second) {
+                keys.push_back(dependent);
+            }
+        }
+        g_deltaDependents.erase(dependents);
+    }
+}
+
+// ========================================
+// SLOT RECORDS
+// ========================================
+
+bool isPrimarySlot(const std::string& slotNum) {
+    try {
+        int num = std::stoi(slotNum);
+        return num >= 1 && num <= 10;
+    } catch (...) {
+        return false;
+    }
+}
+
+bool writeStoreFile(const std::vector<std::string>& configLines, const SlotTable& slots) {
+    // Write entire file
+    PhaseScope phase("writeStoreFile");
+    std::ofstream fileOut(SAVE_FILE, std::ios::out | std::ios::trunc);
+    if (!fileOut.is_open()) {
+        return false;
+    }
+    
+    // Configuration lines first, then slots 1-10 in order (even if empty),
+    // then all other non-empty slots (sorted numerically if possible). Only
+    // pointers into the table are collected: the values are never copied.
+    static const char* primaryKeys[10] = {"1", "2", "3", "4", "5", "6", "7", "8", "9", "10"};
+    const char* primaryValues[10] = {nullptr};
+    size_t primaryLengths[10] = {0};
+    
+    // Numeric keys are parsed once instead of in every comparison
+    struct OtherSlot {
+        SlotTable::Entry entry;
+        bool numeric;
+        int number;
+    };
+    std::vector<OtherSlot> otherSlots;
+    for (const auto& slot : slots) {
+        std::string key = slot.key();
+        if (isPrimarySlot(key)) {
+            // Only the canonical spelling ("1", not "01") is written
+            int index = std::stoi(key) - 1;
+            if (key == primaryKeys[index]) {
+                primaryValues[index] = slot.valueData;
+                primaryLengths[index] = slot.valueLength;
+            }
+        } else if (slot.valueLength > 0) {
+            OtherSlot other = {slot, true, 0};
+            try {
+                other.number = std::stoi(key);
+            } catch (...) {
+                other.numeric = false;
+            }
+            otherSlots.push_back(other);
+        }
+    }
+    
+    std::sort(otherSlots.begin(), otherSlots.end(), [](const OtherSlot& a, const OtherSlot& b) {
+        if (a.numeric && b.numeric) {
+            return a.number < b.number;
+        }
+        int order = memcmp(a.entry.keyData, b.entry.keyData, std::min(a.entry.keyLength, b.entry.keyLength));
+        return order != 0 ? order < 0 : a.entry.keyLength < b.entry.keyLength;
+    });
+    
+    std::vector<StoreLine> lines;
+    lines.reserve(configLines.size() + otherSlots.size() + 10);
+    for (const auto& configLine : configLines) {
+        lines.push_back({nullptr, 0, configLine.data(), configLine.size()});
+    }
+    for (int i = 0; i < 10; i++) {
+        lines.push_back({primaryKeys[i], strlen(primaryKeys[i]), primaryValues[i] ? primaryValues[i] : "", primaryLengths[i]});
+    }
+    for (const auto& slot : otherSlots) {
+        lines.push_back({slot.entry.keyData, slot.entry.keyLength, slot.entry.valueData, slot.entry.valueLength});
+    }
+    
+    // Additional slots close to an earlier one are written as deltas
+    std::deque<std::string> deltas;
+    encodeStoreDeltas(lines, configLines.size() + 10, deltas);
+    
+    if (!writeStoreLines(fileOut, lines)) {
+        return false;
+    }
+    
+    fileOut.close();
+    g_storeStamp = currentStoreStamp();
+    g_storeStaleRecords = 0;
+    refreshPrimaryCache(primaryValues, primaryLengths);
+    
+    // Readers in this process and in others see the new slots
+    g_storeConfigLines = configLines;
+    publishSlotSnapshot(slots);
+    publishSharedSlots(g_sharedSlots, slots);
+    return true;
+}
+
+bool appendStoreRecords(const SlotTable& slots, const std::vector<std::string>& keys) {
+    // Only the given slots are written, at the end of the file: the parser
+    // keeps the last line of a key, and the next full rewrite drops the
+    // older ones (and the empty additional slots, which stand for deletions)
+    if (keys.empty()) {
+        return true;
+    }
+    PhaseScope phase("appendStoreRecords");
+    std::vector<std::string> written = keys;
+    appendDeltaDependents(written);
+    std::vector<std::string> values(written.size());
+    std::vector<StoreLine> lines;
+    StoreChunk chunk = {0, written.size(), 0};
+    for (size_t i = 0; i < written.size(); i++) {
+        slots.find(written[i], values[i]);
+        lines.push_back({written[i].data(), written[i].size(), values[i].data(), values[i].size()});
+        chunk.bytes += lines.back().size();
+    }
+    std::string records;
+    formatStoreLines(lines, chunk, records);
+    
+    // A file edited by hand may lack its last line break
+    std::ifstream fileIn(SAVE_FILE, std::ios::in | std::ios::binary);
+    bool needsBreak = fileIn.seekg(-1, std::ios::end) && fileIn.get() != '\n';
+    fileIn.close();
+    
+    std::ofstream fileOut(SAVE_FILE, std::ios::out | std::ios::app);
+    if (!fileOut.is_open()) {
+        return false;
+    }
+    if (needsBreak) {
+        fileOut << "\n";
+    }
+    fileOut.write(records.data(), records.size());
+    fileOut.close();
+    if (!fileOut) {
+        return false;
+    }
+    g_storeStamp = currentStoreStamp();
+    g_storeStaleRecords += written.size();
+    refreshPrimaryCache(slots);
+    publishSlotSnapshot(slots);
+    publishSharedSlots(g_sharedSlots, slots);
+    return true;
+}
+
+void quarantineRecords(const std::vector<std::string>& damaged) {
+    // Kept as found, so that they can be repaired and pasted back by hand
+    std::ofstream file(SAVE_FILE + ".quarantine", std::ios::out | std::ios::app);
+    if (!file.is_open()) {
+        return;
+    }
+    file << "# " << (long long)time(nullptr) << " - " << damaged.size() << " damaged record(s) removed from " << SAVE_FILE << "\n";
+    for (const auto& line : damaged) {
+        file << line << "\n";
+    }
+}
+
+bool readStoreFile(std::vector<std::string>& configLines, SlotTable& slots) {
+    // Configuration lines are kept verbatim, slot values stay escaped.
+    // Damaged records are salvaged: moved to the quarantine file and the
+    // store rewritten with the intact ones.
+    PhaseScope phase("readStoreFile");
+    std::ifstream fileIn(SAVE_FILE);
+    if (!fileIn.is_open()) {
+        return false;
+    }
+    
+    // The value arena is sized from the file once
+    StoreStamp stamp = currentStoreStamp();
+    if (stamp.size > 0) {
+        slots.reserve(0, (size_t)stamp.size);
+    }
+    
+    std::vector<std::string> damaged;
+    std::string line;
+    size_t records = 0;
+    while (std::getline(fileIn, line)) {
+        // Save configuration lines
+        if (isConfigLine(line)) {
+            configLines.push_back(line);
+            continue;
+        }
+        
+        size_t keyEnd, valueEnd;
+        if (checkSlotRecord(line.data(), line.size(), keyEnd, valueEnd) == RECORD_DAMAGED) {
+            damaged.push_back(line);
+        } else {
+            slots.append(line.data() + 4, keyEnd - 4, line.data() + keyEnd + 1, valueEnd - keyEnd - 1);
+            records++;
+        }
+    }
+    fileIn.close();
+    slots.sortKeys();
+    resolveStoreDeltas(slots, damaged);
+    
+    // Left for the idle compaction: lines of keys seen again, and deleted slots
+    size_t stale = records - slots.size();
+    for (const auto& slot : slots) {
+        if (slot.valueLength == 0 && !isPrimarySlot(slot.key())) {
+            stale++;
+        }
+    }
+    g_storeStaleRecords = stale;
+    
+    g_storeConfigLines = configLines;
+    if (!damaged.empty()) {
+        quarantineRecords(damaged);
+        writeStoreFile(configLines, slots);
+        addToHistory("XX DAMAGED --> %zu record(s) moved to %s.quarantine", damaged.size(), SAVE_FILE.c_str());
+    }
+    return true;
+}
+
+RecordStatus findStoredRecord(const std::string& slotNum, std::string& stored, bool& found) {
+    // Last record of the slot (records appended by a sync supersede the
+    // older ones), verified but left in its stored form
+    found = false;
+    std::ifstream file(SAVE_FILE);
+    if (!file.is_open()) {
+        return RECORD_UNCHECKED;
+    }
+    
+    std::string line;
+    std::string record;
+    std::string targetPrefix = "SLOT" + slotNum + "|";
+    
+    while (std::getline(file, line)) {
+        // Ignore configuration lines and comments
+        if (isConfigLine(line)) {
+            continue;
+        }
+        if (line.compare(0, targetPrefix.length(), targetPrefix) == 0) {
+            record.swap(line);
+            found = true;
+        }
+    }
+    if (!found) {
+        return RECORD_UNCHECKED;
+    }
+    
+    // Only this record is verified
+    size_t keyEnd, valueEnd;
+    RecordStatus status = checkSlotRecord(record.data(), record.size(), keyEnd, valueEnd);
+    if (status != RECORD_DAMAGED) {
+        stored.assign(record, keyEnd + 1, valueEnd - keyEnd - 1);
+    }
+    return status;
+}
+
+std::string readSlotFromFile(const std::string& slotNum, bool* damaged = nullptr) {
+    // Only this record is read and decoded (and opened, if sealed). A delta
+    // costs one more scan per base in its chain. Given damaged, the read
+    // leaves the file alone (the caller does not own the slots): a damaged
+    // record only sets it and reads as empty.
+    std::string stored;
+    std::string content;
+    auto salvage = [&slotNum, &stored, &content, damaged]() {
+        // Damaged records (broken chains included) are quarantined by the
+        // salvage in readStoreFile, which resolves the other deltas
+        if (damaged != nullptr) {
+            *damaged = true;
+            return content;
+        }
+        std::vector<std::string> configLines;
+        SlotTable slots;
+        if (readStoreFile(configLines, slots) && slots.find(slotNum, stored)) {
+            decodeStoredValue(slotNum, stored, content);
+        }
+        return content;
+    };
+    
+    std::vector<std::string> chain;
+    std::string key = slotNum;
+    bool found;
+    while (true) {
+        RecordStatus status = findStoredRecord(key, stored, found);
+        if (!found && chain.empty()) {
+            return "";
+        }
+        std::string baseKey;
+        size_t opsStart;
+        if (status == RECORD_DAMAGED || !found || (isDeltaValue(stored.data(), stored.size()) &&
+            ((int)chain.size() == DELTA_MAX_DEPTH || !parseDeltaBase(stored.data(), stored.size(), baseKey, opsStart)))) {
+            return salvage();
+        }
+        if (!isDeltaValue(stored.data(), stored.size())) {
+            break;
+        }
+        chain.push_back(stored);
+        key = baseKey;
+    }
+    
+    // From the last base back to the slot
+    for (auto delta = chain.rbegin(); delta != chain.rend(); ++delta) {
+        std::string rebuilt;
+        if (!applyDelta(stored, delta->data(), delta->size(), rebuilt)) {
+            return salvage();
+        }
+        stored.swap(rebuilt);
+    }
+    decodeStoredValue(slotNum, stored, content);
+    return content;
+}
+
+bool recodeStoredValue(const std::string& slotNum, std::string& stored) {
+    // Brings one value to the current mode; false if it already matched
+    // or cannot be opened
+    if (stored.empty() || isSealedValue(stored) == g_encryptStore) {
+        return false;
+    }
+    std::string content;
+    if (!decodeStoredValue(slotNum, stored, content)) {
+        return false;
+    }
+    stored = encodeStoredValue(slotNum, content);
+    return true;
+}
+
+bool applyStoreEncryption() {
+    // Loads (or creates) the key, then seals every plain record when
+    // encryption is on, or opens every sealed record when it was turned off.
+    // Returns false if encryption is on but no key is available.
+    bool keyLoaded = loadStoreKey(g_encryptStore);
+    if (g_encryptStore && !keyLoaded) {
+        g_encryptStore = false;
+        return false;
+    }
+    
+    std::vector<std::string> configLines;
+    SlotTable slots;
+    if (readStoreFile(configLines, slots)) {
+        // Sealing or opening every record is the costly part: spread it on the pool
+        std::vector<std::string> values(slots.size());
+        std::vector<char> recoded(slots.size(), 0);
+        workerPool().run(slots.size(), [&slots, &values, &recoded](size_t index) {
+            SlotTable::Entry slot = slots.entry(index);
+            values[index] = slot.value();
+            recoded[index] = recodeStoredValue(slot.key(), values[index]);
+        });
+        bool changed = false;
+        for (size_t i = 0; i < slots.size(); i++) {
+            if (recoded[i]) {
+                slots.set(slots.entry(i).key(), values[i]);
+                changed = true;
+            }
+        }
+        if (changed) {
+            writeStoreFile(configLines, slots);
+        }
+    }
+    
+    // Versions too: the history file would otherwise keep the plain text
+    std::ifstream historyIn(HISTORY_FILE);
+    if (historyIn.is_open()) {
+        std::vector<std::string> records;
+        bool changed = false;
+        std::string line;
+        while (std::getline(historyIn, line)) {
+            size_t firstPipe = line.find('|');
+            size_t secondPipe = firstPipe == std::string::npos ? std::string::npos : line.find('|', firstPipe + 1);
+            if (secondPipe != std::string::npos) {
+                std::string slotNum = line.substr(firstPipe + 1, secondPipe - firstPipe - 1);
+                std::string stored = line.substr(secondPipe + 1);
+                if (recodeStoredValue(slotNum, stored)) {
+                    line = line.substr(0, secondPipe + 1) + stored;
+                    changed = true;
+                }
+            }
+            records.push_back(line);
+        }
+        historyIn.close();
+        
+        if (changed) {
+            std::ofstream historyOut(HISTORY_FILE, std::ios::out | std::ios::trunc);
+            for (const auto& record : records) {
+                historyOut << record << "\n";
+            }
+        }
+    }
+    return true;
+}
+
+std::shared_ptr<const std::string> previousContent(const SlotTable& slots, const std::string& slotNum) {
+    // Content about to be replaced, null if the slot does not exist
+    std::string stored;
+    if (!slots.find(slotNum, stored)) {
+        return nullptr;
+    }
+    std::string content;
+    decodeStoredValue(slotNum, stored, content);
+    return std::make_shared<const std::string>(std::move(content));
+}
+
+bool writeSlotToFile(const std::string& slotNum, const std::string& content, bool asTemplate = false) {
+    // Read entire file
+    std::vector<std::string> configLines;
+    SlotTable slots;
+    if (!readStoreFile(configLines, slots)) {
+        return false;
+    }
+    
+    // A plain SAVE turns a template back into plain text
+    setTemplateMark(configLines, slotNum, asTemplate);
+    
+    // Keep the replaced content for undo
+    auto previous = previousContent(slots, slotNum);
+    
+    // Update or add slot
+    slots.set(slotNum, encodeStoredValue(slotNum, content));
+    
+    if (!writeStoreFile(configLines, slots)) {
+        return false;
+    }
+    
+    setFingerprint(slotNum, content);
+    noteSlotWritten(slotNum, content.size(), &content);
+    recordVersion(slotNum, previous);
+    pushUndo("SAVE Slot [" + slotNum + "]", {{slotNum, previous}});
+    return true;
+}
+
+std::string nextFreeSlot(const SlotTable& slots) {
+    // First number after the highest numbered slot (at least 11)
+    long highest = 10;
+    for (const auto& slot : slots) {
+        try {
+            highest = std::max(highest, std::stol(slot.key()));
+        } catch (...) {
+        }
+    }
+    return std::to_string(highest + 1);
+}
+
+bool saveAliasedSlot(const std::string& name, const std::string& content, std::string& slotNum) {
+    // Saves to the slot named name; an unknown name gets the next free slot
+    // and its ALIAS line in the same rewrite
+    std::vector<std::string> configLines;
+    SlotTable slots;
+    if (!readStoreFile(configLines, slots)) {
+        return false;
+    }
+    
+    bool newAlias = !resolveAlias(name, slotNum);
+    if (newAlias) {
+        slotNum = nextFreeSlot(slots);
+        configLines.push_back("ALIAS|" + name + "|" + slotNum);
+    }
+    
+    setTemplateMark(configLines, slotNum, false);
+    auto previous = previousContent(slots, slotNum);
+    slots.set(slotNum, encodeStoredValue(slotNum, content));
+    
+    if (!writeStoreFile(configLines, slots)) {
+        return false;
+    }
+    
+    if (newAlias) {
+        insertAlias(name, slotNum);
+    }
+    setFingerprint(slotNum, content);
+    noteSlotWritten(slotNum, content.size(), &content);
+    recordVersion(slotNum, previous);
+    pushUndo("SAVE Slot [" + slotNum + "]", {{slotNum, previous}});
+    return true;
+}
+
+void clearNonPrimarySlots() {
+    std::vector<std::string> configLines;
+    SlotTable slots;
+    if (!readStoreFile(configLines, slots)) {
+        return;
+    }
+    
+    // Rewrite only config lines and primary slots (1-10)
+    SlotTable primarySlots;
+    UndoEntry::Changes removed;
+    for (const auto& slot : slots) {
+        std::string key = slot.key();
+        if (isPrimarySlot(key)) {
+            primarySlots.set(key, slot.valueData, slot.valueLength);
+        } else {
+            removed.push_back({key, previousContent(slots, key)});
+        }
+    }
+    
+    if (!writeStoreFile(configLines, primarySlots)) {
+        return;
+    }
+    
+    for (const auto& change : removed) {
+        forgetSlotCaches(change.first);
+        dropSlotMetadata(change.first);
+        recordVersion(change.first, change.second);
+    }
+    pushUndo("CLEAR All additional slots", removed);
+}
+
+bool clearSpecificSlot(const std::string& slotNum) {
+    // Read entire file
+    std::vector<std::string> configLines;
+    SlotTable slots;
+    if (!readStoreFile(configLines, slots)) {
+        return false;
+    }
+    
+    // Check if slot exists
+    if (!slots.contains(slotNum)) {
+        return false;
+    }
+    
+    auto previous = previousContent(slots, slotNum);
+    
+    if (isPrimarySlot(slotNum)) {
+        // Primary slot: empty content but keep slot
+        slots.set(slotNum, "");
+    } else {
+        // Non-primary slot: delete completely
+        slots.erase(slotNum);
+    }
+    
+    if (!writeStoreFile(configLines, slots)) {
+        return false;
+    }
+    
+    // The TEMPLATE mark is kept so that undo restores a working template
+    forgetSlotCaches(slotNum);
+    dropSlotMetadata(slotNum);
+    recordVersion(slotNum, previous);
+    pushUndo("CLEAR Slot [" + slotNum + "]", {{slotNum, previous}});
+    return true;
+}
+
+bool undoLastAction(std::string& description) {
+    // Restores the contents kept in memory: the replaced payloads are
+    // shared with the version history, and the table comes from the last
+    // published snapshot. The file is only read if it changed since.
+    if (g_undoStack.empty()) {
+        return false;
+    }
+    UndoEntry entry = g_undoStack.back();
+    
+    std::vector<std::string> configLines;
+    SlotTable slots;
+    if (!copyPublishedStore(configLines, slots) && !readStoreFile(configLines, slots)) {
+        return false;
+    }
+    
+    UndoEntry::Changes replaced;
+    for (const auto& change : entry.changes) {
+        replaced.push_back({change.first, previousContent(slots, change.first)});
+        if (change.second) {
+            slots.set(change.first, encodeStoredValue(change.first, *change.second));
+        } else if (isPrimarySlot(change.first)) {
+            slots.set(change.first, "");
+        } else {
+            slots.erase(change.first);
+        }
+    }
+    
+    if (!writeStoreFile(configLines, slots)) {
+        return false;
+    }
+    
+    for (const auto& change : entry.changes) {
+        noteSlotWritten(change.first, change.second ? change.second->size() : 0, change.second.get());
+    }
+    
+    // Undo is not destructive either: what it replaced becomes a version
+    for (const auto& change : replaced) {
+        forgetSlotCaches(change.first);
+        recordVersion(change.first, change.second);
+    }
+    g_undoStack.pop_back();
+    description = entry.description;
+    return true;
+}
+
+std::string slotPreview(const std::string& stored) {
+    // Sealed records are not opened just to be displayed
+    if (isSealedValue(stored)) {
+        return "[ENCRYPTED]";
+    }
+    return "\"" + buildPreview(stored, 50, true) + "\"";
+}
+
+void displayAllSlots() {
+    // The published snapshot when it matches the file, else the file itself
+    SnapshotReader reader;
+    const SlotSnapshot* snapshot = reader.get();
+    SlotTable parsedSlots;
+    if (snapshot == nullptr || !(snapshot->stamp == currentStoreStamp())) {
+        snapshot = nullptr;
+        std::ifstream file(SAVE_FILE);
+        if (!file.is_open()) {
+            std::cout << "ERROR: Unable to open file" << std::endl;
+            return;
+        }
+        
+        std::string line;
+        while (std::getline(file, line)) {
+            // Ignore configuration lines and comments
+            if (isConfigLine(line)) {
+                continue;
+            }
+            
+            size_t keyEnd, valueEnd;
+            if (checkSlotRecord(line.data(), line.size(), keyEnd, valueEnd) != RECORD_DAMAGED && valueEnd > keyEnd + 1) {
+                // Kept escaped: the preview decodes only what it displays
+                parsedSlots.append(line.data() + 4, keyEnd - 4, line.data() + keyEnd + 1, valueEnd - keyEnd - 1);
+            }
+        }
+        file.close();
+        parsedSlots.sortKeys();
+        std::vector<std::string> unresolved;
+        resolveStoreDeltas(parsedSlots, unresolved);
+    }
+    const SlotTable& allSlots = snapshot ? snapshot->slots : parsedSlots;
+    
+    std::cout << "=========================================================" << std::endl;
+    std::cout << "                  ACTIVE SLOTS                           " << std::endl;
+    std::cout << "=========================================================" << std::endl;
+    
+    // Outside the number order, each slot shows how it was used
+    SlotView view = (SlotView)g_slotView.load();
+    int64_t now = (int64_t)time(nullptr);
+    auto usage = [view, now](const std::string& key) {
+        uint32_t number;
+        uint32_t row;
+        if (view == VIEW_NUMBER || !metadataSlot(key, number) || !g_slotMetadata.find(number, row)) {
+            return std::string();
+        }
+        return " [" + formatSlotUsage(g_slotMetadata, row, now) + "]";
+    };
+    // Content category, in every order
+    auto categoryTag = [](const std::string& key) {
+        uint32_t number;
+        uint32_t row;
+        if (!metadataSlot(key, number) || !g_slotMetadata.find(number, row) || g_slotMetadata.category[row] == CATEGORY_NONE) {
+            return std::string();
+        }
+        return std::string(" <") + CATEGORY_NAMES[g_slotMetadata.category[row]] + ">";
+    };
+    
+    // Display primary slots (1-10)
+    for (int i = 1; i <= 10; i++) {
+        std::string key = std::to_string(i);
+        std::string alias = aliasOfSlot(key);
+        std::cout << "  Slot " << i << " [key " << (i == 10 ? "0/" : std::to_string(i) + "/") << SLOT_CHARS[i-1] << "]"
+                  << (alias.empty() ? "" : " (" + alias + ")") << (g_templateSlots.count(key) ? " {template}" : "")
+                  << categoryTag(key) << " : ";
+        
+        std::string value;
+        if (allSlots.find(key, value) && !value.empty()) {
+            std::cout << slotPreview(value) << usage(key) << std::endl;
+        } else {
+            std::cout << "[EMPTY]" << std::endl;
+        }
+    }
+    
+    // Display other slots
+    std::vector<SlotTable::Entry> otherSlots;
+    for (const auto& slot : allSlots) {
+        if (slot.valueLength == 0) {
+            continue;
+        }
+        try {
+            int num = std::stoi(slot.key());
+            if (num < 1 || num > 10) {
+                otherSlots.push_back(slot);
+            }
+        } catch (...) {
+            otherSlots.push_back(slot);
+        }
+    }
+    
+    if (!otherSlots.empty()) {
+        std::sort(otherSlots.begin(), otherSlots.end(), [](const auto& a, const auto& b) {
+            try {
+                int numA = std::stoi(a.key());
+                int numB = std::stoi(b.key());
+                return numA < numB;
+            } catch (...) {
+                return a.key() < b.key();
+            }
+        });
+        
+        if (view != VIEW_NUMBER) {
+            // Slots with metadata in view order, then (except for the
+            // unused view) the others in number order
+            std::unordered_map<uint32_t, size_t> positions;
+            for (size_t i = 0; i < otherSlots.size(); i++) {
+                uint32_t number;
+                if (metadataSlot(otherSlots[i].key(), number)) {
+                    positions[number] = i;
+                }
+            }
+            std::vector<SlotTable::Entry> ordered;
+            std::vector<bool> listed(otherSlots.size(), false);
+            for (uint32_t row : slotMetadataView(g_slotMetadata, view, now, g_unusedDays)) {
+                auto position = positions.find(g_slotMetadata.slot[row]);
+                if (position != positions.end()) {
+                    ordered.push_back(otherSlots[position->second]);
+                    listed[position->second] = true;
+                }
+            }
+            for (size_t i = 0; i < otherSlots.size() && view != VIEW_UNUSED; i++) {
+                if (!listed[i]) {
+                    ordered.push_back(otherSlots[i]);
+                }
+            }
+            otherSlots.swap(ordered);
+        }
+        
+        static const char* viewTitles[] = {"", " (most recently used first)", " (most loaded first)", ""};
+        std::string title = viewTitles[view];
+        if (view == VIEW_UNUSED) {
+            title = " (" + std::to_string(otherSlots.size()) + " unused for " + std::to_string(g_unusedDays.load()) + " days)";
+        }
+        std::cout << "\n--- ADDITIONAL SLOTS" << title << " ---" << std::endl;
+        for (const auto& slot : otherSlots) {
+            std::string key = slot.key();
+            std::string alias = aliasOfSlot(key);
+            std::cout << "  Slot [" << key << "]" << (alias.empty() ? "" : " (" + alias + ")")
+                      << (g_templateSlots.count(key) ? " {template}" : "") << categoryTag(key) << " : ";
+            
+            std::cout << slotPreview(slot.value()) << usage(key) << std::endl;
+        }
+    }
+    
+    std::cout << "=========================================================" << std::endl;
+}
+
+// ========================================
+// SLOT RANGES
+// ========================================
+// MOVE, COPY, SWAP and DELETE on blocks of numbered slots. A block is
+// handled as a whole: a destination slot whose source slot does not exist
+// ends up empty. Every operation reads the file once, writes it once and
+// is undone in one step.
+
+bool parseRangeCommand(const std::string& command, RangeOp& op) {
+    // move 11-500 12 | copy 20-29 120 | swap 3 7 | delete 1000-9999
+    std::istringstream stream(command);
+    std::string word, block, target, extra;
+    if (!(stream >> word >> block)) {
+        return false;
+    }
+    std::transform(word.begin(), word.end(), word.begin(), ::tolower);
+    RangeOp parsed;
+    if (word == "move" || word == "m") {
+        parsed.kind = RANGE_MOVE;
+    } else if (word == "copy" || word == "c") {
+        parsed.kind = RANGE_COPY;
+    } else if (word == "swap" || word == "s") {
+        parsed.kind = RANGE_SWAP;
+    } else if (word == "delete" || word == "d") {
+        parsed.kind = RANGE_DELETE;
+    } else {
+        return false;
+    }
+    
+    // Everything but DELETE needs a target slot
+    bool hasTarget = static_cast<bool>(stream >> target);
+    if (stream >> extra || hasTarget == (parsed.kind == RANGE_DELETE)) {
+        return false;
+    }
+    
+    // A block is a slot ("7") or an inclusive range ("11-500")
+    size_t dash = block.find('-');
+    std::string first = block.substr(0, dash);
+    std::string last = dash == std::string::npos ? first : block.substr(dash + 1);
+    if (!parseSlotNumber(first.data(), first.size(), parsed.first) || !parseSlotNumber(last.data(), last.size(), parsed.last)) {
+        return false;
+    }
+    if (hasTarget && !parseSlotNumber(target.data(), target.size(), parsed.target)) {
+        return false;
+    }
+    op = parsed;
+    return true;
+}
+
+std::string describeRange(const RangeOp& op) {
+    // "MOVE Slots [11-500] to [12]", also used as the undo description
+    auto block = [](unsigned long first, unsigned long last) {
+        return "[" + std::to_string(first) + (last == first ? "" : "-" + std::to_string(last)) + "]";
+    };
+    unsigned long size = op.last - op.first;
+    switch (op.kind) {
+        case RANGE_MOVE:   return "MOVE Slots " + block(op.first, op.last) + " to " + block(op.target, op.target);
+        case RANGE_COPY:   return "COPY Slots " + block(op.first, op.last) + " to " + block(op.target, op.target);
+        case RANGE_SWAP:   return "SWAP Slots " + block(op.first, op.last) + " and " + block(op.target, op.target + size);
+        case RANGE_DELETE: return "DELETE Slots " + block(op.first, op.last);
+        default:           return "RANGE";
+    }
+}
+
+const char* checkRangeOp(const RangeOp& op) {
+    // Error message, or null if the operation can run
+    if (op.kind == RANGE_NONE) {
+        return "Incomplete range command";
+    }
+    if (op.first == 0 || op.first > op.last) {
+        return "Invalid slot range";
+    }
+    if (op.kind == RANGE_DELETE) {
+        return nullptr;
+    }
+    unsigned long size = op.last - op.first + 1;
+    if (op.target == 0 || op.target > RANGE_SLOT_MAX - (size - 1)) {
+        return "Target slots out of range";
+    }
+    if (op.target == op.first) {
+        return "Source and target are the same slots";
+    }
+    if (op.kind == RANGE_SWAP && op.target <= op.last && op.first <= op.target + (size - 1)) {
+        return "Swapped ranges overlap";
+    }
+    return nullptr;
+}
+
+bool applyRangeOp(const RangeOp& op, size_t& changed) {
+    std::vector<std::string> configLines;
+    SlotTable slots;
+    if (!readStoreFile(configLines, slots)) {
+        return false;
+    }
+    
+    // Contents leaving their slot are copied out first, so that source and
+    // target blocks may overlap
+    struct MovedSlot {
+        unsigned long number;
+        std::string key;
+        std::string stored;
+        bool isTemplate;
+    };
+    unsigned long size = op.last - op.first + 1;
+    auto inBlock = [size](unsigned long number, unsigned long start) {
+        return number >= start && number - start < size;
+    };
+    
+    std::vector<MovedSlot> moved;
+    std::map<unsigned long, const MovedSlot*> plan;   // Slot -> new content (null: cleared)
+    for (const auto& slot : slots) {
+        unsigned long number;
+        if (!parseSlotNumber(slot.keyData, slot.keyLength, number)) {
+            continue;
+        }
+        bool inSource = inBlock(number, op.first);
+        bool inTarget = op.kind != RANGE_DELETE && inBlock(number, op.target);
+        if ((inSource && op.kind != RANGE_COPY) || inTarget) {
+            plan[number] = nullptr;
+        }
+        if ((inSource && op.kind != RANGE_DELETE) || (inTarget && op.kind == RANGE_SWAP)) {
+            std::string key = slot.key();
+            moved.push_back({number, key, slot.value(), g_templateSlots.count(key) > 0});
+        }
+    }
+    for (const auto& slot : moved) {
+        // Swapped blocks never overlap: a slot belongs to exactly one of them
+        bool fromSource = inBlock(slot.number, op.first);
+        plan[fromSource ? slot.number - op.first + op.target : slot.number - op.target + op.first] = &slot;
+    }
+    
+    UndoEntry::Changes changes;
+    bool marksMoved = false;
+    for (const auto& step : plan) {
+        std::string key = std::to_string(step.first);
+        std::string stored;
+        bool exists = slots.find(key, stored);
+        
+        if (step.second) {
+            // Sealed records are bound to their slot number: re-seal them
+            std::string value = step.second->stored;
+            std::string content;
+            if (isSealedValue(value) && decodeStoredValue(step.second->key, value, content)) {
+                value = encodeStoredValue(key, content);
+            }
+            if (step.second->isTemplate != (g_templateSlots.count(key) > 0)) {
+                setTemplateMark(configLines, key, step.second->isTemplate);
+                marksMoved = true;
+            }
+            if (exists && value == stored) {
+                continue;
+            }
+            changes.push_back({key, previousContent(slots, key)});
+            slots.set(key, value);
+        } else if (exists && !(isPrimarySlot(key) && stored.empty())) {
+            // Primary slots are emptied, the others deleted
+            changes.push_back({key, previousContent(slots, key)});
+            if (isPrimarySlot(key)) {
+                slots.set(key, "");
+            } else {
+                slots.erase(key);
+            }
+        }
+    }
+    
+    changed = changes.size();
+    if (changes.empty() && !marksMoved) {
+        return true;
+    }
+    if (!writeStoreFile(configLines, slots)) {
+        return false;
+    }
+    
+    for (const auto& change : changes) {
+        forgetSlotCaches(change.first);
+        recordVersion(change.first, change.second);
+    }
+    applyRangeToMetadata(op);
+    pushUndo(describeRange(op), changes);
+    return true;
+}
+
+// ========================================
+// SLOT SYNC
+// ========================================
+// Slots are exchanged between machines through a shared directory
+// (SYNC_DIR), without any network service. Each sync writes one delta file
+// holding only the slots changed here since the previous sync, and merges
+// the delta files written by the other machines. Every slot carries a
+// version vector (one counter per machine): a change is applied only over
+// the versions it has seen, and two concurrent changes are settled the
+// same way on every machine. The local state is an append-only journal
+// next to the save file (<store>.sync).
+
+typedef std::map<std::string, unsigned long> VersionVector;
+
+struct SyncSlotState {
+    bool present = false;       // The slot has a non-empty content
+    uint64_t hash = 0;          // Content at the last sync
+    std::string author;         // Machine of the last change
+    VersionVector versions;
+};
+
+struct SyncState {
+    std::string machine;
+    unsigned long sequence = 0;                   // Last delta file written
+    std::map<std::string, unsigned long> seen;    // Machine -> last delta file merged
+    std::map<std::string, SyncSlotState> slots;
+    size_t journalLines = 0;
+};
+
+struct SyncEntry {
+    std::string key;
+    std::string author;
+    VersionVector versions;
+    std::string content;        // Empty: the slot was cleared or deleted
+};
+
+struct SyncReport {
+    size_t sent = 0;
+    size_t received = 0;
+    size_t conflicts = 0;
+    size_t damaged = 0;
+};
+
+std::string formatVersions(const VersionVector& versions) {
+    // machine:counter,machine:counter
+    std::string text;
+    for (const auto& version : versions) {
+        if (!text.empty()) {
+            text += ',';
+        }
+        text += version.first + ":" + std::to_string(version.second);
+    }
+    return text;
+}
+
+bool parseVersions(const std::string& text, VersionVector& versions) {
+    versions.clear();
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        size_t colon = item.find(':');
+        if (colon == std::string::npos || colon == 0) {
+            return false;
+        }
+        try {
+            versions[item.substr(0, colon)] = std::stoul(item.substr(colon + 1));
+        } catch (...) {
+            return false;
+        }
+    }
+    return true;
+}
+
+enum VersionOrder {
+    VERSIONS_EQUAL,
+    VERSIONS_BEFORE,      // The first vector has seen less than the second
+    VERSIONS_AFTER,
+    VERSIONS_CONCURRENT
+};
+
+VersionOrder compareVersions(const VersionVector& a, const VersionVector& b) {
+    bool less = false, greater = false;
+    auto ia = a.begin();
+    auto ib = b.begin();
+    while (ia != a.end() || ib != b.end()) {
+        unsigned long countA = 0, countB = 0;
+        if (ib == b.end() || (ia != a.end() && ia->first < ib->first)) {
+            countA = (ia++)->second;
+        } else if (ia == a.end() || ib->first < ia->first) {
+            countB = (ib++)->second;
+        } else {
+            countA = (ia++)->second;
+            countB = (ib++)->second;
+        }
+        less = less || countA < countB;
+        greater = greater || countA > countB;
+    }
+    return less ? (greater ? VERSIONS_CONCURRENT : VERSIONS_BEFORE) : (greater ? VERSIONS_AFTER : VERSIONS_EQUAL);
+}
+
+void mergeVersions(VersionVector& into, const VersionVector& other) {
+    for (const auto& version : other) {
+        into[version.first] = std::max(into[version.first], version.second);
+    }
+}
+
+unsigned long long versionWeight(const VersionVector& versions) {
+    unsigned long long total = 0;
+    for (const auto& version : versions) {
+        total += version.second;
+    }
+    return total;
+}
+
+std::string syncSlotLine(const std::string& key, const SyncSlotState& slot) {
+    // SLOT|key|hash (- if absent)|author|versions
+    char hash[17];
+    snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)slot.hash);
+    return "SLOT|" + key + "|" + (slot.present ? hash : "-") + "|" + slot.author + "|" + formatVersions(slot.versions);
+}
+
+bool loadSyncState(SyncState& state) {
+    // Later lines of the journal replace earlier ones
+    std::ifstream file(SAVE_FILE + ".sync");
+    std::string line;
+    while (std::getline(file, line)) {
+        state.journalLines++;
+        std::vector<std::string> fields;
+        std::stringstream stream(line);
+        std::string field;
+        while (std::getline(stream, field, '|')) {
+            fields.push_back(field);
+        }
+        try {
+            if (fields.size() == 2 && fields[0] == "ID") {
+                state.machine = fields[1];
+            } else if (fields.size() == 2 && fields[0] == "SEQ") {
+                state.sequence = std::stoul(fields[1]);
+            } else if (fields.size() == 3 && fields[0] == "SEEN") {
+                state.seen[fields[1]] = std::stoul(fields[2]);
+            } else if (fields.size() >= 4 && fields[0] == "SLOT") {
+                SyncSlotState& slot = state.slots[fields[1]];
+                slot.present = fields[2] != "-";
+                slot.hash = slot.present ? std::stoull(fields[2], nullptr, 16) : 0;
+                slot.author = fields[3];
+                parseVersions(fields.size() > 4 ? fields[4] : "", slot.versions);
+            }
+        } catch (...) {
+        }
+    }
+    file.close();
+    if (!state.machine.empty()) {
+        return true;
+    }
+    
+    // First sync on this machine: a random identifier
+    uint8_t id[8];
+    if (!randomBytes(id, sizeof(id))) {
+        return false;
+    }
+    char hex[17];
+    for (int i = 0; i < 8; i++) {
+        snprintf(hex + 2 * i, 3, "%02x", id[i]);
+    }
+    state.machine = hex;
+    std::ofstream journal(SAVE_FILE + ".sync", std::ios::out | std::ios::app);
+    journal << "ID|" << state.machine << "\n";
+    state.journalLines++;
+    return journal.good();
+}
+
+bool writeSyncJournal(SyncState& state, const std::vector<std::string>& lines) {
+    // Appended, and rewritten from the state once half of it is outdated
+    size_t live = 2 + state.seen.size() + state.slots.size();
+    if (state.journalLines + lines.size() <= 2 * live + 64) {
+        std::ofstream journal(SAVE_FILE + ".sync", std::ios::out | std::ios::app);
+        for (const auto& line : lines) {
+            journal << line << "\n";
+        }
+        state.journalLines += lines.size();
+        return journal.good();
+    }
+    
+    std::ofstream journal(SAVE_FILE + ".sync", std::ios::out | std::ios::trunc);
+    journal << "ID|" << state.machine << "\n";
+    journal << "SEQ|" << state.sequence << "\n";
+    for (const auto& seen : state.seen) {
+        journal << "SEEN|" << seen.first << "|" << seen.second << "\n";
+    }
+    for (const auto& slot : state.slots) {
+        journal << syncSlotLine(slot.first, slot.second) << "\n";
+    }
+    state.journalLines = live;
+    return journal.good();
+}
+
+void listDeltaFiles(const std::string& dir, std::vector<std::string>& names) {
+    // Names only, in file name order (machine, then sequence)
+#ifdef _WIN32
+    WIN32_FIND_DATAA found;
+    HANDLE search = FindFirstFileA((dir + "\\*.delta").c_str(), &found);
+    if (search != INVALID_HANDLE_VALUE) {
+        do {
+            if (!(found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+                names.push_back(found.cFileName);
+            }
+        } while (FindNextFileA(search, &found));
+        FindClose(search);
+    }
+#else
+    DIR* directory = opendir(dir.c_str());
+    if (directory != nullptr) {
+        while (struct dirent* entry = readdir(directory)) {
+            std::string name = entry->d_name;
+            if (name.size() > 6 && name.compare(name.size() - 6, 6, ".delta") == 0) {
+                names.push_back(name);
+            }
+        }
+        closedir(directory);
+    }
+#endif
+    std::sort(names.begin(), names.end());
+}
+
+std::string deltaRecord(const std::string& key, const SyncSlotState& slot, const std::string& content) {
+    // SLOT<key>|author|versions|<escaped content>|<crc32c>
+    std::string record = "SLOT" + key + "|" + slot.author + "|" + formatVersions(slot.versions) + "|" + escapeString(content);
+    char checksum[RECORD_CHECKSUM_SIZE];
+    formatChecksum(checksum, crc32c(record.data(), record.size()));
+    record.append(checksum, RECORD_CHECKSUM_SIZE);
+    return record;
+}
+
+bool readDeltaFile(const std::string& path, std::vector<SyncEntry>& entries, size_t& damaged) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        return false;
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        
+        // Escaped contents never contain '|': exactly four of them
+        size_t pipes[4];
+        size_t count = 0;
+        for (size_t i = 0; i < line.size() && count <= 4; i++) {
+            if (line[i] == '|') {
+                if (count < 4) {
+                    pipes[count] = i;
+                }
+                count++;
+            }
+        }
+        char checksum[RECORD_CHECKSUM_SIZE];
+        if (count == 4) {
+            formatChecksum(checksum, crc32c(line.data(), pipes[3]));
+        }
+        SyncEntry entry;
+        if (count != 4 || line.compare(0, 4, "SLOT") != 0 || line.size() != pipes[3] + RECORD_CHECKSUM_SIZE ||
+            line.compare(pipes[3], RECORD_CHECKSUM_SIZE, checksum, RECORD_CHECKSUM_SIZE) != 0 ||
+            !parseVersions(line.substr(pipes[1] + 1, pipes[2] - pipes[1] - 1), entry.versions)) {
+            damaged++;
+            continue;
+        }
+        entry.key = line.substr(4, pipes[0] - 4);
+        entry.author = line.substr(pipes[0] + 1, pipes[1] - pipes[0] - 1);
+        entry.content = unescapeString(line.substr(pipes[2] + 1, pipes[3] - pipes[2] - 1));
+        entries.push_back(std::move(entry));
+    }
+    return true;
+}
+
+bool runSync(const std::string& dir, SyncReport& report, std::string& error) {
+    if (g_encryptStore) {
+        // Delta files would carry the contents in clear text
+        error = "Sync is not available with CLIPBOARD_ENCRYPT=1";
+        return false;
+    }
+    std::vector<std::string> configLines;
+    SlotTable slots;
+    SyncState state;
+    if (!readStoreFile(configLines, slots) || !loadSyncState(state)) {
+        error = "Unable to read the save file or its sync state";
+        return false;
+    }
+    
+    // 1. Slots changed here since the last sync get a new version first, so
+    //    that incoming changes are compared with them
+    std::set<std::string> outgoing;
+    auto noteLocal = [&state, &outgoing](const std::string& key, const std::string& content) {
+        bool present = !content.empty();
+        uint64_t hash = present ? hashContent(content.data(), content.size()) : 0;
+        auto known = state.slots.find(key);
+        if (known == state.slots.end() ? !present : known->second.present == present && known->second.hash == hash) {
+            return;
+        }
+        SyncSlotState& slot = state.slots[key];
+        slot.present = present;
+        slot.hash = hash;
+        slot.author = state.machine;
+        slot.versions[state.machine]++;
+        outgoing.insert(key);
+    };
+    for (const auto& slot : slots) {
+        std::string key = slot.key();
+        std::string content;
+        decodeStoredValue(key, slot.value(), content);
+        noteLocal(key, content);
+    }
+    std::vector<std::string> removed;
+    for (const auto& slot : state.slots) {
+        if (slot.second.present && !slots.contains(slot.first)) {
+            removed.push_back(slot.first);
+        }
+    }
+    for (const auto& key : removed) {
+        noteLocal(key, "");
+    }
+    
+    // 2. They leave as one delta file, renamed once complete so that other
+    //    machines never read half of it. A concurrent change merged below
+    //    is settled the same way by the machines receiving this file.
+    std::vector<std::string> journal;
+    if (!outgoing.empty()) {
+        char sequence[16];
+        snprintf(sequence, sizeof(sequence), "%010lu", state.sequence + 1);
+        std::string path = dir + "/" + state.machine + "-" + sequence + ".delta";
+        std::ofstream delta(path + ".tmp", std::ios::out | std::ios::trunc);
+        delta << "# CLIPBOARD SYNC|" << state.machine << "|" << sequence << "\n";
+        for (const auto& key : outgoing) {
+            std::string stored, content;
+            if (slots.find(key, stored)) {
+                decodeStoredValue(key, stored, content);
+            }
+            delta << deltaRecord(key, state.slots[key], content) << "\n";
+        }
+        delta.close();
+        if (!delta || std::rename((path + ".tmp").c_str(), path.c_str()) != 0) {
+            // Nothing is recorded: the same changes are found at the next sync
+            std::remove((path + ".tmp").c_str());
+            error = "Unable to write to " + dir;
+            return false;
+        }
+        state.sequence++;
+        writeSyncJournal(state, {"SEQ|" + std::to_string(state.sequence)});
+        report.sent = outgoing.size();
+    }
+    
+    // 3. Delta files of the other machines not merged yet, oldest first
+    std::vector<std::string> names;
+    listDeltaFiles(dir, names);
+    std::set<std::string> synced = outgoing;
+    std::map<std::string, std::string> incoming;   // Slot -> content received
+    for (const auto& name : names) {
+        size_t dash = name.find('-');
+        unsigned long sequence = 0;
+        try {
+            sequence = std::stoul(name.substr(dash + 1));
+        } catch (...) {
+            continue;
+        }
+        std::string machine = name.substr(0, dash);
+        std::vector<SyncEntry> entries;
+        if (dash == std::string::npos || machine == state.machine || sequence <= state.seen[machine] ||
+            !readDeltaFile(dir + "/" + name, entries, report.damaged)) {
+            continue;
+        }
+        
+        for (const auto& entry : entries) {
+            SyncSlotState& local = state.slots[entry.key];
+            VersionOrder order = compareVersions(local.versions, entry.versions);
+            if (order == VERSIONS_EQUAL || order == VERSIONS_AFTER) {
+                continue;
+            }
+            
+            // Concurrent changes: the most edited one wins, then the
+            // highest machine identifier, on every machine alike
+            bool remoteWins = order == VERSIONS_BEFORE;
+            if (order == VERSIONS_CONCURRENT) {
+                report.conflicts++;
+                unsigned long long localWeight = versionWeight(local.versions);
+                unsigned long long remoteWeight = versionWeight(entry.versions);
+                remoteWins = remoteWeight > localWeight || (remoteWeight == localWeight && entry.author > local.author);
+            }
+            mergeVersions(local.versions, entry.versions);
+            synced.insert(entry.key);
+            if (!remoteWins) {
+                continue;
+            }
+            
+            incoming[entry.key] = entry.content;
+            local.present = !entry.content.empty();
+            local.hash = local.present ? hashContent(entry.content.data(), entry.content.size()) : 0;
+            local.author = entry.author;
+        }
+        state.seen[machine] = sequence;
+        journal.push_back("SEEN|" + machine + "|" + std::to_string(sequence));
+    }
+    
+    // 4. Received slots are appended to the save file, never a full
+    //    rewrite. The table is sorted once for all of them.
+    report.received = incoming.size();
+    UndoEntry::Changes changes;
+    std::vector<std::string> appended;
+    for (const auto& slot : incoming) {
+        changes.push_back({slot.first, previousContent(slots, slot.first)});
+        appended.push_back(slot.first);
+    }
+    for (const auto& slot : incoming) {
+        std::string stored = encodeStoredValue(slot.first, slot.second);
+        slots.append(slot.first.data(), slot.first.size(), stored.data(), stored.size());
+    }
+    slots.sortKeys();
+    if (!appendStoreRecords(slots, appended)) {
+        error = "Unable to update the save file";
+        return false;
+    }
+    for (const auto& change : changes) {
+        forgetSlotCaches(change.first);
+        recordVersion(change.first, change.second);
+    }
+    for (const auto& slot : incoming) {
+        noteSlotWritten(slot.first, slot.second.size(), &slot.second);
+    }
+    pushUndo("SYNC " + std::to_string(changes.size()) + " slot(s)", changes);
+    
+    for (const auto& key : synced) {
+        journal.push_back(syncSlotLine(key, state.slots[key]));
+    }
+    writeSyncJournal(state, journal);
+    return true;
+}
+
+int runSyncOnce(const std::string& dir) {
+    // --sync <dir>: one sync of the save file of the current directory
+    initializeSaveFile();
+    loadSlotMetadata();
+    SyncReport report;
+    std::string error;
+    if (!runSync(dir, report, error)) {
+        std::cout << "XX ERROR: " << error << std::endl;
+        return 1;
+    }
+    flushSlotMetadata();
+    std::cout << "OK SYNC --> " << report.received << " slot(s) received, " << report.sent << " sent, "
+              << report.conflicts << " conflict(s)" << std::endl;
+    if (report.damaged > 0) {
+        std::cout << "XX DAMAGED --> " << report.damaged << " sync record(s) ignored" << std::endl;
+    }
+    return 0;
+}
+
+// ========================================
+// CLIPBOARD MANAGEMENT
+// ========================================
+
+// Contention counters, reported in the console
+struct ClipboardStats {
+    std::atomic<unsigned long> acquisitions{0};   // Successful OpenClipboard
+    std::atomic<unsigned long> retries{0};        // Failed attempts followed by a retry
+    std::atomic<unsigned long> timeouts{0};       // Deadline reached without the clipboard
+    std::atomic<unsigned long long> totalWaitMs{0};
+    std::atomic<unsigned long> maxWaitMs{0};
+};
+ClipboardStats g_clipboardStats;
+
+// Headless backends (replay harness, non-Windows builds): an in-memory
+// clipboard and a counter instead of SendInput
+std::string g_fakeClipboard;
+unsigned long g_fakeClipboardSequence = 1;
+std::string g_fakeClipboardSource;
+unsigned long g_fakeKeyTaps = 0;
+unsigned long g_fakeExitRequests = 0;
+
+#ifdef _WIN32
+bool acquireClipboard() {
+    // Another application (RDP client, Office...) may hold the clipboard:
+    // retry with exponential backoff until CLIPBOARD_TIMEOUT_MS is reached
+    PhaseScope phase("OpenClipboard");
+    ULONGLONG start = GetTickCount64();
+    DWORD backoff = 1;
+    
+    while (true) {
+        if (OpenClipboard(nullptr)) {
+            unsigned long waited = (unsigned long)(GetTickCount64() - start);
+            g_clipboardStats.acquisitions++;
+            g_clipboardStats.totalWaitMs += waited;
+            unsigned long previousMax = g_clipboardStats.maxWaitMs;
+            while (waited > previousMax && !g_clipboardStats.maxWaitMs.compare_exchange_weak(previousMax, waited)) {
+            }
+            return true;
+        }
+        
+        ULONGLONG elapsed = GetTickCount64() - start;
+        if (elapsed >= CLIPBOARD_TIMEOUT_MS) {
+            g_clipboardStats.timeouts++;
+            g_clipboardStats.totalWaitMs += elapsed;
+            return false;
+        }
+        
+        g_clipboardStats.retries++;
+        DWORD remaining = (DWORD)(CLIPBOARD_TIMEOUT_MS - elapsed);
+        Sleep(backoff < remaining ? backoff : remaining);
+        if (backoff < 64) {
+            backoff *= 2;
+        }
+    }
+}
+
+#endif
+
+unsigned long getClipboardSequence() {
+    // Changes every time the clipboard content changes; 0 means unknown
+    if (g_headless) {
+        return g_fakeClipboardSequence;
+    }
+#ifdef _WIN32
+    return GetClipboardSequenceNumber();
+#else
+    return 0;
+#endif
+}
+
+std::string clipboardSourceApp() {
+    // Executable name of the application that put the text on the
+    // clipboard (or of the foreground window if its owner window is gone)
+    if (g_headless) {
+        return g_fakeClipboardSource;
+    }
+#ifdef _WIN32
+    HWND owner = GetClipboardOwner();
+    if (owner == NULL) {
+        owner = GetForegroundWindow();
+    }
+    DWORD processId = 0;
+    if (owner == NULL || GetWindowThreadProcessId(owner, &processId) == 0) {
+        return "";
+    }
+    HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, processId);
+    if (process == NULL) {
+        return "";
+    }
+    char path[MAX_PATH];
+    DWORD length = MAX_PATH;
+    std::string name;
+    if (QueryFullProcessImageNameA(process, 0, path, &length)) {
+        name.assign(path, length);
+        size_t separator = name.find_last_of("\\/");
+        if (separator != std::string::npos) {
+            name.erase(0, separator + 1);
+        }
+    }
+    CloseHandle(process);
+    return name;
+#else
+    return "";
+#endif
+}
+
+bool getClipboard(std::string& text) {
+    // Returns false only if the clipboard could not be acquired;
+    // a clipboard without text gives an empty string
+    PhaseScope phase("getClipboard");
+    text.clear();
+    if (g_headless) {
+        text = g_fakeClipboard;
+        return true;
+    }
+#ifdef _WIN32
+    if (!acquireClipboard()) {
+        return false;
+    }
+    
+    HANDLE hData = GetClipboardData(CF_UNICODETEXT);
+    if (hData == nullptr) {
+        CloseClipboard();
+        return true;
+    }
+    
+    wchar_t* pszText = static_cast<wchar_t*>(GlobalLock(hData));
+    if (pszText == nullptr) {
+        CloseClipboard();
+        return true;
+    }
+    
+    // Single conversion pass (no WideCharToMultiByte sizing pass)
+    size_t length = wcsnlen(pszText, GlobalSize(hData) / sizeof(wchar_t));
+    {
+        PhaseScope convert("UTF-16 to UTF-8", length * sizeof(wchar_t));
+        utf16ToUtf8(pszText, length, text);
+    }
+    
+    GlobalUnlock(hData);
+    CloseClipboard();
+#endif
+    
+    return true;
+}
+
+#ifdef _WIN32
+template <typename Fill>
+bool publishClipboardText(size_t capacity, Fill fill) {
+    // One CF_UNICODETEXT block of capacity units plus the terminator,
+    // filled in place: fill returns the number of units written
+    if (!acquireClipboard()) {
+        return false;
+    }
+    
+    EmptyClipboard();
+    
+    HGLOBAL hMem = GlobalAlloc(GMEM_MOVEABLE, (capacity + 1) * sizeof(wchar_t));
+    if (hMem == nullptr) {
+        CloseClipboard();
+        return false;
+    }
+    
+    wchar_t* pMem = static_cast<wchar_t*>(GlobalLock(hMem));
+    if (pMem == nullptr) {
+        GlobalFree(hMem);
+        CloseClipboard();
+        return false;
+    }
+    
+    size_t units = fill(pMem);
+    pMem[units] = L'\0';
+    GlobalUnlock(hMem);
+    
+    SetClipboardData(CF_UNICODETEXT, hMem);
+    CloseClipboard();
+    return true;
+}
+#endif
+
+bool setClipboard(const std::string& text) {
+    PhaseScope phase("setClipboard");
+    if (g_headless) {
+        g_fakeClipboard = text;
+        g_fakeClipboardSequence++;
+        return true;
+    }
+#ifdef _WIN32
+    // UTF-16 never needs more code units than UTF-8 has bytes, so the block
+    // is sized up front and filled in a single pass
+    return publishClipboardText(text.size(), [&text](wchar_t* pMem) {
+        PhaseScope convert("UTF-8 to UTF-16", text.size());
+        return utf8ToUtf16(text.data(), text.size(), pMem);
+    });
+#else
+    return true;
+#endif
+}
+
+bool setClipboardUnits(const std::vector<uint16_t>& units, const std::string& text) {
+    // Text already converted (primary slot cache): one copy into the block
+    PhaseScope phase("setClipboard", units.size() * sizeof(uint16_t));
+    if (g_headless) {
+        g_fakeClipboard = text;
+        g_fakeClipboardSequence++;
+        return true;
+    }
+#ifdef _WIN32
+    return publishClipboardText(units.size(), [&units](wchar_t* pMem) {
+        memcpy(pMem, units.data(), units.size() * sizeof(uint16_t));
+        return units.size();
+    });
+#else
+    return true;
+#endif
+}
+
+void sendKeyTap(int vkCode) {
+    // Replays a swallowed key that ended up not being part of a chord
+    if (g_headless) {
+        (void)vkCode;
+        g_fakeKeyTaps++;
+        return;
+    }
+#ifdef _WIN32
+    INPUT input[2] = {};
+    input[0].type = INPUT_KEYBOARD;
+    input[0].ki.wVk = vkCode;
+    input[1].type = INPUT_KEYBOARD;
+    input[1].ki.wVk = vkCode;
+    input[1].ki.dwFlags = KEYEVENTF_KEYUP;
+    SendInput(2, input, sizeof(INPUT));
+#endif
+}
+
+void requestExit() {
+    if (g_headless) {
+        g_fakeExitRequests++;
+        return;
+    }
+#ifdef _WIN32
+    PostMessage(g_hwnd, WM_CLOSE, 0, 0);
+#endif
+}
+
+// ========================================
+// DIRECT TYPING
+// ========================================
+// LOAD + K types a slot as Unicode keystrokes, for applications that ignore
+// the clipboard (remote consoles, locked-down terminals). Keys are sent in
+// batches of INPUT records, one SendInput call per batch, and batches are
+// spaced so that TYPE_RATE characters per second are not exceeded.
+
+const size_t TYPE_BATCH_CHARS = 64;  // Characters per SendInput call at most
+const unsigned long TYPE_BATCH_MS = 20;  // Batch spacing when TYPE_RATE is set
+
+// A UTF-16 unit sent with KEYEVENTF_UNICODE, or a virtual key for line
+// breaks and tabs (unicode Enter is ignored by most consoles)
+struct TypedKey {
+    uint16_t unit;
+    uint16_t vk;
+};
+
+struct TypingStats {
+    unsigned long runs = 0;
+    unsigned long stopped = 0;
+    unsigned long long characters = 0;
+    unsigned long long batches = 0;
+    double lastCharsPerSecond = 0;
+    double lastLatencyMs = 0;  // From the release of LOAD to the last batch
+    double maxLatencyMs = 0;
+};
+TypingStats g_typingStats;
+
+// Set by a LOAD press while a slot is being typed
+std::atomic<bool> g_typingActive(false);
+std::atomic<bool> g_typingCancel(false);
+
+// Headless input sink: typed units, batch count and a clock that only
+// advances through the pacing sleeps, so runs are deterministic
+std::u16string g_fakeTyped;
+unsigned long g_fakeTypedBatches = 0;
+double g_fakeTypingClockMs = 0;
+
+double typingClockMs() {
+    if (g_headless) {
+        return g_fakeTypingClockMs;
+    }
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void typingSleepMs(double ms) {
+    if (g_headless) {
+        g_fakeTypingClockMs += ms;
+        return;
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(ms));
+}
+
+size_t buildTypedKeys(const std::string& text, std::vector<TypedKey>& keys, std::vector<size_t>& charEnds) {
+    // charEnds[i] is the index in keys after character i: a surrogate pair
+    // is one character and is never split between two batches
+    std::vector<uint16_t> units(text.size());
+    size_t count = utf8ToUtf16(text.data(), text.size(), units.data());
+    keys.clear();
+    charEnds.clear();
+    keys.reserve(count);
+    charEnds.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        uint16_t unit = units[i];
+        if (unit == '\r') {
+            if (i + 1 < count && units[i + 1] == '\n') continue;
+            keys.push_back({0, VK_RETURN});
+        } else if (unit == '\n') {
+            keys.push_back({0, VK_RETURN});
+        } else if (unit == '\t') {
+            keys.push_back({0, VK_TAB});
+        } else {
+            keys.push_back({unit, 0});
+            if (unit >= 0xD800 && unit < 0xDC00 && i + 1 < count) {
+                keys.push_back({units[++i], 0});
+            }
+        }
+        charEnds.push_back(keys.size());
+    }
+    return charEnds.size();
+}
+
+bool sendTypedBatch(const TypedKey* keys, size_t count) {
+    // Key down + key up for each key; false if input was blocked midway
+    if (g_headless) {
+        for (size_t i = 0; i < count; i++) {
+            if (keys[i].vk == VK_RETURN) g_fakeTyped += u'\n';
+            else if (keys[i].vk == VK_TAB) g_fakeTyped += u'\t';
+            else g_fakeTyped += static_cast<char16_t>(keys[i].unit);
+        }
+        g_fakeTypedBatches++;
+        return true;
+    }
+#ifdef _WIN32
+    INPUT inputs[TYPE_BATCH_CHARS * 4] = {};
+    UINT total = 0;
+    for (size_t i = 0; i < count; i++) {
+        for (int up = 0; up < 2; up++) {
+            INPUT& input = inputs[total++];
+            input.type = INPUT_KEYBOARD;
+            input.ki.wVk = keys[i].vk;
+            input.ki.wScan = keys[i].unit;
+            input.ki.dwFlags = (keys[i].vk ? 0 : KEYEVENTF_UNICODE) | (up ? KEYEVENTF_KEYUP : 0);
+        }
+    }
+    return SendInput(total, inputs, sizeof(INPUT)) == total;
+#else
+    return false;
+#endif
+}
+
+struct TypingRun {
+    size_t characters = 0;
+    size_t typed = 0;
+    double durationMs = 0;
+};
+
+bool typeText(const std::string& text, TypingRun& run) {
+    // Batch n is sent no earlier than n * batch / TYPE_RATE seconds after
+    // the first one: a slow SendInput is caught up, never accumulated
+    std::vector<TypedKey> keys;
+    std::vector<size_t> charEnds;
+    run.characters = buildTypedKeys(text, keys, charEnds);
+    run.typed = 0;
+    
+    size_t batchChars = TYPE_BATCH_CHARS;
+    if (TYPE_RATE > 0) {
+        batchChars = std::max<size_t>(1, std::min<size_t>(TYPE_BATCH_CHARS, TYPE_RATE * TYPE_BATCH_MS / 1000));
+    }
+    
+    g_typingCancel = false;
+    g_typingActive = true;
+    double start = typingClockMs();
+    bool complete = true;
+    while (run.typed < run.characters) {
+        if (g_typingCancel || !g_running) {
+            complete = false;
+            break;
+        }
+        if (TYPE_RATE > 0 && run.typed > 0) {
+            double due = start + run.typed * 1000.0 / TYPE_RATE;
+            double now = typingClockMs();
+            if (due > now) {
+                typingSleepMs(due - now);
+            }
+        }
+        size_t last = std::min(run.characters, run.typed + batchChars);
+        size_t first = run.typed == 0 ? 0 : charEnds[run.typed - 1];
+        PhaseScope phase("SendInput", charEnds[last - 1] - first);
+        if (!sendTypedBatch(keys.data() + first, charEnds[last - 1] - first)) {
+            complete = false;
+            break;
+        }
+        g_typingStats.batches++;
+        run.typed = last;
+    }
+    run.durationMs = typingClockMs() - start;
+    g_typingActive = false;
+    
+    g_typingStats.runs++;
+    g_typingStats.characters += run.typed;
+    if (!complete) {
+        g_typingStats.stopped++;
+    }
+    g_typingStats.lastCharsPerSecond = run.durationMs > 0 ? run.typed * 1000.0 / run.durationMs : 0;
+    return complete;
+}
+
+// ========================================
+// IDLE MAINTENANCE
+// ========================================
+// Housekeeping that can wait runs on a low-priority thread once input has
+// been idle for IDLE_MAINTENANCE_MS, in short slices: trimming the history
+// file, compacting the records left behind by appends, and verifying the
+// store checksums block by block. A slice holds the action lock, so a chord
+// waits for one slice at most, and any key stops the run before the next.
+// Compaction is spread over slices too: a first pass finds the last record
+// of every key, a second copies those to <store>.compact, which replaces
+// the store only if nothing wrote it meanwhile (else it is abandoned).
+
+const size_t MAINTENANCE_VERIFY_BYTES = 1 << 20;   // Store bytes verified per slice
+const size_t MAINTENANCE_COMPACT_BYTES = 1 << 20;  // Store bytes read per compaction slice
+const uint64_t COMPACT_RETRY_MS = 60000;           // First wait after a failed compaction, doubled up to
+const uint64_t COMPACT_RETRY_MAX_MS = 3600000;     // one hour
+
+struct MaintenanceStats {
+    std::atomic<unsigned long> slices{0};
+    std::atomic<unsigned long> interrupted{0};    // Runs stopped by input or an action
+    std::atomic<unsigned long long> verifiedBytes{0};
+    std::atomic<unsigned long> compactions{0};
+};
+MaintenanceStats g_maintenanceStats;
+
+// Bumped by every key the chord logic sees and every queued action
+std::atomic<uint64_t> g_inputEpoch(0);
+std::atomic<uint64_t> g_lastInputMs(0);
+
+// Headless clock: set from the trace timestamps in --replay
+uint64_t g_fakeMaintenanceClockMs = 0;
+
+// Checksum scrub position, valid while the store keeps this stamp
+std::atomic<uint64_t> g_scrubOffset(0);
+std::atomic<long long> g_scrubSize(-1);
+std::atomic<long long> g_scrubModified(0);
+std::atomic<unsigned long long> g_scrubIdentity(0);
+
+enum CompactionPass {
+    COMPACT_IDLE,
+    COMPACT_INDEX,      // Finding the last record of every key
+    COMPACT_COPY        // Copying those records
+};
+
+struct StoreCompaction {
+    CompactionPass pass = COMPACT_IDLE;
+    StoreStamp source;                                      // Store being compacted
+    uint64_t offset = 0;                                    // Next byte to read in the pass
+    std::unordered_map<std::string, uint64_t> lastRecord;   // Key -> offset of its last line
+    std::vector<std::string> configLines;
+    std::ofstream out;
+};
+StoreCompaction g_compaction;
+uint64_t g_compactRetryAtMs = 0;       // Maintenance clock before which a failed compaction waits
+uint64_t g_compactRetryDelayMs = 0;
+
+std::thread g_maintenanceThread;
+std::mutex g_maintenanceWaitMutex;
+std::condition_variable g_maintenanceWake;
+bool g_maintenanceStop = false;
+
+// Held while an action or a maintenance slice runs
+std::mutex g_actionRunMutex;
+
+uint64_t maintenanceClockMs() {
+    if (g_headless) {
+        return g_fakeMaintenanceClockMs;
+    }
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void noteInputActivity() {
+    g_inputEpoch++;
+    g_lastInputMs = maintenanceClockMs();
+}
+
+uint64_t inputIdleMs() {
+    uint64_t now = maintenanceClockMs();
+    uint64_t idle = now - std::min<uint64_t>(now, g_lastInputMs);
+#ifdef _WIN32
+    // Mouse and other input the hook does not see
+    if (!g_headless) {
+        LASTINPUTINFO info = {};
+        info.cbSize = sizeof(info);
+        if (GetLastInputInfo(&info)) {
+            idle = std::min<uint64_t>(idle, (DWORD)(GetTickCount() - info.dwTime));
+        }
+    }
+#endif
+    return idle;
+}
+
+struct MaintenanceDebt {
+    uint64_t unverifiedBytes = 0;
+    size_t staleRecords = 0;
+    size_t historyRecords = 0;      // Over HISTORY_FILE_MAX_RECORDS
+};
+
+MaintenanceDebt maintenanceDebt() {
+    MaintenanceDebt debt;
+    StoreStamp stamp = currentStoreStamp();
+    if (stamp.size > 0) {
+        bool sameFile = g_scrubSize == stamp.size && g_scrubModified == stamp.modified && g_scrubIdentity == stamp.identity;
+        debt.unverifiedBytes = (uint64_t)stamp.size - (sameFile ? std::min<uint64_t>(g_scrubOffset, stamp.size) : 0);
+    }
+    debt.staleRecords = g_storeStaleRecords;
+    size_t historyRecords = g_historyFileRecords;
+    debt.historyRecords = historyRecords > HISTORY_FILE_MAX_RECORDS ? historyRecords - HISTORY_FILE_MAX_RECORDS : 0;
+    return debt;
+}
+
+bool trimHistorySlice() {
+    if (g_historyFileRecords <= HISTORY_FILE_MAX_RECORDS) {
+        return false;
+    }
+    trimHistoryFile();
+    return true;
+}
+
+bool readStoreBlock(uint64_t offset, uint64_t size, size_t maxBytes, std::string& block, size_t& length) {
+    // Whole lines from offset: about maxBytes of them, or one longer line
+    std::ifstream file(SAVE_FILE, std::ios::binary);
+    if (!file.is_open() || !file.seekg((std::streamoff)offset)) {
+        return false;
+    }
+    block.assign(maxBytes, '\0');
+    file.read(&block[0], block.size());
+    length = (size_t)file.gcount();
+    block.resize(length);
+    if (offset + length < size) {
+        size_t lastNewline = block.rfind('\n');
+        if (lastNewline != std::string::npos) {
+            length = lastNewline + 1;
+        } else {
+            file.clear();
+            std::string rest;
+            std::getline(file, rest);
+            block += rest;
+            length = block.size();
+            if (!file.eof()) {
+                block += '\n';
+                length++;
+            }
+        }
+    }
+    return true;
+}
+
+void endCompaction() {
+    g_compaction.out.close();
+    remove((SAVE_FILE + ".compact").c_str());
+    g_compaction.pass = COMPACT_IDLE;
+    g_compaction.lastRecord.clear();
+    g_compaction.configLines.clear();
+}
+
+void failCompaction() {
+    // The stale records stay counted; tried again later, less and less often
+    endCompaction();
+    g_compactRetryDelayMs = std::min(COMPACT_RETRY_MAX_MS, std::max(COMPACT_RETRY_MS, g_compactRetryDelayMs * 2));
+    g_compactRetryAtMs = maintenanceClockMs() + g_compactRetryDelayMs;
+}
+
+bool finishCompaction() {
+    // The copy replaces the store, whose contents it holds unchanged
+    g_compaction.out.close();
+    if (!g_compaction.out) {
+        return false;
+    }
+    std::string compacted = SAVE_FILE + ".compact";
+#ifdef _WIN32
+    if (!MoveFileExA(compacted.c_str(), SAVE_FILE.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+        return false;
+    }
+#else
+    if (std::rename(compacted.c_str(), SAVE_FILE.c_str()) != 0) {
+        return false;
+    }
+#endif
+    StoreStamp stamp = currentStoreStamp();
+    if (g_storeStamp == g_compaction.source) {
+        g_storeStamp = stamp;
+    }
+    if (g_primaryCacheStamp == g_compaction.source) {
+        g_primaryCacheStamp = stamp;
+    }
+    g_storeStaleRecords = 0;
+    g_compactRetryDelayMs = 0;
+    g_maintenanceStats.compactions++;
+    endCompaction();
+    return true;
+}
+
+bool compactStoreSlice() {
+    // One block of the current pass; the superseded and empty records are
+    // left out of the copy
+    StoreCompaction& compaction = g_compaction;
+    if (compaction.pass == COMPACT_IDLE) {
+        if (g_storeStaleRecords == 0 || maintenanceClockMs() < g_compactRetryAtMs) {
+            return false;
+        }
+        compaction.source = currentStoreStamp();
+        compaction.offset = 0;
+        compaction.pass = COMPACT_INDEX;
+    } else if (!(currentStoreStamp() == compaction.source)) {
+        // Written meanwhile: the next slice starts over if still needed
+        endCompaction();
+        return true;
+    }
+    
+    std::string block;
+    size_t length;
+    if (compaction.source.size <= 0 ||
+        !readStoreBlock(compaction.offset, compaction.source.size, MAINTENANCE_COMPACT_BYTES, block, length)) {
+        failCompaction();
+        return false;
+    }
+    for (size_t start = 0; start < length;) {
+        size_t end = block.find('\n', start);
+        end = end == std::string::npos || end > length ? length : end;
+        uint64_t lineOffset = compaction.offset + start;
+        std::string line = block.substr(start, end - start - (end > start && block[end - 1] == '\r' ? 1 : 0));
+        start = end + 1;
+        
+        if (isConfigLine(line)) {
+            if (compaction.pass == COMPACT_INDEX) {
+                compaction.configLines.push_back(line);
+            }
+            continue;
+        }
+        size_t keyEnd, valueEnd;
+        if (checkSlotRecord(line.data(), line.size(), keyEnd, valueEnd) == RECORD_DAMAGED) {
+            // Salvaged as on startup, which also rewrites the store
+            endCompaction();
+            std::vector<std::string> configLines;
+            SlotTable slots;
+            readStoreFile(configLines, slots);
+            return true;
+        }
+        std::string key = line.substr(4, keyEnd - 4);
+        if (compaction.pass == COMPACT_INDEX) {
+            compaction.lastRecord[key] = lineOffset;
+        } else if (compaction.lastRecord.find(key)->second == lineOffset && (valueEnd > keyEnd + 1 || isPrimarySlot(key))) {
+            compaction.out << line << '\n';
+        }
+    }
+    compaction.offset += length;
+    if (compaction.offset < (uint64_t)compaction.source.size) {
+        return true;
+    }
+    
+    if (compaction.pass == COMPACT_INDEX) {
+        // Settings first, as a full rewrite writes them
+        compaction.pass = COMPACT_COPY;
+        compaction.offset = 0;
+        compaction.out.open(SAVE_FILE + ".compact", std::ios::out | std::ios::trunc);
+        for (const auto& configLine : compaction.configLines) {
+            compaction.out << configLine << '\n';
+        }
+        if (!compaction.out) {
+            failCompaction();
+            return false;
+        }
+        return true;
+    }
+    if (!finishCompaction()) {
+        failCompaction();
+        return false;
+    }
+    return true;
+}
+
+bool verifyStoreSlice() {
+    // The next block of whole lines; the scrub restarts when the file changes
+    StoreStamp stamp = currentStoreStamp();
+    if (stamp.size <= 0) {
+        return false;
+    }
+    if (g_scrubSize != stamp.size || g_scrubModified != stamp.modified || g_scrubIdentity != stamp.identity) {
+        g_scrubOffset = 0;
+        g_scrubSize = stamp.size;
+        g_scrubModified = stamp.modified;
+        g_scrubIdentity = stamp.identity;
+    }
+    uint64_t offset = g_scrubOffset;
+    if (offset >= (uint64_t)stamp.size) {
+        return false;
+    }
+    
+    // A line longer than a block is verified whole
+    std::string block;
+    size_t length;
+    if (!readStoreBlock(offset, stamp.size, MAINTENANCE_VERIFY_BYTES, block, length)) {
+        return false;
+    }
+    
+    StoreCheck check;
+    verifyStoreBuffer(block.data(), length, check);
+    g_scrubOffset = offset + length;
+    g_maintenanceStats.verifiedBytes += length;
+    if (check.damaged > 0) {
+        // Salvaged as on startup: quarantined, then the store is rewritten
+        std::vector<std::string> configLines;
+        SlotTable slots;
+        readStoreFile(configLines, slots);
+    }
+    return true;
+}
+
+bool runMaintenanceSlice() {
+    // Compaction first: verifying a file about to be rewritten is wasted
+    return trimHistorySlice() || compactStoreSlice() || verifyStoreSlice();
+}
+
+size_t runIdleMaintenance() {
+    // Slices until the debt is paid or input comes back
+    if (IDLE_MAINTENANCE_MS == 0) {
+        return 0;
+    }
+    uint64_t epoch = g_inputEpoch;
+    size_t slices = 0;
+    while (g_running) {
+        if (g_inputEpoch != epoch || inputIdleMs() < IDLE_MAINTENANCE_MS) {
+            if (slices > 0) {
+                g_maintenanceStats.interrupted++;
+            }
+            break;
+        }
+        std::lock_guard<std::mutex> lock(g_actionRunMutex);
+        PhaseScope phase("maintenance");
+        if (!runMaintenanceSlice()) {
+            break;
+        }
+        g_maintenanceStats.slices++;
+        slices++;
+    }
+    return slices;
+}
+
+void maintenanceLoop() {
+    g_phaseThreadName = "maintenance";
+#ifdef _WIN32
+    // Lowest CPU and disk priority
+    SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+#endif
+    std::unique_lock<std::mutex> lock(g_maintenanceWaitMutex);
+    while (true) {
+        // Idle time is polled: nothing signals that input stopped
+        g_maintenanceWake.wait_for(lock, std::chrono::seconds(1), [] { return g_maintenanceStop; });
+        if (g_maintenanceStop) {
+            return;
+        }
+        lock.unlock();
+        runIdleMaintenance();
+        lock.lock();
+    }
+}
+
+void startMaintenance() {
+    g_maintenanceThread = std::thread(maintenanceLoop);
+}
+
+void stopMaintenance() {
+    // A slice in progress is finished first
+    {
+        std::lock_guard<std::mutex> lock(g_maintenanceWaitMutex);
+        g_maintenanceStop = true;
+    }
+    g_maintenanceWake.notify_one();
+    if (g_maintenanceThread.joinable()) {
+        g_maintenanceThread.join();
+    }
+}
+
+// ========================================
+// CONSOLE DISPLAY
+// ========================================
+
+void displayStats() {
+    std::cout << "[CLIPBOARD] " << g_clipboardStats.acquisitions << " opened, "
+              << g_clipboardStats.retries << " retries, "
+              << g_clipboardStats.timeouts << " timeouts, wait "
+              << g_clipboardStats.totalWaitMs << " ms total / "
+              << g_clipboardStats.maxWaitMs << " ms max" << std::endl;
+    std::cout << "[SAVES] " << g_saveStats.written << " written, "
+              << g_saveStats.skipped << " unchanged skipped ("
+              << g_saveStats.clipboardReadsSkipped << " without reading the clipboard), "
+              << g_saveStats.bytesSaved << " bytes not rewritten" << std::endl;
+    std::cout << "[LOADS] slots 1-10: " << formatLoadLatency(g_primaryLoads, true)
+              << " | other slots: " << formatLoadLatency(g_additionalLoads, false) << std::endl;
+    std::cout << "[TYPING] " << g_typingStats.characters << " chars typed in "
+              << g_typingStats.batches << " batches ("
+              << g_typingStats.stopped << " stopped), last "
+              << (unsigned long)g_typingStats.lastCharsPerSecond << " chars/s, done "
+              << (unsigned long)g_typingStats.lastLatencyMs << " ms after release / "
+              << (unsigned long)g_typingStats.maxLatencyMs << " ms max" << std::endl;
+    MaintenanceDebt debt = maintenanceDebt();
+    std::cout << "[MAINTENANCE] " << g_maintenanceStats.slices << " idle slices ("
+              << g_maintenanceStats.interrupted << " interrupted), pending: "
+              << (debt.unverifiedBytes + 1023) / 1024 << " KB to verify, "
+              << debt.staleRecords << " records to compact, "
+              << debt.historyRecords << " history records to trim" << std::endl;
+    std::cout << "[SLOTS] " << g_slotMetadata.count() << " with usage data, "
+              << countUnusedSlots(g_slotMetadata, (int64_t)time(nullptr), g_unusedDays) << " unused for "
+              << g_unusedDays << "+ days (type recent, frequent, unused <days> or numbers to reorder)" << std::endl;
+    if (g_deltaStore) {
+        std::cout << "[DELTAS] " << g_deltaStats.slots << " slots stored as deltas, "
+                  << (g_deltaStats.fullBytes + 1023) / 1024 << " KB written as "
+                  << (g_deltaStats.deltaBytes + 1023) / 1024 << " KB" << std::endl;
+    }
+}
+
+void showAliasCompletion(const std::string& prefix) {
+    // Shown in the console title while the name is typed, so the slot list
+    // does not have to be redrawn on every key
+    std::string title = "Clipboard Manager";
+    if (!prefix.empty()) {
+        std::string name;
+        std::string slotNum;
+        int matches = completeAlias(prefix, name, slotNum);
+        title += " - " + prefix;
+        if (matches == 0) {
+            title += " (no slot)";
+        } else if (matches == 1) {
+            title += " -> " + name + " [" + slotNum + "]";
+        } else {
+            title += " (" + std::to_string(matches) + " slots)";
+        }
+    }
+#ifdef _WIN32
+    if (!g_headless) {
+        SetConsoleTitleA(title.c_str());
+    }
+#endif
+}
+
+void refreshDisplay() {
+    if (!g_consoleVisible) return;
+    
+    std::lock_guard<std::mutex> lock(g_displayMutex);
+    PhaseScope phase("refreshDisplay");
+    {
+        PhaseScope clear("cls");
+#ifdef _WIN32
+        system("cls");
+#else
+        system("clear");
+#endif
+    }
+    
+    // Display last 4 action history
+    displayHistory();
+    
+    // Display all slots
+    {
+        PhaseScope slots("displayAllSlots");
+        displayAllSlots();
+    }
+    
+    // Display clipboard contention
+    displayStats();
+}
+
+// ========================================
+// ACTIONS
+// ========================================
+
+void skipSave(const std::string& finalSlot, SlotFingerprint& fingerprint, unsigned long sequence, bool clipboardRead) {
+    fingerprint.sequence = sequence;
+    g_saveStats.skipped++;
+    g_saveStats.bytesSaved += (unsigned long long)g_storeStamp.size;
+    if (!clipboardRead) {
+        g_saveStats.clipboardReadsSkipped++;
+    }
+    noteSlotWritten(finalSlot, fingerprint.size);
+    addToHistory("OK SAVE --> Slot [%s] unchanged, not rewritten", finalSlot.c_str());
+    refreshDisplay();
+}
+
+void performSave(const std::string& finalSlot) {
+    // An unchanged clipboard is detected first from its sequence number,
+    // then from the hash and size of what was read
+    unsigned long sequence = getClipboardSequence();
+    auto fingerprint = g_slotFingerprints.end();
+    if (!g_templateSlots.count(finalSlot)) {
+        StoreStamp stamp = currentStoreStamp();
+        if (stamp == g_storeStamp) {
+            fingerprint = g_slotFingerprints.find(finalSlot);
+        } else {
+            g_slotFingerprints.clear();
+        }
+    }
+    
+    if (fingerprint != g_slotFingerprints.end() && sequence != 0 && fingerprint->second.sequence == sequence) {
+        skipSave(finalSlot, fingerprint->second, sequence, false);
+        return;
+    }
+    
+    std::string clipContent;
+    if (!getClipboard(clipContent)) {
+        // Never overwrite a slot with an empty string because the clipboard was busy
+        addToHistory("XX ERROR --> Clipboard busy, Slot [%s] not saved", finalSlot.c_str());
+        refreshDisplay();
+        return;
+    }
+    
+    if (fingerprint != g_slotFingerprints.end() && fingerprint->second.size == clipContent.size() &&
+        fingerprint->second.hash == hashContent(clipContent.data(), clipContent.size())) {
+        skipSave(finalSlot, fingerprint->second, sequence, true);
+        return;
+    }
+    
+    bool success = writeSlotToFile(finalSlot, clipContent);
+    
+    if (success) {
+        g_slotFingerprints[finalSlot].sequence = sequence;
+        g_saveStats.written++;
+        noteSlotSource(finalSlot, clipboardSourceApp());
+        char preview[PREVIEW_BUFFER_SIZE(40)];
+        buildPreview(clipContent.data(), clipContent.size(), 40, false, preview);
+        
+        addToHistory("OK SAVE --> Slot [%s] : \"%s\"", finalSlot.c_str(), preview);
+        refreshDisplay();
+    }
+}
+
+void performTemplateSave(const std::string& finalSlot) {
+    std::string clipContent;
+    if (!getClipboard(clipContent)) {
+        addToHistory("XX ERROR --> Clipboard busy, Slot [%s] not saved", finalSlot.c_str());
+        refreshDisplay();
+        return;
+    }
+    
+    auto source = std::make_shared<const std::string>(std::move(clipContent));
+    if (writeSlotToFile(finalSlot, *source, true)) {
+        // Parsed now, only expanded at LOAD
+        g_compiledTemplates[finalSlot] = compileTemplate(source);
+        noteSlotSource(finalSlot, clipboardSourceApp());
+        
+        char preview[PREVIEW_BUFFER_SIZE(40)];
+        buildPreview(source->data(), source->size(), 40, false, preview);
+        addToHistory("OK TEMPLATE --> Slot [%s] : \"%s\"", finalSlot.c_str(), preview);
+        refreshDisplay();
+    }
+}
+
+bool nextFreeBankSlot(ContentCategory category, std::string& slotNum) {
+    // Lowest slot of the bank that is missing or empty and has no name or
+    // template attached, looked up in the snapshot while it is current
+    SnapshotReader reader;
+    const SlotSnapshot* snapshot = reader.get();
+    SlotTable readSlots;
+    if (snapshot == nullptr || !(snapshot->stamp == currentStoreStamp())) {
+        snapshot = nullptr;
+        std::vector<std::string> configLines;
+        if (!readStoreFile(configLines, readSlots)) {
+            return false;
+        }
+    }
+    const SlotTable& slots = snapshot ? snapshot->slots : readSlots;
+    const AutoBank& bank = g_autoBanks[category];
+    for (unsigned long number = bank.first; number <= bank.last; number++) {
+        std::string key = std::to_string(number);
+        SlotTable::Entry entry;
+        if ((!slots.findEntry(key, entry) || entry.valueLength == 0) && aliasOfSlot(key).empty() && !g_templateSlots.count(key)) {
+            slotNum = key;
+            return true;
+        }
+    }
+    return false;
+}
+
+void performAutoSave() {
+    unsigned long sequence = getClipboardSequence();
+    std::string clipContent;
+    if (!getClipboard(clipContent)) {
+        addToHistory("XX ERROR --> Clipboard busy, not saved");
+        refreshDisplay();
+        return;
+    }
+    
+    ContentCategory category = classifyContent(clipContent);
+    std::string slotNum;
+    if (category == CATEGORY_NONE) {
+        addToHistory("XX ERROR --> Clipboard empty, not saved");
+    } else if (!nextFreeBankSlot(category, slotNum)) {
+        addToHistory("XX ERROR --> No free slot for %s in [%lu-%lu]", CATEGORY_NAMES[category],
+                     g_autoBanks[category].first, g_autoBanks[category].last);
+    } else if (writeSlotToFile(slotNum, clipContent)) {
+        g_slotFingerprints[slotNum].sequence = sequence;
+        g_saveStats.written++;
+        noteSlotSource(slotNum, clipboardSourceApp());
+        char preview[PREVIEW_BUFFER_SIZE(40)];
+        buildPreview(clipContent.data(), clipContent.size(), 40, false, preview);
+        addToHistory("OK SAVE --> Slot [%s] <%s> : \"%s\"", slotNum.c_str(), CATEGORY_NAMES[category], preview);
+    }
+    refreshDisplay();
+}
+
+std::string expandSlotTemplate(const std::string& slotNum) {
+    // The compiled form is kept until the slot changes, so a LOAD neither
+    // reads the file nor parses the template again
+    auto it = g_compiledTemplates.find(slotNum);
+    if (it == g_compiledTemplates.end()) {
+        auto source = std::make_shared<const std::string>(readSlotFromFile(slotNum));
+        it = g_compiledTemplates.emplace(slotNum, compileTemplate(source)).first;
+    }
+    if (it->second.source->empty()) {
+        return "";
+    }
+    
+    std::string clipboard;
+    if (it->second.usesClipboard) {
+        getClipboard(clipboard);
+    }
+    return expandTemplate(it->second, clipboard);
+}
+
+const PrimarySlotCache* primaryCacheEntry(const std::string& slotNum) {
+    // Null for other slots and for those too large to be cached
+    unsigned long number;
+    if (!parseSlotNumber(slotNum.data(), slotNum.size(), number) || number > 10) {
+        return nullptr;
+    }
+    if (!(currentStoreStamp() == g_primaryCacheStamp)) {
+        // First LOAD, or the file changed behind our back: one read rebuilds all ten
+        dropPrimaryCache();
+        std::vector<std::string> configLines;
+        SlotTable slots;
+        if (!readStoreFile(configLines, slots)) {
+            return nullptr;
+        }
+        refreshPrimaryCache(slots);
+    }
+    const PrimarySlotCache& cache = g_primaryCache[number - 1];
+    return cache.ready ? &cache : nullptr;
+}
+
+void performLoad(const std::string& finalSlot, bool chordTransform = false) {
+    auto start = std::chrono::steady_clock::now();
+    
+    // Slots 1-10 come ready to publish, unless LOAD + X adds its steps
+    const PrimarySlotCache* cached = nullptr;
+    if (!chordTransform && !g_templateSlots.count(finalSlot)) {
+        cached = primaryCacheEntry(finalSlot);
+    }
+    std::string content;
+    if (!cached) {
+        content = g_templateSlots.count(finalSlot) ? expandSlotTemplate(finalSlot) : readSlotFromFile(finalSlot);
+    }
+    const std::string& text = cached ? cached->text : content;
+    
+    if (!text.empty()) {
+        // Clean-up declared with TRANSFORM lines
+        size_t slotBytes = cached ? cached->slotBytes : content.size();
+        bool transformed = cached ? cached->transformed : transformSlotContent(finalSlot, chordTransform, content);
+        bool success = cached ? setClipboardUnits(cached->units, cached->text) : setClipboard(content);
+        if (success) {
+            noteLoadLatency(isPrimarySlot(finalSlot), cached != nullptr, start);
+            noteSlotLoaded(finalSlot, slotBytes);
+            char preview[PREVIEW_BUFFER_SIZE(40)];
+            buildPreview(text.data(), text.size(), 40, false, preview);
+            
+            addToHistory(transformed ? "OK LOAD <-- Slot [%s] (transformed) : \"%s\"" : "OK LOAD <-- Slot [%s] : \"%s\"",
+                         finalSlot.c_str(), preview);
+            refreshDisplay();
+        } else {
+            addToHistory("XX ERROR --> Clipboard busy, Slot [%s] not loaded", finalSlot.c_str());
+            refreshDisplay();
+        }
+    } else {
+        addToHistory("XX ERROR --> Slot [%s] is EMPTY", finalSlot.c_str());
+        refreshDisplay();
+    }
+}
+
+void performType(const std::string& finalSlot, std::chrono::steady_clock::time_point queued) {
+    std::string content = g_templateSlots.count(finalSlot) ? expandSlotTemplate(finalSlot) : readSlotFromFile(finalSlot);
+    if (content.empty()) {
+        addToHistory("XX ERROR --> Slot [%s] is EMPTY", finalSlot.c_str());
+        refreshDisplay();
+        return;
+    }
+    noteSlotLoaded(finalSlot, content.size());
+    transformSlotContent(finalSlot, false, content);
+    
+    // Latency: waiting in the action queue (real time) plus typing (typing clock)
+    double waitedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - queued).count();
+    TypingRun run;
+    bool complete = typeText(content, run);
+    double latencyMs = waitedMs + run.durationMs;
+    g_typingStats.lastLatencyMs = latencyMs;
+    g_typingStats.maxLatencyMs = std::max(g_typingStats.maxLatencyMs, latencyMs);
+    
+    if (complete) {
+        addToHistory("OK TYPE <-- Slot [%s] : %zu chars in %.0f ms", finalSlot.c_str(), run.typed, latencyMs);
+    } else {
+        addToHistory("XX TYPE --> Slot [%s] stopped after %zu of %zu chars", finalSlot.c_str(), run.typed, run.characters);
+    }
+    refreshDisplay();
+}
+
+void performClear(const std::string& finalSlot) {
+    // CLEAR MODE: Empty or delete slot
+    bool success = clearSpecificSlot(finalSlot);
+    
+    if (success) {
+        // Check if it's a primary slot
+        bool isPrimary = false;
+        try {
+            int num = std::stoi(finalSlot);
+            if (num >= 1 && num <= 10) {
+                isPrimary = true;
+            }
+        } catch (...) {
+            isPrimary = false;
+        }
+        
+        if (isPrimary) {
+            addToHistory("OK CLEAR --> Slot [%s] emptied", finalSlot.c_str());
+        } else {
+            addToHistory("OK DELETE --> Slot [%s] deleted", finalSlot.c_str());
+        }
+        refreshDisplay();
+    } else {
+        addToHistory("XX ERROR --> Slot [%s] not found", finalSlot.c_str());
+        refreshDisplay();
+    }
+}
+
+void performAliasSave(const std::string& name) {
+    std::string clipContent;
+    if (!getClipboard(clipContent)) {
+        addToHistory("XX ERROR --> Clipboard busy, Slot (%s) not saved", name.c_str());
+        refreshDisplay();
+        return;
+    }
+    
+    std::string slotNum;
+    if (saveAliasedSlot(name, clipContent, slotNum)) {
+        noteSlotSource(slotNum, clipboardSourceApp());
+        char preview[PREVIEW_BUFFER_SIZE(40)];
+        buildPreview(clipContent.data(), clipContent.size(), 40, false, preview);
+        addToHistory("OK SAVE --> Slot [%s] (%s) : \"%s\"", slotNum.c_str(), name.c_str(), preview);
+    }
+    showAliasCompletion("");
+    refreshDisplay();
+}
+
+void performAliasLoad(const std::string& prefix) {
+    // Exact name first, then a prefix matching a single name
+    std::string name = prefix;
+    std::string slotNum;
+    if (!resolveAlias(prefix, slotNum)) {
+        int matches = completeAlias(prefix, name, slotNum);
+        if (matches != 1) {
+            addToHistory(matches == 0 ? "XX ERROR --> No slot named (%s)" : "XX ERROR --> Several slots start with (%s)",
+                         prefix.c_str());
+            showAliasCompletion("");
+            refreshDisplay();
+            return;
+        }
+    }
+    showAliasCompletion("");
+    performLoad(slotNum);
+}
+
+void performUndo() {
+    std::string description;
+    if (undoLastAction(description)) {
+        addToHistory("OK UNDO --> %s reverted", description.c_str());
+    } else {
+        addToHistory("XX ERROR --> Nothing to undo");
+    }
+    refreshDisplay();
+}
+
+// Changes sent by other instances and tools (see sendSlotMutation)
+struct RemoteMutation {
+    unsigned long op;
+    std::string slot;
+    std::string content;
+};
+
+std::vector<RemoteMutation> g_remoteMutations;
+std::mutex g_remoteMutex;
+
+void performRemoteMutations() {
+    std::vector<RemoteMutation> mutations;
+    {
+        std::lock_guard<std::mutex> lock(g_remoteMutex);
+        mutations.swap(g_remoteMutations);
+    }
+    
+    for (const auto& mutation : mutations) {
+        if (mutation.op == SHARED_OP_SET) {
+            if (writeSlotToFile(mutation.slot, mutation.content)) {
+                addToHistory("OK SET --> Slot [%s] (external)", mutation.slot.c_str());
+            }
+        } else if (mutation.op == SHARED_OP_CLEAR) {
+            if (clearSpecificSlot(mutation.slot)) {
+                addToHistory("OK CLEAR --> Slot [%s] (external)", mutation.slot.c_str());
+            }
+        }
+    }
+    refreshDisplay();
+}
+
+void performRange(const RangeOp& op) {
+    const char* error = checkRangeOp(op);
+    size_t changed = 0;
+    if (error) {
+        addToHistory("XX ERROR --> %s", error);
+    } else if (applyRangeOp(op, changed)) {
+        // "MOVE Slots [11-500] to [12]" -> "OK MOVE --> Slots [11-500] to [12]"
+        std::string description = describeRange(op);
+        size_t space = description.find(' ');
+        addToHistory("OK %s --> %s (%zu slot(s) changed)", description.substr(0, space).c_str(),
+                     description.substr(space + 1).c_str(), changed);
+    } else {
+        addToHistory("XX ERROR --> Unable to update the slot file");
+    }
+    refreshDisplay();
+}
+
+void performSync() {
+    SyncReport report;
+    std::string error;
+    if (SYNC_DIR.empty()) {
+        addToHistory("XX ERROR --> No SYNC_DIR set in %s", SAVE_FILE.c_str());
+    } else if (runSync(SYNC_DIR, report, error)) {
+        addToHistory("OK SYNC --> %zu slot(s) received, %zu sent, %zu conflict(s)", report.received, report.sent, report.conflicts);
+    } else {
+        addToHistory("XX ERROR --> %s", error.c_str());
+    }
+    if (report.damaged > 0) {
+        addToHistory("XX DAMAGED --> %zu sync record(s) ignored", report.damaged);
+    }
+    refreshDisplay();
+}
+
+void performClearAll() {
+    clearNonPrimarySlots();
+    addToHistory("OK CLEAR --> All additional slots deleted");
+    refreshDisplay();
+}
+
+// ========================================
+// KEY TRACE
+// ========================================
+// Key events can be recorded to a compact binary trace (--record <file>)
+// and replayed headless (--replay <file>) to reproduce a hook glitch or
+// compare builds.
+//
+// File: "CBTR" | uint32 version | TraceRecord... (little-endian)
+
+const char TRACE_MAGIC[4] = {'C', 'B', 'T', 'R'};
+const uint32_t TRACE_VERSION = 1;
+const uint8_t TRACE_KEY_DOWN = 1;
+const uint8_t TRACE_KEY_UP = 2;
+
+struct TraceRecord {
+    uint32_t time;      // Event time in ms (KBDLLHOOKSTRUCT time)
+    uint8_t vkCode;
+    uint8_t flags;      // KBDLLHOOKSTRUCT flags (injected, extended...)
+    uint8_t kind;       // TRACE_KEY_DOWN or TRACE_KEY_UP
+    uint8_t reserved;
+};
+
+// The hook only fills a fixed buffer; the action worker writes it out
+const size_t TRACE_BUFFER_RECORDS = 4096;
+TraceRecord g_traceBuffer[TRACE_BUFFER_RECORDS];
+size_t g_traceCount = 0;
+unsigned long g_traceDropped = 0;
+std::mutex g_traceMutex;
+FILE* g_traceFile = nullptr;
+
+bool startTraceRecording(const std::string& path) {
+    g_traceFile = fopen(path.c_str(), "wb");
+    if (g_traceFile == nullptr) {
+        return false;
+    }
+    fwrite(TRACE_MAGIC, 1, sizeof(TRACE_MAGIC), g_traceFile);
+    fwrite(&TRACE_VERSION, sizeof(TRACE_VERSION), 1, g_traceFile);
+    return true;
+}
+
+bool appendTraceRecord(uint32_t time, int vkCode, uint32_t flags, bool isKeyDown, bool isKeyUp) {
+    // Returns true when the buffer is half full and should be flushed
+    if (g_traceFile == nullptr || (!isKeyDown && !isKeyUp)) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(g_traceMutex);
+    if (g_traceCount == TRACE_BUFFER_RECORDS) {
+        g_traceDropped++;
+        return true;
+    }
+    TraceRecord& record = g_traceBuffer[g_traceCount++];
+    record.time = time;
+    record.vkCode = (uint8_t)vkCode;
+    record.flags = (uint8_t)flags;
+    record.kind = isKeyDown ? TRACE_KEY_DOWN : TRACE_KEY_UP;
+    record.reserved = 0;
+    return g_traceCount == TRACE_BUFFER_RECORDS / 2;
+}
+
+void flushTrace() {
+    std::lock_guard<std::mutex> lock(g_traceMutex);
+    if (g_traceFile == nullptr) {
+        return;
+    }
+    fwrite(g_traceBuffer, sizeof(TraceRecord), g_traceCount, g_traceFile);
+    fflush(g_traceFile);
+    g_traceCount = 0;
+}
+
+void stopTraceRecording() {
+    flushTrace();
+    std::lock_guard<std::mutex> lock(g_traceMutex);
+    if (g_traceFile != nullptr) {
+        fclose(g_traceFile);
+        g_traceFile = nullptr;
+    }
+}
+
+bool loadTrace(const std::string& path, std::vector<TraceRecord>& records) {
+    std::ifstream file(path, std::ios::binary);
+    char magic[4];
+    uint32_t version = 0;
+    if (!file.read(magic, sizeof(magic)) || memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0 ||
+        !file.read(reinterpret_cast<char*>(&version), sizeof(version)) || version != TRACE_VERSION) {
+        return false;
+    }
+    TraceRecord record;
+    while (file.read(reinterpret_cast<char*>(&record), sizeof(record))) {
+        records.push_back(record);
+    }
+    return true;
+}
+
+// ========================================
+// ACTION WORKER
+// ========================================
+// The low-level hook must return quickly: clipboard and file work
+// is queued here and executed in order on a dedicated thread
+
+enum ActionType {
+    ACTION_SAVE,
+    ACTION_LOAD,
+    ACTION_LOAD_TRANSFORM,
+    ACTION_TYPE,
+    ACTION_CLEAR,
+    ACTION_CLEAR_ALL,
+    ACTION_UNDO,
+    ACTION_SAVE_TEMPLATE,
+    ACTION_SAVE_AUTO,
+    ACTION_RANGE,
+    ACTION_SYNC,
+    ACTION_SAVE_ALIAS,
+    ACTION_LOAD_ALIAS,
+    ACTION_COMPLETE_ALIAS,
+    ACTION_REMOTE,
+    ACTION_FLUSH_TRACE,
+    ACTION_REFRESH
+};
+
+// Phase names of the actions, in ActionType order
+const char* const ACTION_PHASE_NAMES[] = {
+    "SAVE", "LOAD", "LOAD TRANSFORM", "TYPE", "CLEAR", "CLEAR ALL", "UNDO", "SAVE TEMPLATE", "SAVE AUTO", "RANGE", "SYNC",
+    "SAVE ALIAS", "LOAD ALIAS", "COMPLETE ALIAS", "REMOTE", "FLUSH TRACE", "REFRESH"
+};
+static_assert(sizeof(ACTION_PHASE_NAMES) / sizeof(ACTION_PHASE_NAMES[0]) == ACTION_REFRESH + 1, "one phase name per action");
+
+struct PendingAction {
+    ActionType type;
+    SlotDigits slot;
+    RangeOp range;
+    std::chrono::steady_clock::time_point queued;
+};
+
+// Fixed-capacity ring so that queueing from the hook never allocates
+const size_t ACTION_QUEUE_SIZE = 64;
+PendingAction g_actionQueue[ACTION_QUEUE_SIZE];
+size_t g_actionQueueHead = 0;
+size_t g_actionQueueCount = 0;
+std::mutex g_actionMutex;
+std::condition_variable g_actionCondition;
+std::thread g_actionWorker;
+bool g_actionWorkerStop = false;
+
+void queueAction(ActionType type, const SlotDigits& slot = SlotDigits(), const RangeOp& range = RangeOp()) {
+    noteInputActivity();
+    {
+        std::lock_guard<std::mutex> lock(g_actionMutex);
+        if (g_actionQueueCount == ACTION_QUEUE_SIZE) {
+            addToHistory("XX ERROR --> Too many pending actions, Slot [%s] ignored", slot.c_str());
+            return;
+        }
+        PendingAction& action = g_actionQueue[(g_actionQueueHead + g_actionQueueCount) % ACTION_QUEUE_SIZE];
+        action.type = type;
+        action.slot = slot;
+        action.range = range;
+        action.queued = std::chrono::steady_clock::now();
+        g_actionQueueCount++;
+    }
+    g_actionCondition.notify_one();
+}
+
+void executeAction(const PendingAction& action) {
+    if (g_phaseTracing.load(std::memory_order_relaxed)) {
+        // Time spent in the queue, from the hook to the worker
+        recordPhase("queued", phaseClockNs(action.queued), phaseClockNs());
+    }
+    std::lock_guard<std::mutex> lock(g_actionRunMutex);
+    PhaseScope phase(ACTION_PHASE_NAMES[action.type]);
+    if (action.slot.overflowed) {
+        // A cut number or name could be another slot
+        if (action.type != ACTION_COMPLETE_ALIAS) {
+            addToHistory("XX ERROR --> Slot [%s...] longer than %zu characters, ignored", action.slot.c_str(),
+                         sizeof(action.slot.digits) - 1);
+            refreshDisplay();
+        }
+        return;
+    }
+    switch (action.type) {
+        case ACTION_SAVE:      performSave(action.slot.c_str()); break;
+        case ACTION_LOAD:      performLoad(action.slot.c_str()); break;
+        case ACTION_LOAD_TRANSFORM: performLoad(action.slot.c_str(), true); break;
+        case ACTION_TYPE:      performType(action.slot.c_str(), action.queued); break;
+        case ACTION_CLEAR:     performClear(action.slot.c_str()); break;
+        case ACTION_CLEAR_ALL: performClearAll(); break;
+        case ACTION_UNDO:      performUndo(); break;
+        case ACTION_SAVE_TEMPLATE: performTemplateSave(action.slot.c_str()); break;
+        case ACTION_SAVE_AUTO: performAutoSave(); break;
+        case ACTION_RANGE:     performRange(action.range); break;
+        case ACTION_SYNC:      performSync(); break;
+        case ACTION_SAVE_ALIAS: performAliasSave(action.slot.c_str()); break;
+        case ACTION_LOAD_ALIAS: performAliasLoad(action.slot.c_str()); break;
+        case ACTION_COMPLETE_ALIAS: showAliasCompletion(action.slot.c_str()); break;
+        case ACTION_REMOTE:    performRemoteMutations(); break;
+        case ACTION_FLUSH_TRACE: flushTrace(); break;
+        case ACTION_REFRESH:   refreshDisplay(); break;
+    }
+    flushSlotMetadata();
+}
+
+bool takeAction(PendingAction& action) {
+    // Caller holds g_actionMutex
+    if (g_actionQueueCount == 0) {
+        return false;
+    }
+    action = g_actionQueue[g_actionQueueHead];
+    g_actionQueueHead = (g_actionQueueHead + 1) % ACTION_QUEUE_SIZE;
+    g_actionQueueCount--;
+    return true;
+}
+
+void actionWorkerLoop() {
+    g_phaseThreadName = "action worker";
+    g_phaseReservedBuffer = PHASE_BUFFER_WORKER;
+    while (true) {
+        PendingAction action;
+        {
+            std::unique_lock<std::mutex> lock(g_actionMutex);
+            g_actionCondition.wait(lock, [] { return g_actionWorkerStop || g_actionQueueCount > 0; });
+            if (!takeAction(action)) {
+                return;
+            }
+        }
+        executeAction(action);
+    }
+}
+
+void drainActions() {
+    // Runs the queued actions on the calling thread (replay harness)
+    while (true) {
+        PendingAction action;
+        {
+            std::lock_guard<std::mutex> lock(g_actionMutex);
+            if (!takeAction(action)) {
+                return;
+            }
+        }
+        executeAction(action);
+    }
+}
+
+void startActionWorker() {
+    g_actionWorker = std::thread(actionWorkerLoop);
+}
+
+void stopActionWorker() {
+    // Pending actions are completed before the thread exits
+    {
+        std::lock_guard<std::mutex> lock(g_actionMutex);
+        g_actionWorkerStop = true;
+    }
+    g_actionCondition.notify_one();
+    if (g_actionWorker.joinable()) {
+        g_actionWorker.join();
+    }
+}
+
+void consoleCommandLoop() {
+    g_phaseThreadName = "console";
+    // Commands typed in the console run on the action worker too
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        std::istringstream words(line);
+        std::string first;
+        if (!(words >> first)) {
+            continue;
+        }
+        RangeOp op;
+        unsigned long days;
+        if (first == "sync") {
+            queueAction(ACTION_SYNC);
+        } else if (first == "recent" || first == "frequent" || first == "numbers") {
+            // Order of the additional slots in the console
+            g_slotView = first == "recent" ? VIEW_RECENT : (first == "frequent" ? VIEW_FREQUENT : VIEW_NUMBER);
+            queueAction(ACTION_REFRESH);
+        } else if (first == "unused" && words >> days) {
+            g_unusedDays = days;
+            g_slotView = VIEW_UNUSED;
+            queueAction(ACTION_REFRESH);
+        } else if (first == "find" && line.find_first_not_of(" \t", line.find(first) + first.size()) != std::string::npos) {
+            // Searched here, on the snapshot: neither waits for a running action
+            std::string needle = line.substr(line.find_first_not_of(" \t", line.find(first) + first.size()));
+            std::vector<std::string> matches;
+            size_t sealed = 0;
+            searchSlots(needle, matches, sealed);
+            std::string found = sealed ? ", " + std::to_string(sealed) + " sealed not searched" : "";
+            for (const auto& key : matches) {
+                found += " [" + key + "]";
+            }
+            // Long lists are cut at the history entry size
+            addToHistory("OK FIND --> \"%s\" in %zu slot(s)%s", needle.c_str(), matches.size(), found.c_str());
+            queueAction(ACTION_REFRESH);
+        } else if (parseRangeCommand(line, op)) {
+            queueAction(ACTION_RANGE, SlotDigits(), op);
+        } else {
+            addToHistory("XX ERROR --> Unknown command (move 11-500 12, copy 20-29 120, swap 3 7, delete 1000-9999, sync, "
+                         "recent, frequent, unused 90, numbers, find text)");
+            queueAction(ACTION_REFRESH);
+        }
+    }
+}
+
+// ========================================
+// CHORD HANDLING
+// ========================================
+// Platform independent: fed by the keyboard hook on Windows and by the
+// trace replayer. Returns true if the key must be swallowed.
+
+bool handleKeyEvent(int vkCode, bool isKeyDown, bool isKeyUp) {
+    noteInputActivity();
+    
+    // ESC to exit
+    if (isKeyDown && vkCode == VK_ESCAPE) {
+        requestExit();
+        return true;
+    }
+    
+    // ========== SPECIAL KEY HANDLING ==========
+    
+    if (vkCode == KEY_SAVE1 || vkCode == KEY_SAVE2 || vkCode == KEY_LOAD) {
+        if (isKeyDown) {
+            if (!keyPressed[vkCode]) {
+                keyPressed[vkCode] = true;
+                actionExecuted[vkCode] = false;
+            }
+            
+            // LOAD while a slot is being typed = stop typing
+            if (vkCode == KEY_LOAD && g_typingActive) {
+                g_typingCancel = true;
+                actionExecuted[KEY_LOAD] = true;
+            }
+            
+            // LOAD + SAVE1 or LOAD + SAVE2 = CLEAR ALL SLOTS (except primary)
+            if ((vkCode == KEY_SAVE1 || vkCode == KEY_SAVE2) && keyPressed[KEY_LOAD] && !isAccumulatingSlot) {
+                queueAction(ACTION_CLEAR_ALL);
+                actionExecuted[KEY_SAVE1] = true;
+                actionExecuted[KEY_SAVE2] = true;
+                actionExecuted[KEY_LOAD] = true;
+                return true;
+            }
+            
+            // SAVE1 + LOAD or SAVE2 + LOAD = TOGGLE CONSOLE
+            if (vkCode == KEY_LOAD && (keyPressed[KEY_SAVE1] || keyPressed[KEY_SAVE2]) && !isAccumulatingSlot) {
+                toggleConsole();
+                if (g_consoleVisible) {
+                    queueAction(ACTION_REFRESH);
+                }
+                actionExecuted[KEY_SAVE1] = true;
+                actionExecuted[KEY_SAVE2] = true;
+                actionExecuted[KEY_LOAD] = true;
+                return true;
+            }
+            
+            return true;
+        }
+        else if (isKeyUp) {
+            // Release SAVE1/SAVE2 or LOAD after a name = SAVE or LOAD a named slot
+            if (isAliasMode) {
+                if (!currentAlias.empty()) {
+                    queueAction(vkCode == KEY_LOAD ? ACTION_LOAD_ALIAS : ACTION_SAVE_ALIAS, currentAlias);
+                }
+                isAliasMode = false;
+                currentAlias.clear();
+                actionExecuted[KEY_SAVE1] = true;
+                actionExecuted[KEY_SAVE2] = true;
+                actionExecuted[KEY_LOAD] = true;
+            }
+            
+            // Release SAVE1 or SAVE2 = SAVE
+            if ((vkCode == KEY_SAVE1 || vkCode == KEY_SAVE2) && isAccumulatingSlot && !currentSlotNumber.empty() && !isClearMode) {
+                // Convert slot according to rules
+                SlotDigits finalSlot = currentSlotNumber.finalSlot();
+                
+                // Save (clipboard and file work runs on the action worker)
+                queueAction(isTemplateMode ? ACTION_SAVE_TEMPLATE : ACTION_SAVE, finalSlot);
+                
+                // Reset accumulation
+                isAccumulatingSlot = false;
+                currentSlotNumber.clear();
+                actionExecuted[KEY_SAVE1] = true;
+                actionExecuted[KEY_SAVE2] = true;
+            }
+            if (vkCode == KEY_SAVE1 || vkCode == KEY_SAVE2) {
+                isTemplateMode = false;
+            }
+            
+            // Release LOAD after LOAD + R = range operation
+            if (vkCode == KEY_LOAD && isRangeMode) {
+                queueAction(ACTION_RANGE, SlotDigits(), currentRange.rangeOp());
+                isRangeMode = false;
+                currentRange.clear();
+                actionExecuted[KEY_LOAD] = true;
+            }
+            
+            // Release LOAD = LOAD or CLEAR
+            if (vkCode == KEY_LOAD && isAccumulatingSlot && !currentSlotNumber.empty()) {
+                // Convert slot according to rules
+                SlotDigits finalSlot = currentSlotNumber.finalSlot();
+                
+                if (isClearMode) {
+                    // CLEAR MODE: Empty or delete slot
+                    queueAction(ACTION_CLEAR, finalSlot);
+                } else if (isTypeMode) {
+                    // TYPE MODE: Type the slot as keystrokes
+                    queueAction(ACTION_TYPE, finalSlot);
+                } else if (isTransformMode) {
+                    // TRANSFORM MODE: Load with the chord transforms
+                    queueAction(ACTION_LOAD_TRANSFORM, finalSlot);
+                } else {
+                    // NORMAL MODE: Load
+                    queueAction(ACTION_LOAD, finalSlot);
+                }
+                
+                // Reset accumulation and CLEAR mode
+                isAccumulatingSlot = false;
+                currentSlotNumber.clear();
+                isClearMode = false;
+                actionExecuted[KEY_LOAD] = true;
+            }
+            if (vkCode == KEY_LOAD) {
+                isTypeMode = false;
+                isTransformMode = false;
+            }
+            
+            keyPressed[vkCode] = false;
+            
+            // If no action was performed, simulate the character
+            if (!actionExecuted[vkCode]) {
+                sendKeyTap(vkCode);
+            }
+            
+            actionExecuted[vkCode] = false;
+            return true;
+        }
+    }
+    
+    // ========== N KEY AND NAME HANDLING (ALIAS MODE) ==========
+    
+    bool isSaveOrLoadHeld = keyPressed[KEY_SAVE1] || keyPressed[KEY_SAVE2] || keyPressed[KEY_LOAD];
+    bool isNameKey = (vkCode >= 0x41 && vkCode <= 0x5A) || (vkCode >= 0x30 && vkCode <= 0x39);
+    
+    if (isAliasMode && isNameKey && isSaveOrLoadHeld) {
+        // Letters and digits build the name; completion follows each key
+        if (isKeyDown) {
+            currentAlias.push(vkCode <= 0x39 ? (char)vkCode : (char)('a' + (vkCode - 0x41)));
+            queueAction(ACTION_COMPLETE_ALIAS, currentAlias);
+        }
+        return true;
+    }
+    
+    if (vkCode == KEY_ALIAS && isKeyDown && isSaveOrLoadHeld && !isAccumulatingSlot && !isClearMode) {
+        // SAVE + N or LOAD + N = Type a slot name
+        isAliasMode = true;
+        currentAlias.clear();
+        actionExecuted[KEY_SAVE1] = true;
+        actionExecuted[KEY_SAVE2] = true;
+        actionExecuted[KEY_LOAD] = true;
+        return true;
+    }
+    
+    // ========== T KEY HANDLING (TEMPLATE MODE) ==========
+    
+    if (vkCode == KEY_TEMPLATE && (keyPressed[KEY_SAVE1] || keyPressed[KEY_SAVE2])) {
+        if (isKeyDown && !isAccumulatingSlot && !isAliasMode) {
+            // SAVE + T = The slot typed next is saved as a template
+            isTemplateMode = true;
+            actionExecuted[KEY_SAVE1] = true;
+            actionExecuted[KEY_SAVE2] = true;
+        }
+        return true;
+    }
+    
+    // ========== A KEY HANDLING (AUTO SAVE) ==========
+    
+    if (vkCode == KEY_AUTO) {
+        if (isKeyDown && (keyPressed[KEY_SAVE1] || keyPressed[KEY_SAVE2]) && !isAccumulatingSlot && !isTemplateMode &&
+            !keyPressed[vkCode]) {
+            // SAVE + A = Save into the next free slot of the content's bank
+            keyPressed[KEY_AUTO] = true;
+            queueAction(ACTION_SAVE_AUTO);
+            actionExecuted[KEY_SAVE1] = true;
+            actionExecuted[KEY_SAVE2] = true;
+            return true;
+        }
+        else if (isKeyUp && keyPressed[KEY_AUTO]) {
+            keyPressed[KEY_AUTO] = false;
+            return true;
+        }
+    }
+    
+    // ========== R KEY HANDLING (RANGE MODE) ==========
+    
+    if (isRangeMode && keyPressed[KEY_LOAD]) {
+        // Operation letter, digits and R separators until LOAD is released
+        RangeKind kind = vkCode == KEY_RANGE_MOVE ? RANGE_MOVE :
+                         vkCode == KEY_RANGE_COPY ? RANGE_COPY :
+                         vkCode == KEY_RANGE_SWAP ? RANGE_SWAP :
+                         vkCode == KEY_RANGE_DELETE ? RANGE_DELETE : RANGE_NONE;
+        int digit = -1;
+        for (int i = 0; i < 10; i++) {
+            if (vkCode == slotKeys[i]) {
+                digit = (i + 1) % 10;
+            }
+        }
+        if (kind == RANGE_NONE && digit < 0 && vkCode != KEY_RANGE) {
+            return false;
+        }
+        if (isKeyDown) {
+            if (kind != RANGE_NONE) {
+                currentRange.kind = kind;
+            } else if (digit >= 0) {
+                currentRange.push((char)('0' + digit));
+            } else {
+                currentRange.separate();
+            }
+        }
+        return true;
+    }
+    
+    if (vkCode == KEY_RANGE && isKeyDown && keyPressed[KEY_LOAD] && !isAccumulatingSlot && !isClearMode && !isAliasMode) {
+        // LOAD + R = Type a range operation
+        isRangeMode = true;
+        currentRange.clear();
+        actionExecuted[KEY_LOAD] = true;
+        return true;
+    }
+    
+    // ========== C KEY HANDLING (CLEAR MODE) ==========
+    
+    if (vkCode == KEY_CLEAR) {
+        if (isKeyDown && keyPressed[KEY_LOAD] && !keyPressed[vkCode]) {
+            // LOAD + C = Activate CLEAR mode
+            keyPressed[KEY_CLEAR] = true;
+            isClearMode = true;
+            return true;
+        }
+        else if (isKeyUp) {
+            keyPressed[KEY_CLEAR] = false;
+            return true;
+        }
+    }
+    
+    // ========== K KEY HANDLING (TYPE MODE) ==========
+    
+    if (vkCode == KEY_TYPE) {
+        if (isKeyDown && keyPressed[KEY_LOAD] && !isAccumulatingSlot && !isClearMode && !isAliasMode && !keyPressed[vkCode]) {
+            // LOAD + K = Type the slot instead of loading it
+            keyPressed[KEY_TYPE] = true;
+            isTypeMode = true;
+            return true;
+        }
+        else if (isKeyUp && keyPressed[KEY_TYPE]) {
+            keyPressed[KEY_TYPE] = false;
+            return true;
+        }
+    }
+    
+    // ========== X KEY HANDLING (TRANSFORM MODE) ==========
+    
+    if (vkCode == KEY_TRANSFORM) {
+        if (isKeyDown && keyPressed[KEY_LOAD] && !isAccumulatingSlot && !isClearMode && !isAliasMode && !keyPressed[vkCode]) {
+            // LOAD + X = Load with the TRANSFORM|chord steps
+            keyPressed[KEY_TRANSFORM] = true;
+            isTransformMode = true;
+            return true;
+        }
+        else if (isKeyUp && keyPressed[KEY_TRANSFORM]) {
+            keyPressed[KEY_TRANSFORM] = false;
+            return true;
+        }
+    }
+    
+    // ========== Z KEY HANDLING (UNDO) ==========
+    
+    if (vkCode == KEY_UNDO) {
+        if (isKeyDown && keyPressed[KEY_LOAD] && !isAccumulatingSlot && !keyPressed[vkCode]) {
+            // LOAD + Z = Undo the last SAVE, CLEAR or CLEAR ALL
+            keyPressed[KEY_UNDO] = true;
+            queueAction(ACTION_UNDO);
+            actionExecuted[KEY_LOAD] = true;
+            return true;
+        }
+        else if (isKeyUp && keyPressed[KEY_UNDO]) {
+            keyPressed[KEY_UNDO] = false;
+            return true;
+        }
+    }
+    
+    // ========== SLOT KEY HANDLING ==========
+    
+    bool isSlotKey = false;
+    char slotDigit = 0;
+    for (int i = 0; i < 10; i++) {
+        if (vkCode == slotKeys[i]) {
+            isSlotKey = true;
+            if (i == 9) {
+                slotDigit = '0';
+            } else {
+                slotDigit = '1' + i;
+            }
+            break;
+        }
+    }
+    
+    if (isSlotKey && isKeyDown) {
+        // Check if SAVE1 or SAVE2 is held (ACCUMULATION for SAVE)
+        if (keyPressed[KEY_SAVE1] || keyPressed[KEY_SAVE2]) {
+            if (!isAccumulatingSlot) {
+                isAccumulatingSlot = true;
+                currentSlotNumber.clear();
+            }
+            currentSlotNumber.push(slotDigit);
+            
+            actionExecuted[KEY_SAVE1] = true;
+            actionExecuted[KEY_SAVE2] = true;
+            return true;
+        }
+        // Check if LOAD is held (ACCUMULATION for LOAD)
+        else if (keyPressed[KEY_LOAD]) {
+            if (!isAccumulatingSlot) {
+                isAccumulatingSlot = true;
+                currentSlotNumber.clear();
+            }
+            currentSlotNumber.push(slotDigit);
+            
+            actionExecuted[KEY_LOAD] = true;
+            return true;
+        }
+    }
+    
+    // Block slot keys if a special key is active
+    if (isSlotKey && (keyPressed[KEY_SAVE1] || keyPressed[KEY_SAVE2] || keyPressed[KEY_LOAD])) {
+        return true;
+    }
+    
+    // Block C, K, X and Z keys if LOAD is held, and A if SAVE is held
+    if ((vkCode == KEY_CLEAR || vkCode == KEY_TYPE || vkCode == KEY_TRANSFORM || vkCode == KEY_UNDO) && keyPressed[KEY_LOAD]) {
+        return true;
+    }
+    if (vkCode == KEY_AUTO && (keyPressed[KEY_SAVE1] || keyPressed[KEY_SAVE2])) {
+        return true;
+    }
+    
+    return false;
+}
+
+// ========================================
+// TRACE REPLAY
+// ========================================
+// Runs a recorded trace through handleKeyEvent with the headless backends
+// and a fresh slot file, executing actions inline so that the run is
+// deterministic. Reports throughput, per-event latency (chord logic plus
+// the actions it triggers), the heap allocations made by the hook path
+// itself and the resulting slots.
+
+void replayKeyEvent(const TraceRecord& record, bool runActions = true) {
+    // Only the hook path is counted; the actions it queued run after it
+    t_countAllocations = true;
+    {
+        PhaseScope phase("keyboard hook");
+        handleKeyEvent(record.vkCode, record.kind == TRACE_KEY_DOWN, record.kind == TRACE_KEY_UP);
+    }
+    t_countAllocations = false;
+    if (runActions) {
+        drainActions();
+    }
+}
+
+std::string commandLineOption(int argc, char** argv, const char* name) {
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], name) == 0) {
+            return argv[i + 1];
+        }
+    }
+    return "";
+}
+
+bool hasCommandLineFlag(int argc, char** argv, const char* name) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+double percentile(const std::vector<double>& sorted, double fraction) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t index = (size_t)(fraction * (sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+int runReplay(const std::string& tracePath) {
+    std::vector<TraceRecord> records;
+    if (!loadTrace(tracePath, records)) {
+        std::cerr << "ERROR: Unable to read trace " << tracePath << std::endl;
+        return 1;
+    }
+    
+    // Same keys as the real instance, but never its slots or names
+    loadKeyConfiguration();
+    clearAliases();
+    SAVE_FILE = tracePath + ".slots.dat";
+    HISTORY_FILE = tracePath + ".slots.history";
+    remove(SAVE_FILE.c_str());
+    remove(HISTORY_FILE.c_str());
+    remove((SAVE_FILE + ".meta").c_str());
+    initializeSaveFile();
+    applyStoreEncryption();
+    loadSlotMetadata();
+    
+    g_headless = true;
+    g_consoleVisible = false;
+    g_fakeClipboard = "replay clipboard";
+    g_phaseThreadName = "replay";
+    g_phaseReservedBuffer = PHASE_BUFFER_HOOK;
+    
+    std::vector<double> latencies;
+    latencies.reserve(records.size());
+    auto start = std::chrono::steady_clock::now();
+    
+    for (const auto& record : records) {
+        // Idle gaps of the trace run the maintenance the thread would run
+        g_fakeMaintenanceClockMs = record.time;
+        runIdleMaintenance();
+        
+        auto eventStart = std::chrono::steady_clock::now();
+        replayKeyEvent(record);
+        latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - eventStart).count());
+    }
+    
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::sort(latencies.begin(), latencies.end());
+    
+    std::cout << "=========================================================" << std::endl;
+    std::cout << "                  REPLAY REPORT                          " << std::endl;
+    std::cout << "=========================================================" << std::endl;
+    std::cout << "  Trace         : " << tracePath << std::endl;
+    std::cout << "  Events        : " << records.size() << std::endl;
+    std::cout << "  Duration      : " << seconds * 1000 << " ms" << std::endl;
+    std::cout << "  Events/sec    : " << (seconds > 0 ? records.size() / seconds : 0) << std::endl;
+    std::cout << "  Latency (us)  : p50 " << percentile(latencies, 0.50)
+              << " / p90 " << percentile(latencies, 0.90)
+              << " / p99 " << percentile(latencies, 0.99)
+              << " / max " << (latencies.empty() ? 0 : latencies.back()) << std::endl;
+    std::cout << "  Saves         : " << g_saveStats.written << " written / "
+              << g_saveStats.skipped << " unchanged skipped" << std::endl;
+    std::cout << "  Loads 1-10    : " << formatLoadLatency(g_primaryLoads, true) << std::endl;
+    std::cout << "  Loads 11+     : " << formatLoadLatency(g_additionalLoads, false) << std::endl;
+    std::cout << "  Replayed keys : " << g_fakeKeyTaps << std::endl;
+    if (ALLOCATIONS_COUNTED) {
+        std::cout << "  Hook allocs   : " << t_allocations << (t_allocations == 0 ? " (OK)" : " (XX the hook path must not allocate)")
+                  << std::endl;
+    } else {
+        std::cout << "  Hook allocs   : not counted (build with -DCLIPBOARD_COUNT_ALLOCATIONS)" << std::endl;
+    }
+    std::cout << "  Typed         : " << g_fakeTyped.size() << " units in " << g_fakeTypedBatches << " batches, "
+              << (unsigned long)g_fakeTypingClockMs << " ms at " << TYPE_RATE << " chars/s" << std::endl;
+    MaintenanceDebt debt = maintenanceDebt();
+    std::cout << "  Maintenance   : " << g_maintenanceStats.slices << " idle slices ("
+              << g_maintenanceStats.interrupted << " interrupted, " << g_maintenanceStats.compactions << " compactions, "
+              << g_maintenanceStats.verifiedBytes << " bytes verified), pending "
+              << debt.unverifiedBytes << " bytes / " << debt.staleRecords << " records" << std::endl;
+    std::cout << "  Exit requests : " << g_fakeExitRequests << std::endl;
+    std::cout << "  Clipboard     : \"" << buildPreview(g_fakeClipboard, 50) << "\"" << std::endl;
+    std::cout << std::endl;
+    displayHistory();
+    displayAllSlots();
+    return t_allocations == 0 ? 0 : 1;
+}
+
+// ========================================
+// COMMAND LINE SLOTS
+// ========================================
+// --get, --set and --clear let scripts read and write slots without the
+// console, tray icon or keyboard hook. A read comes from the shared region
+// of the running instance, or else from the one record in the file (no
+// full parse). A write follows the owner rule: it is sent to the running
+// instance, or applied here while holding the owner lock (the named mutex on
+// Windows, a lock file next to the save file elsewhere).
+
+const unsigned long SLOT_COMMAND_LOCK_TIMEOUT_MS = 2000;
+
+enum SlotCommandOp : uint8_t {
+    SLOT_COMMAND_GET,
+    SLOT_COMMAND_SET,       // Content read from stdin
+    SLOT_COMMAND_CLEAR
+};
+
+struct SlotCommand {
+    SlotCommandOp op;
+    std::string slot;       // As typed: number, key or slot name
+};
+
+struct OwnerLock {
+#ifdef _WIN32
+    HANDLE mutex = NULL;
+#else
+    int fd = -1;
+#endif
+};
+
+bool tryLockOwner(OwnerLock& lock) {
+    // False if an instance or another command owns the slots
+#ifdef _WIN32
+    lock.mutex = CreateMutexA(NULL, TRUE, OWNER_MUTEX_NAME);
+    if (lock.mutex != NULL && GetLastError() == ERROR_ALREADY_EXISTS) {
+        CloseHandle(lock.mutex);
+        lock.mutex = NULL;
+    }
+    return lock.mutex != NULL;
+#else
+    lock.fd = open((SAVE_FILE + ".lock").c_str(), O_RDWR | O_CREAT, 0600);
+    if (lock.fd >= 0 && flock(lock.fd, LOCK_EX | LOCK_NB) != 0) {
+        close(lock.fd);
+        lock.fd = -1;
+    }
+    return lock.fd >= 0;
+#endif
+}
+
+void unlockOwner(OwnerLock& lock) {
+#ifdef _WIN32
+    if (lock.mutex != NULL) {
+        ReleaseMutex(lock.mutex);
+        CloseHandle(lock.mutex);
+        lock.mutex = NULL;
+    }
+#else
+    if (lock.fd >= 0) {
+        close(lock.fd);
+        lock.fd = -1;
+    }
+#endif
+}
+
+bool isSlotCommand(const char* arg) {
+    return strcmp(arg, "--get") == 0 || strcmp(arg, "--set") == 0 || strcmp(arg, "--clear") == 0;
+}
+
+bool parseSlotCommands(int argc, char** argv, std::vector<SlotCommand>& commands, std::string& error) {
+    // Every argument must be part of a command; only one --set reads stdin
+    bool readsInput = false;
+    for (int i = 1; i < argc; i += 2) {
+        if (!isSlotCommand(argv[i]) || i + 1 >= argc) {
+            error = std::string("Expected --get, --set or --clear followed by a slot, got ") + argv[i];
+            return false;
+        }
+        SlotCommand command;
+        command.op = argv[i][2] == 'g' ? SLOT_COMMAND_GET : (argv[i][2] == 's' ? SLOT_COMMAND_SET : SLOT_COMMAND_CLEAR);
+        command.slot = argv[i + 1];
+        if (command.op == SLOT_COMMAND_SET) {
+            if (readsInput) {
+                error = "Only one --set can read stdin";
+                return false;
+            }
+            readsInput = true;
+        }
+        commands.push_back(command);
+    }
+    return true;
+}
+
+bool resolveCommandSlot(const std::string& name, std::string& slotNum) {
+    // A slot number, else a slot name, else a key written by hand in the file
+    unsigned long number;
+    if (parseSlotNumber(name.data(), name.size(), number) || !resolveAlias(name, slotNum)) {
+        slotNum = name;
+    }
+    return !slotNum.empty() && slotNum.find_first_of("|\r\n") == std::string::npos;
+}
+
+std::string readStandardInput() {
+    std::string content;
+    char buffer[65536];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), stdin)) > 0) {
+        content.append(buffer, count);
+    }
+    return content;
+}
+
+bool sendSlotCommand(const SlotCommand& command, const std::string& slotNum, const std::string& content,
+                     const SharedSlotRegion& region) {
+    // True once the running instance has applied and published the change
+#ifdef _WIN32
+    // The running instance publishes the region: without it nobody applies
+    if (region.base == nullptr) {
+        return false;
+    }
+    const SharedSlotHeader* header = reinterpret_cast<const SharedSlotHeader*>(region.base);
+    uint32_t before = header->sequence.load(std::memory_order_acquire);
+    if (!sendSlotMutation(command.op == SLOT_COMMAND_SET ? SHARED_OP_SET : SHARED_OP_CLEAR, slotNum, content)) {
+        return false;
+    }
+    // The owner applies it on its action worker: a later --get must see it
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(SLOT_COMMAND_LOCK_TIMEOUT_MS);
+    while (std::chrono::steady_clock::now() < deadline) {
+        uint32_t sequence = header->sequence.load(std::memory_order_acquire);
+        if (sequence != before && !(sequence & 1)) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+#else
+    (void)command; (void)slotNum; (void)content; (void)region;
+    return false;
+#endif
+}
+
+int applySlotCommands(const std::vector<SlotCommand>& commands, const std::string& input,
+                      const SharedSlotRegion& region, FILE* out) {
+    // Commands run in order, contents read go to out; 1 if any of them failed
+    OwnerLock lock;
+    bool locked = false;
+    int result = 0;
+    
+    for (const auto& command : commands) {
+        std::string slotNum;
+        if (!resolveCommandSlot(command.slot, slotNum)) {
+            std::cerr << "XX ERROR --> Invalid slot [" << command.slot << "]" << std::endl;
+            result = 1;
+            continue;
+        }
+        
+        if (command.op == SLOT_COMMAND_GET) {
+            // A damaged record is repaired only by the owner of the slots
+            std::string content;
+            bool damaged = false;
+            if (!readSharedSlot(region, slotNum, content)) {
+                content = readSlotFromFile(slotNum, locked ? nullptr : &damaged);
+            }
+            if (damaged) {
+                std::cerr << "XX ERROR --> Slot [" << slotNum << "] is DAMAGED, repaired when the slots are next loaded"
+                          << std::endl;
+                result = 1;
+            } else if (content.empty()) {
+                std::cerr << "XX ERROR --> Slot [" << slotNum << "] is EMPTY" << std::endl;
+                result = 1;
+            } else {
+                fwrite(content.data(), 1, content.size(), out);
+            }
+            continue;
+        }
+        
+        if (!locked) {
+            // The running instance applies the change, or this process owns
+            // the slots until it exits
+            bool sent = false;
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(SLOT_COMMAND_LOCK_TIMEOUT_MS);
+            while (!(sent = sendSlotCommand(command, slotNum, input, region)) && !(locked = tryLockOwner(lock)) &&
+                   std::chrono::steady_clock::now() < deadline) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+            if (sent) {
+                continue;
+            }
+            if (!locked) {
+                std::cerr << "XX ERROR --> Slots locked by another instance, Slot [" << slotNum << "] not changed" << std::endl;
+                result = 1;
+                continue;
+            }
+            if (g_encryptStore && !g_storeKeyReady) {
+                std::cerr << "XX ERROR --> Store key unavailable, slots not changed" << std::endl;
+                unlockOwner(lock);
+                return 1;
+            }
+            loadSlotMetadata();
+        }
+        
+        if (command.op == SLOT_COMMAND_SET && !writeSlotToFile(slotNum, input)) {
+            std::cerr << "XX ERROR --> Unable to update the slot file, Slot [" << slotNum << "] not saved" << std::endl;
+            result = 1;
+        } else if (command.op == SLOT_COMMAND_CLEAR && !clearSpecificSlot(slotNum)) {
+            std::cerr << "XX ERROR --> Slot [" << slotNum << "] not found" << std::endl;
+            result = 1;
+        }
+    }
+    
+    if (locked) {
+        flushSlotMetadata();
+        unlockOwner(lock);
+    }
+    fflush(out);
+    return result;
+}
+
+int runSlotCommands(int argc, char** argv) {
+    std::vector<SlotCommand> commands;
+    std::string error;
+    if (!parseSlotCommands(argc, argv, commands, error)) {
+        std::cerr << "XX ERROR --> " << error << std::endl;
+        std::cerr << "Usage: clipboard_manager --get <slot> | --set <slot> (content on stdin) | --clear <slot> ..." << std::endl;
+        return 1;
+    }
+#ifdef _WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    
+    // Settings, names and key only: slots are read one record at a time
+    initializeSaveFile();
+    if (g_encryptStore) {
+        loadStoreKey(false);
+    }
+    bool readsInput = std::any_of(commands.begin(), commands.end(), [](const SlotCommand& command) {
+        return command.op == SLOT_COMMAND_SET;
+    });
+    std::string input = readsInput ? readStandardInput() : "";
+    
+    SharedSlotRegion region;
+    openSharedSlots(region, false);
+    int result = applySlotCommands(commands, input, region, stdout);
+    closeSharedSlots(region);
+    return result;
+}
+
+// ========================================
+// SELF CHECKS
+// ========================================
+// --check runs edge cases of the text, template and store code with the
+// headless backends; --bench runs them first. Every failure is printed and
+// the exit code is 1 if any check failed.
+
+int g_checkFailures = 0;
+
+void expect(bool ok, const char* what) {
+    if (!ok) {
+        std::cout << "  FAIL: " << what << std::endl;
+        g_checkFailures++;
+    }
+}
+
+std::string utf8RoundTrip(const std::string& text) {
+    std::vector<char16_t> units(text.size() + 1);
+    size_t count = utf8ToUtf16(text.data(), text.size(), units.data());
+    std::string back;
+    utf16ToUtf8(units.data(), count, back);
+    return back;
+}
+
+std::string utf16ToUtf8String(const std::u16string& units) {
+    std::string out;
+    utf16ToUtf8(units.data(), units.size(), out);
+    return out;
+}
+
+void checkTextEncoding() {
+    // Long enough for the 16-byte ASCII runs, with 2, 3 and 4-byte characters
+    // on both sides of a block boundary
+    std::string mixed = "0123456789abcdef0123456789abcd\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80 tail 0123456789abcdef";
+    expect(utf8RoundTrip(mixed) == mixed, "UTF-8 -> UTF-16 -> UTF-8 keeps mixed text");
+    expect(utf8RoundTrip("") == "", "Empty text converts to empty text");
+    
+    std::vector<char16_t> units(8);
+    expect(utf8ToUtf16("\xF0\x9F\x98\x80", 4, units.data()) == 2 && units[0] == 0xD83D && units[1] == 0xDE00,
+           "U+1F600 becomes a surrogate pair");
+    
+    // Each invalid form becomes one U+FFFD per rejected byte
+    const std::string replacement = "\xEF\xBF\xBD";
+    expect(utf8RoundTrip("a\xC0\xAF") == "a" + replacement + replacement, "Overlong form is replaced");
+    expect(utf8RoundTrip("\xED\xA0\x80") == replacement + replacement + replacement, "Encoded surrogate is replaced");
+    expect(utf8RoundTrip("\xF4\x90\x80\x80").compare(0, 3, replacement) == 0, "Codepoint above U+10FFFF is replaced");
+    expect(utf8RoundTrip("ab\xE2\x82") == "ab" + replacement + replacement, "Truncated sequence at the end is replaced");
+    expect(utf16ToUtf8String(u"a\xD800") == "a" + replacement, "Lone high surrogate at the end is replaced");
+    expect(utf16ToUtf8String(u"\xDC00z") == replacement + "z", "Lone low surrogate is replaced");
+    
+    expect(utf8Validate(mixed.data(), mixed.size()), "Valid UTF-8 is accepted");
+    expect(!utf8Validate("abc\xC3", 4), "Truncated UTF-8 is rejected");
+    expect(!utf8Validate("\xC0\x80", 2), "Overlong NUL is rejected");
+}
+
+void checkPreviews() {
+    std::string accents;
+    for (int i = 0; i < 60; i++) {
+        accents += "\xC3\xA9";
+    }
+    std::string preview = buildPreview(accents, 40);
+    expect(preview.size() == 37 * 2 + 3 && preview.compare(74, 3, "...") == 0, "Long preview keeps 37 characters and ...");
+    expect(utf8Validate(preview.data(), preview.size()), "Truncation never splits a character");
+    expect(buildPreview(accents.substr(0, 80), 40) == accents.substr(0, 80), "Exactly 40 characters are not truncated");
+    expect(buildPreview("a\r\nb\tc", 40) == "a  b c", "Line breaks and tabs become spaces");
+    expect(buildPreview("a\\nb\\pc\\\\", 40, true) == "a b|c\\", "Escaped file form is decoded");
+    std::string invalid = buildPreview("ok\xFF\xC3", 40);
+    expect(utf8Validate(invalid.data(), invalid.size()), "Invalid bytes give a valid preview");
+}
+
+std::string expandOnce(const std::string& text, const std::string& clipboard) {
+    CompiledTemplate compiled = compileTemplate(std::make_shared<const std::string>(text));
+    return expandTemplate(compiled, clipboard);
+}
+
+void checkTemplates() {
+    expect(expandOnce("a{clip}b", "X") == "aXb", "{clip} is replaced by the clipboard");
+    expect(expandOnce("{clip}{clip}", "") == "", "Empty clipboard expands to nothing");
+    expect(expandOnce("{{clip}}", "X") == "{clip}", "{{ and }} escape a placeholder");
+    expect(expandOnce("{{ {clip} }}", "X") == "{ X }", "Escapes around a placeholder");
+    expect(expandOnce("a}b{c", "X") == "a}b{c", "Lone braces are kept");
+    expect(expandOnce("{unknown}{clip", "X") == "{unknown}{clip", "Unknown or unclosed placeholders are kept");
+    expect(expandOnce("}}}", "") == "}}", "}}} gives }}");
+    
+    CompiledTemplate counter = compileTemplate(std::make_shared<const std::string>("#{counter}"));
+    expect(expandTemplate(counter, "") == "#1" && expandTemplate(counter, "") == "#2", "{counter} counts the expansions");
+    
+    std::string stamp = expandOnce("{date} {time}", "");
+    expect(stamp.size() == 19 && stamp[4] == '-' && stamp[7] == '-' && stamp[13] == ':' && stamp[16] == ':',
+           "{date} and {time} give YYYY-MM-DD HH:MM:SS");
+    
+    std::string large(1 << 20, 'x');
+    large.replace(1000, 6, "{clip}");
+    std::string expanded = expandOnce(large, "CLIP");
+    expect(expanded.size() == large.size() - 2 && expanded.compare(1000, 4, "CLIP") == 0, "Large template expands in place");
+}
+
+struct ScratchStore {
+    // Points the store at a fresh file for the time of a check
+    std::string saveFile = SAVE_FILE;
+    std::string historyFile = HISTORY_FILE;
+    
+    explicit ScratchStore(const std::string& path) {
+        SAVE_FILE = path;
+        HISTORY_FILE = path + ".history";
+        removeFiles();
+        initializeSaveFile();
+    }
+    
+    ~ScratchStore() {
+        removeFiles();
+        SAVE_FILE = saveFile;
+        HISTORY_FILE = historyFile;
+    }
+    
+    void removeFiles() {
+        for (const char* suffix : {"", ".meta", ".history", ".quarantine", ".lock", ".sync", ".out", ".compact"}) {
+            remove((SAVE_FILE + suffix).c_str());
+        }
+    }
+};
+
+bool storeHasLine(const std::string& prefix) {
+    std::ifstream file(SAVE_FILE);
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.compare(0, prefix.size(), prefix) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool replaceInStore(const std::string& from, const std::string& to) {
+    // Edits the file behind the store's back, e.g. to damage a record
+    std::ifstream in(SAVE_FILE, std::ios::binary);
+    std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+    size_t at = text.find(from);
+    if (at == std::string::npos) {
+        return false;
+    }
+    text.replace(at, from.size(), to);
+    std::ofstream out(SAVE_FILE, std::ios::binary | std::ios::trunc);
+    out << text;
+    return out.good();
+}
+
+bool storeFileExists(const char* suffix) {
+    std::ifstream file(SAVE_FILE + suffix);
+    return file.is_open();
+}
+
+std::vector<uint8_t> fromHex(const char* hex) {
+    std::vector<uint8_t> bytes;
+    for (size_t i = 0; hex[i] && hex[i + 1]; i += 2) {
+        bytes.push_back((uint8_t)std::stoul(std::string(hex + i, 2), nullptr, 16));
+    }
+    return bytes;
+}
+
+void checkStoreEncryption() {
+    // AES-256-GCM test case 16 of the GCM specification (McGrew and Viega),
+    // through both implementations
+    std::vector<uint8_t> secret = fromHex("feffe9928665731c6d6a8f9467308308feffe9928665731c6d6a8f9467308308");
+    std::vector<uint8_t> nonce = fromHex("cafebabefacedbaddecaf888");
+    std::vector<uint8_t> plain = fromHex("d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a72"
+                                         "1c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b39");
+    std::vector<uint8_t> aad = fromHex("feedfacedeadbeeffeedfacedeadbeefabaddad2");
+    std::vector<uint8_t> cipher = fromHex("522dc1f099567d07f47f37a32a84427d643a8cdcbfe5c0c97598a2bd2555d1aa"
+                                          "8cb08e48590dbb3da7b08b1056828838c5f61e6393ba7a0abcc9f662");
+    std::vector<uint8_t> tag = fromHex("76fc6ece0f4e1768cddf8853bb2d551b");
+    
+    GcmKey keys[2];
+    gcmInit(keys[0], secret.data(), true);
+    gcmInit(keys[1], secret.data(), false);
+    for (const GcmKey& key : keys) {
+        std::vector<uint8_t> out(plain.size()), back(plain.size());
+        uint8_t outTag[GCM_TAG_SIZE], backTag[GCM_TAG_SIZE];
+        std::string additional(aad.begin(), aad.end());
+        gcmCrypt(key, nonce.data(), additional, plain.data(), plain.size(), out.data(), true, outTag);
+        gcmCrypt(key, nonce.data(), additional, out.data(), out.size(), back.data(), false, backTag);
+        expect(out == cipher && memcmp(outTag, tag.data(), GCM_TAG_SIZE) == 0 && back == plain &&
+               memcmp(backTag, tag.data(), GCM_TAG_SIZE) == 0,
+               key.hardware ? "AES-256-GCM known answer (AES-NI)" : "AES-256-GCM known answer (portable)");
+    }
+    
+    // Same records from both, for every length around the block sizes
+    bool same = true;
+    for (size_t length = 0; length < 200; length++) {
+        std::string content(length, '\0');
+        for (size_t i = 0; i < length; i++) {
+            content[i] = (char)(i * 31 + length);
+        }
+        same = same && sealRecord(keys[0], "12", content, nonce.data()) == sealRecord(keys[1], "12", content, nonce.data());
+    }
+    expect(same, "AES-NI and portable keys seal the same records");
+    
+    // Any changed byte, or another slot, fails to open
+    std::string stored = sealRecord(keys[0], "12", "secret content");
+    std::string content;
+    auto flipped = [&stored](size_t index) {
+        std::vector<uint8_t> record;
+        base64Decode(stored.data() + 2, stored.size() - 2, record);
+        record[index] ^= 0x01;
+        std::string changed = "\\e";
+        base64Encode(record.data(), record.size(), changed);
+        return changed;
+    };
+    size_t tagStart = GCM_NONCE_SIZE + strlen("secret content");
+    expect(openRecord(keys[1], "12", stored, content) && content == "secret content", "A sealed record opens");
+    expect(!openRecord(keys[0], "12", flipped(GCM_NONCE_SIZE + 3), content) &&
+           !openRecord(keys[0], "12", flipped(tagStart + 5), content) &&
+           !openRecord(keys[0], "12", flipped(0), content) && !openRecord(keys[0], "13", stored, content),
+           "A changed ciphertext, tag or nonce, or another slot, fails to open");
+}
+
+void checkRecordChecksums() {
+    const char* digits = "123456789";
+    expect(crc32c(digits, 9) == 0xE3069283 && crc32cSoftware(reinterpret_cast<const uint8_t*>(digits), 9) == 0xE3069283,
+           "CRC32C check value of \"123456789\"");
+    
+    // Every start alignment and tail length of the 8-byte loop
+    uint8_t buffer[300];
+    for (size_t i = 0; i < sizeof(buffer); i++) {
+        buffer[i] = (uint8_t)(i * 131 + 7);
+    }
+    bool same = true;
+    for (size_t offset = 0; offset < 8; offset++) {
+        for (size_t length = 0; length + offset <= sizeof(buffer); length++) {
+            same = same && crc32c(reinterpret_cast<const char*>(buffer + offset), length) == crc32cSoftware(buffer + offset, length);
+        }
+    }
+    expect(same, crc32cHasHardware() ? "SSE4.2 CRC32C matches the tables" : "CRC32C matches the tables (no SSE4.2)");
+    
+    ScratchStore store("check_checksums.dat");
+    writeSlotToFile("40", "first");
+    writeSlotToFile("41", "second");
+    writeSlotToFile("42", "third");
+    std::ofstream(SAVE_FILE, std::ios::app) << "SLOT43|by hand\n";
+    replaceInStore("SLOT41|second", "SLOT41|secont");
+    
+    StoreCheck check;
+    expect(verifyStoreFile(check) && check.damaged == 1 && check.unchecked == 1,
+           "The store check finds the damaged and the unchecked record");
+    std::vector<std::string> configLines;
+    SlotTable slots;
+    readStoreFile(configLines, slots);
+    std::ifstream quarantine(SAVE_FILE + ".quarantine");
+    std::string quarantined((std::istreambuf_iterator<char>(quarantine)), std::istreambuf_iterator<char>());
+    expect(quarantined.find("SLOT41|secont|") != std::string::npos && !storeHasLine("SLOT41|"),
+           "A damaged record is moved to the quarantine file");
+    expect(readSlotFromFile("40") == "first" && readSlotFromFile("42") == "third" && readSlotFromFile("43") == "by hand" &&
+           readSlotFromFile("41").empty(),
+           "Intact and unchecked records survive the salvage");
+    
+    g_undoStack.clear();
+}
+
+int storedDeltaDepth(const std::string& slotNum) {
+    // Records a LOAD of slotNum follows in the file, -1 for a broken chain
+    std::ifstream file(SAVE_FILE);
+    std::unordered_map<std::string, std::string> values;
+    std::string line;
+    while (std::getline(file, line)) {
+        size_t keyEnd, valueEnd;
+        if (!isConfigLine(line) && checkSlotRecord(line.data(), line.size(), keyEnd, valueEnd) != RECORD_DAMAGED) {
+            values[line.substr(4, keyEnd - 4)] = line.substr(keyEnd + 1, valueEnd - keyEnd - 1);
+        }
+    }
+    std::string key = slotNum;
+    for (int depth = 0; depth <= DELTA_MAX_DEPTH + 1; depth++) {
+        auto value = values.find(key);
+        if (value == values.end()) {
+            return -1;
+        }
+        size_t opsStart;
+        if (!isDeltaValue(value->second.data(), value->second.size())) {
+            return depth;
+        }
+        if (!parseDeltaBase(value->second.data(), value->second.size(), key, opsStart)) {
+            return -1;
+        }
+    }
+    return -1;
+}
+
+void checkDeltaStorage() {
+    ScratchStore store("check_deltas.dat");
+    bool deltaStore = g_deltaStore;
+    g_deltaStore = true;
     
+    // 4 files with 12 small edits of each, so chains could grow past the limit
     std::vector<std::string> configLines;
-    std::map<int, std::string> primarySlots;
-    std::string line;
-    
-    while (std::getline(fileIn, line)) {
-        // Save configuration lines
-        if (line.empty() || line[0] == '#' || line.substr(0, 4) == "KEY_" || line.substr(0, 10) == "SLOT_CHARS") {
-            configLines.push_back(line);
+    SlotTable slots;
+    readStoreFile(configLines, slots);
+    std::map<std::string, std::string> originals;
+    uint64_t seed = 0x2545F4914F6CDD1DULL;
+    auto nextRandom = [&seed]() {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        return seed;
+    };
+    for (int file = 0; file < 4; file++) {
+        std::string content;
+        for (int line = 0; line < 30; line++) {
+            content += "server.pool" + std::to_string(nextRandom() % 50) + ".timeout_ms = " + std::to_string(nextRandom() % 10000) + "|\n";
         }
-        else {
-            size_t pipePos = line.find('|');
-            if (pipePos != std::string::npos && line.substr(0, 4) == "SLOT") {
-                std::string key = line.substr(4, pipePos - 4);
-                std::string value = line.substr(pipePos + 1);
-                
-                try {
-                    int num = std::stoi(key);
-                    if (num >= 1 && num <= 10) {
-                        primarySlots[num] = value;
-                    }
-                } catch (...) {
-                    // Ignore non-numeric slots
-                }
-            }
+        for (int variant = 0; variant < 12; variant++) {
+            content.replace(nextRandom() % (content.size() - 8), 4, std::to_string(nextRandom() % 100000));
+            std::string key = std::to_string(11 + file * 12 + variant);
+            originals[key] = content;
+            slots.set(key, encodeStoredValue(key, content));
         }
     }
-    fileIn.close();
+    writeStoreFile(configLines, slots);
     
-    // Rewrite only config lines and primary slots (1-10)
-    std::ofstream fileOut(SAVE_FILE, std::ios::out | std::ios::trunc);
-    if (!fileOut.is_open()) {
-        return;
+    auto allReadBack = [&originals]() {
+        for (const auto& original : originals) {
+            if (readSlotFromFile(original.first) != original.second) {
+                return false;
+            }
+        }
+        return true;
+    };
+    bool depthsInRange = true;
+    int deepest = 0;
+    for (const auto& original : originals) {
+        int depth = storedDeltaDepth(original.first);
+        depthsInRange = depthsInRange && depth >= 0 && depth <= DELTA_MAX_DEPTH;
+        deepest = std::max(deepest, depth);
     }
+    expect(g_deltaStats.slots > 0 && allReadBack(), "Every slot stored as a delta reads back as written");
+    expect(depthsInRange && deepest > 1, "Delta chains stop at DELTA_MAX_DEPTH");
     
-    // Write configuration lines
-    for (const auto& configLine : configLines) {
-        fileOut << configLine << std::endl;
+    // Deleting a base, appended at the end of the file and then rewritten
+    std::vector<std::string> bases;
+    for (const auto& dependents : g_deltaDependents) {
+        bases.push_back(dependents.first);
     }
-    
-    // Write slots 1-10
-    for (int i = 1; i <= 10; i++) {
-        if (primarySlots.find(i) != primarySlots.end()) {
-            fileOut << "SLOT" << i << "|" << primarySlots[i] << std::endl;
-        } else {
-            fileOut << "SLOT" << i << "|" << std::endl;
-        }
+    std::sort(bases.begin(), bases.end());
+    expect(bases.size() >= 2, "Near-duplicate slots are stored against bases");
+    if (bases.size() >= 2) {
+        configLines.clear();
+        slots = SlotTable();
+        readStoreFile(configLines, slots);
+        slots.set(bases[0], "");
+        appendStoreRecords(slots, {bases[0]});
+        originals.erase(bases[0]);
+        expect(readSlotFromFile(bases[0]).empty() && allReadBack(), "The slots stored against an appended deletion stay readable");
+        
+        writeSlotToFile(bases[1], "");
+        originals.erase(bases[1]);
+        expect(readSlotFromFile(bases[1]).empty() && allReadBack(), "The slots stored against a deleted base stay readable");
     }
     
-    fileOut.close();
+    g_deltaStore = deltaStore;
+    g_deltaSketches.clear();
+    g_deltaEncodings.clear();
+    g_deltaDependents.clear();
+    g_undoStack.clear();
+    g_slotVersions.clear();
 }
 
-bool clearSpecificSlot(const std::string& slotNum) {
-    // Read entire file
-    std::ifstream fileIn(SAVE_FILE);
-    if (!fileIn.is_open()) {
-        return false;
+void checkContentClassification() {
+    std::string samples[] = {
+        "https://example.com/a?b=c", "C:\\Users\\me\\notes.txt", "-1 234,56", "{\"name\": \"value\", \"n\": [1, 2]}",
+        "int main() {\n    return f(x) + 1;\n}\n", "Dear all,\nthe meeting moves to Friday.\n"
+    };
+    bool correct = true;
+    for (int category = CATEGORY_URL; category < CATEGORY_COUNT; category++) {
+        correct = correct && classifyContent(samples[category - 1]) == category;
     }
+    expect(correct, "One sample of each category is classified as such");
+    expect(classifyContent("") == CATEGORY_NONE && classifyContent(" \r\n\t") == CATEGORY_NONE, "Empty and blank content has no category");
+    expect(classifyContent("  {\"a\": 1}\r\n") == CATEGORY_JSON && classifyContent("{\"a\": 1} and") == CATEGORY_TEXT &&
+           classifyContent("{\"a\": 1") == CATEGORY_TEXT,
+           "JSON needs its closing bracket at the very end, blanks aside");
+    expect(classifyContent(std::string(CLASSIFY_NUMBER_MAX, '7')) == CATEGORY_NUMBER &&
+           classifyContent(std::string(CLASSIFY_NUMBER_MAX + 1, '7')) == CATEGORY_TEXT,
+           "Digit runs longer than CLASSIFY_NUMBER_MAX are text");
     
-    std::vector<std::string> configLines;
-    std::map<std::string, std::string> slots;
-    std::string line;
+    // Paths must fit in the prefix; code is only looked for in the prefix
+    std::string path = "C:\\" + std::string(CLASSIFY_PREFIX_BYTES - 3, 'a');
+    std::string code;
+    while (code.size() < CLASSIFY_PREFIX_BYTES) {
+        code += "x = f(y);\n";
+    }
+    std::string prose;
+    while (prose.size() < CLASSIFY_PREFIX_BYTES) {
+        prose += "plain words\n";
+    }
+    expect(classifyContent(path) == CATEGORY_PATH && classifyContent(path + "a") == CATEGORY_TEXT,
+           "A path ending at the prefix boundary is a path, one byte more is text");
+    expect(classifyContent(code + prose) == CATEGORY_CODE && classifyContent(prose + code) == CATEGORY_TEXT,
+           "Only the first CLASSIFY_PREFIX_BYTES are counted");
     
-    while (std::getline(fileIn, line)) {
-        // Save configuration lines
-        if (line.empty() || line[0] == '#' || line.substr(0, 4) == "KEY_" || line.substr(0, 10) == "SLOT_CHARS") {
-            configLines.push_back(line);
+    // Every byte value, at every alignment and tail length, and runs long
+    // enough to wrap the 8-bit lane counters
+    unsigned char bytes[1024];
+    for (size_t i = 0; i < sizeof(bytes); i++) {
+        bytes[i] = (unsigned char)(i * 7 + (i >> 8));
+    }
+    auto sameCounts = [](const unsigned char* data, size_t length) {
+        ByteClassCounts fast, portable;
+        countByteClasses(data, length, fast);
+        countByteClassesPortable(data, length, portable);
+        return fast.digit == portable.digit && fast.blank == portable.blank && fast.newline == portable.newline &&
+               fast.code == portable.code && fast.numeric == portable.numeric && fast.slash == portable.slash &&
+               fast.quote == portable.quote;
+    };
+    bool same = true;
+    for (size_t offset = 0; offset < 16; offset++) {
+        for (size_t length = 0; offset + length <= 300; length++) {
+            same = same && sameCounts(bytes + offset, length);
         }
-        else {
-            size_t pipePos = line.find('|');
-            if (pipePos != std::string::npos && line.substr(0, 4) == "SLOT") {
-                std::string key = line.substr(4, pipePos - 4);
-                std::string value = line.substr(pipePos + 1);
-                slots[key] = value;
+    }
+    std::string run(255 * 16 * 3 + 5, '(');
+    same = same && sameCounts(reinterpret_cast<const unsigned char*>(run.data()), run.size());
+    expect(same, "SSE2 byte class counts match the portable ones");
+}
+
+bool runRangeCommand(const std::string& command, size_t& changed) {
+    RangeOp op;
+    changed = 0;
+    return parseRangeCommand(command, op) && checkRangeOp(op) == nullptr && applyRangeOp(op, changed);
+}
+
+void checkSlotRanges() {
+    ScratchStore store("check_ranges.dat");
+    std::vector<std::string> configLines;
+    SlotTable slots;
+    readStoreFile(configLines, slots);
+    for (int number = 11; number <= 30; number++) {
+        slots.set(std::to_string(number), "v" + std::to_string(number));
+    }
+    for (const char* key : {"499", "500", "600"}) {
+        slots.set(key, std::string("v") + key);
+    }
+    slots.set("3", "three");
+    slots.set("4", "four");
+    slots.set("7", "seven");
+    slots.sortKeys();
+    writeStoreFile(configLines, slots);
+    auto holds = [](int first, int last, int shift) {
+        // Slots first..last hold the contents first-shift..last-shift
+        for (int number = first; number <= last; number++) {
+            if (readSlotFromFile(std::to_string(number)) != "v" + std::to_string(number - shift)) {
+                return false;
             }
         }
-    }
-    fileIn.close();
+        return true;
+    };
+    std::string description;
+    size_t changed;
     
-    // Check if slot exists
-    if (slots.find(slotNum) == slots.end()) {
-        return false;
-    }
+    // Each slot is read before the one before it overwrites it
+    expect(runRangeCommand("move 11-500 12", changed) && readSlotFromFile("11").empty() && holds(12, 31, 1) &&
+           readSlotFromFile("500") == "v499" && readSlotFromFile("501") == "v500" && readSlotFromFile("600") == "v600",
+           "move 11-500 12 shifts the whole block by one");
+    expect(undoLastAction(description) && holds(11, 30, 0) && readSlotFromFile("31").empty() &&
+           readSlotFromFile("500") == "v500" && readSlotFromFile("501").empty(),
+           "Undo of a range move restores every slot");
     
-    // Determine if it's a primary slot (1-10) or not
-    bool isPrimarySlot = false;
-    try {
-        int num = std::stoi(slotNum);
-        if (num >= 1 && num <= 10) {
-            isPrimarySlot = true;
+    expect(runRangeCommand("swap 3 7", changed) && readSlotFromFile("3") == "seven" && readSlotFromFile("7") == "three" &&
+           runRangeCommand("swap 4 8", changed) && readSlotFromFile("4").empty() && readSlotFromFile("8") == "four",
+           "swap exchanges two slots, an empty one included");
+    RangeOp overlap;
+    expect(parseRangeCommand("swap 1-5 3", overlap) && checkRangeOp(overlap) != nullptr, "Overlapping swaps are refused");
+    
+    expect(runRangeCommand("copy 11-13 20", changed) && changed == 3 && holds(11, 19, 0) &&
+           readSlotFromFile("20") == "v11" && readSlotFromFile("22") == "v13" && holds(23, 30, 0),
+           "copy replaces the occupied target slots only");
+    expect(runRangeCommand("delete 25-40", changed) && changed == 6 && readSlotFromFile("25").empty() &&
+           readSlotFromFile("30").empty() && readSlotFromFile("24") == "v24",
+           "delete skips the missing slots of the range");
+    expect(undoLastAction(description) && holds(23, 30, 0) && undoLastAction(description) && holds(11, 30, 0),
+           "Undo of a range delete and copy restores the slots");
+    
+    g_undoStack.clear();
+    g_slotVersions.clear();
+}
+
+std::string transformInSpans(const std::string& text, const std::string& content, size_t span) {
+    // The chain run over content handed to it span bytes at a time
+    TransformChain chain;
+    std::string error, result;
+    if (!parseTransformChain(text, chain, error)) {
+        return "(" + error + ")";
+    }
+    std::vector<const TransformStep*> steps;
+    for (const auto& step : chain) steps.push_back(&step);
+    auto stages = buildTransformPipeline(steps, result);
+    for (size_t pos = 0; pos < content.size(); pos += span) {
+        stages.front()->write(content.data() + pos, std::min(span, content.size() - pos));
+    }
+    stages.front()->finish();
+    return result;
+}
+
+bool transformsTo(const std::string& text, const std::string& content, const std::string& expected) {
+    // Same result whatever the spans are cut at
+    for (size_t span = 1; span <= content.size() + 1; span++) {
+        if (transformInSpans(text, content, span) != expected) {
+            return false;
         }
-    } catch (...) {
-        isPrimarySlot = false;
     }
+    return true;
+}
+
+void checkTransforms() {
+    expect(transformsTo("crlf", "a\r\nb\rc\r\n\r\r\n\r", "a\nb\rc\n\r\n\r"), "crlf with a CR cut from its LF by a span end");
+    expect(transformsTo("rstrip", "a  \nb \t c \t\r\n  \nd  ", "a\nb \t c\r\n\nd"), "rstrip with spaces cut by a span end");
+    expect(transformsTo("trim", " \r\n a  b \n c \n\t ", "a  b \n c") && transformsTo("trim", " \t\r\n \n", ""),
+           "trim, of an all-whitespace slot too");
     
-    if (isPrimarySlot) {
-        // Primary slot: empty content but keep slot
-        slots[slotNum] = "";
-    } else {
-        // Non-primary slot: delete completely
-        slots.erase(slotNum);
+    TransformChain chain;
+    std::string error;
+    expect(parseTransformChain("s/cat|dog/pet/|upper", chain, error) && chain.size() == 2 &&
+           transformsTo("s/cat|dog/pet/|upper", "a cat\r\nand a dog\n", "A PET\r\nAND A PET\n") &&
+           transformsTo("s/(a)|(b)/[$1$2]/i", "xAbx", "x[A][b]x"),
+           "A regex with | is one step");
+    
+    // Latin-1 letters change case, other UTF-8 sequences and the
+    // multiplication and division signs stay as they are
+    expect(transformsTo("upper", "\xC3\xA9t\xC3\xA9 \xC3\xA7" "a \xC3\xB7\xC3\xBF\xC3\x9F \xD0\xB6\xE2\x82\xAC",
+                        "\xC3\x89T\xC3\x89 \xC3\x87" "A \xC3\xB7\xC3\xBF\xC3\x9F \xD0\xB6\xE2\x82\xAC") &&
+           transformsTo("lower", "\xC3\x89T\xC3\x89 \xC3\x97 \xD0\x96 \xC3\xA9",
+                        "\xC3\xA9t\xC3\xA9 \xC3\x97 \xD0\x96 \xC3\xA9"),
+           "upper and lower on UTF-8 text");
+    
+    // A chain gives what its steps give one after the other
+    const char* steps[] = {"crlf", "rstrip", "s/ +/ /", "trim", "upper", "s/(\\w+)=(\\w+)/$2=$1/", "lower"};
+    std::string content = "  \r\n  key=Value  \r\nnext\t  line \xC3\xA9\xC3\x89 \r\r\n\t\n";
+    std::string text, stepByStep = content;
+    for (const char* step : steps) {
+        text += (text.empty() ? "" : "|") + std::string(step);
+        stepByStep = transformInSpans(step, stepByStep, stepByStep.size() + 1);
     }
+    expect(transformsTo(text, content, stepByStep), "A chain gives the same result as its steps one at a time");
+}
+
+void checkUndo() {
+    ScratchStore store("check_undo.dat");
+    std::string description;
+    writeSlotToFile("20", "one");
+    writeSlotToFile("20", "two");
+    expect(undoLastAction(description) && readSlotFromFile("20") == "one", "Undo restores the replaced content");
+    expect(storeHasLine("KEY_SAVE1="), "Undo keeps the configuration lines");
+    expect(undoLastAction(description) && readSlotFromFile("20").empty(), "Undo of a new slot removes it");
     
-    // Write entire file
-    std::ofstream fileOut(SAVE_FILE, std::ios::out | std::ios::trunc);
-    if (!fileOut.is_open()) {
-        return false;
+    for (int i = 0; i < 12; i++) {
+        writeSlotToFile("21", "version " + std::to_string(i));
+    }
+    expect(slotVersionCount("21") == SLOT_HISTORY_DEPTH, "Versions stop at SLOT_HISTORY_DEPTH");
+    g_undoStack.clear();
+    g_slotVersions.clear();
+}
+
+int runCheckCommand(SlotCommandOp op, const std::string& slot, const std::string& input, std::string& output,
+                    std::string& errors) {
+    // One command as the CLI runs it, with no running instance; its
+    // messages are kept out of the check output
+    SharedSlotRegion region;
+    std::string outPath = SAVE_FILE + ".out";
+    FILE* out = fopen(outPath.c_str(), "w+b");
+    if (out == nullptr) {
+        return -1;
     }
+    std::stringstream messages;
+    std::streambuf* console = std::cerr.rdbuf(messages.rdbuf());
+    int result = applySlotCommands({{op, slot}}, input, region, out);
+    std::cerr.rdbuf(console);
     
-    // Write configuration lines
-    for (const auto& configLine : configLines) {
-        fileOut << configLine << std::endl;
+    output.clear();
+    rewind(out);
+    char buffer[4096];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), out)) > 0) {
+        output.append(buffer, count);
     }
+    fclose(out);
+    remove(outPath.c_str());
+    errors = messages.str();
+    return result;
+}
+
+void checkAliases() {
+    ScratchStore store("check_aliases.dat");
+    clearAliases();
+    insertAlias("sql", "234");
+    insertAlias("SQLite", "235");
+    insertAlias("notes", "31");
+    std::string name, slotNum;
+    expect(completeAlias("x", name, slotNum) == 0 && completeAlias("sq", name, slotNum) == 2 && completeAlias("", name, slotNum) == 3,
+           "Completion counts the names under a prefix");
+    expect(completeAlias("n", name, slotNum) == 1 && name == "notes" && slotNum == "31" &&
+           completeAlias("sqli", name, slotNum) == 1 && name == "sqlite" && slotNum == "235",
+           "Completion of a single name gives the name and its slot");
     
-    // First write slots 1-10 in order
-    for (int i = 1; i <= 10; i++) {
-        std::string key = std::to_string(i);
-        if (slots.find(key) != slots.end()) {
-            fileOut << "SLOT" << key << "|" << slots[key] << std::endl;
-        } else {
-            fileOut << "SLOT" << key << "|" << std::endl;
-        }
+    // An exact name wins over the longer names it starts
+    bool headless = g_headless;
+    bool consoleVisible = g_consoleVisible;
+    g_headless = true;
+    g_consoleVisible = false;
+    writeSlotToFile("234", "select 1");
+    writeSlotToFile("235", "pragma");
+    std::string clipboard;
+    setClipboard("before");
+    performAliasLoad("sq");
+    bool ambiguous = getClipboard(clipboard) && clipboard == "before";
+    performAliasLoad("sql");
+    bool exact = getClipboard(clipboard) && clipboard == "select 1";
+    performAliasLoad("sqli");
+    expect(ambiguous && exact && getClipboard(clipboard) && clipboard == "pragma",
+           "LOAD by name takes the exact name, else the only name with that prefix");
+    g_headless = headless;
+    g_consoleVisible = consoleVisible;
+    g_fakeClipboard.clear();
+    
+    insertAlias("query", "234");
+    expect(!resolveAlias("sql", slotNum) && resolveAlias("query", slotNum) && slotNum == "234" && aliasOfSlot("234") == "query" &&
+           completeAlias("sq", name, slotNum) == 1 && name == "sqlite",
+           "A new name for a slot renames it");
+    insertAlias("notes", "235");
+    expect(resolveAlias("notes", slotNum) && slotNum == "235" && aliasOfSlot("31").empty() && aliasOfSlot("235") == "notes" &&
+           !resolveAlias("sqlite", slotNum) && completeAlias("", name, slotNum) == 2,
+           "A name given to another slot leaves its old slot");
+    removeAlias("query");
+    expect(!resolveAlias("query", slotNum) && aliasOfSlot("234").empty() && completeAlias("q", name, slotNum) == 0 &&
+           completeAlias("", name, slotNum) == 1 && name == "notes",
+           "A removed name no longer resolves or completes");
+    
+    // Names may be made of digits: a number is always the slot itself
+    insertAlias("12", "300");
+    insertAlias("x1", "301");
+    expect(resolveCommandSlot("12", slotNum) && slotNum == "12" && resolveCommandSlot("X1", slotNum) && slotNum == "301" &&
+           resolveCommandSlot("draft", slotNum) && slotNum == "draft" && !resolveCommandSlot("a|b", slotNum) &&
+           !resolveCommandSlot("", slotNum),
+           "Command slots: numbers first, then names, then keys written by hand");
+    
+    clearAliases();
+    g_undoStack.clear();
+    g_slotVersions.clear();
+}
+
+void checkSlotCommands() {
+    ScratchStore store("check_commands.dat");
+    std::string output, errors;
+    const std::string content = "a|b\nsecond line\r\nlast|";
+    expect(runCheckCommand(SLOT_COMMAND_SET, "30", content, output, errors) == 0 &&
+           runCheckCommand(SLOT_COMMAND_GET, "30", "", output, errors) == 0 && output == content,
+           "--set then --get returns the content, pipes and newlines included");
+    
+    insertAlias("notes", "31");
+    expect(runCheckCommand(SLOT_COMMAND_SET, "Notes", "by name", output, errors) == 0 && readSlotFromFile("31") == "by name" &&
+           runCheckCommand(SLOT_COMMAND_GET, "notes", "", output, errors) == 0 && output == "by name",
+           "--set and --get resolve slot names");
+    
+    expect(runCheckCommand(SLOT_COMMAND_CLEAR, "30", "", output, errors) == 0 &&
+           runCheckCommand(SLOT_COMMAND_GET, "30", "", output, errors) == 1 && output.empty() &&
+           errors.find("is EMPTY") != std::string::npos,
+           "--get of a cleared slot reports EMPTY and fails");
+    
+    runCheckCommand(SLOT_COMMAND_SET, "32", "intact", output, errors);
+    expect(replaceInStore("SLOT32|intact", "SLOT32|intacT") &&
+           runCheckCommand(SLOT_COMMAND_GET, "32", "", output, errors) == 1 && errors.find("DAMAGED") != std::string::npos &&
+           storeHasLine("SLOT32|intacT") && !storeFileExists(".quarantine"),
+           "--get reports a damaged record and leaves the repair to the owner");
+    
+    OwnerLock first, second;
+    expect(tryLockOwner(first) && !tryLockOwner(second), "A second owner lock fails while one is held");
+    unlockOwner(second);
+    unlockOwner(first);
+    expect(tryLockOwner(second), "The owner lock is free once released");
+    unlockOwner(second);
+    
+    clearAliases();
+    g_undoStack.clear();
+    g_slotVersions.clear();
+}
+
+void checkMaintenance() {
+    // The scheduler on the headless clock, over a store whose records were
+    // all written twice (as appends leave them)
+    ScratchStore store("check_maintenance.dat");
+    bool headless = g_headless;
+    unsigned long idleMs = IDLE_MAINTENANCE_MS;
+    g_headless = true;
+    IDLE_MAINTENANCE_MS = 30000;
+    
+    std::vector<std::string> configLines;
+    SlotTable slots;
+    std::vector<std::string> keys;
+    readStoreFile(configLines, slots);
+    for (int i = 0; i < 1000; i++) {
+        std::string key = std::to_string(100 + i);
+        slots.set(key, std::to_string(i) + std::string(4000, 'm'));
+        keys.push_back(key);
     }
+    slots.sortKeys();
+    writeStoreFile(configLines, slots);
+    appendStoreRecords(slots, keys);
     
-    // Then write all other slots (sorted numerically if possible)
-    std::vector<std::pair<std::string, std::string>> otherSlots;
-    for (const auto& slot : slots) {
-        try {
-            int num = std::stoi(slot.first);
-            if (num < 1 || num > 10) {
-                otherSlots.push_back(slot);
-            }
-        } catch (...) {
-            otherSlots.push_back(slot);
-        }
+    g_fakeMaintenanceClockMs = 1000;
+    noteInputActivity();
+    g_fakeMaintenanceClockMs += IDLE_MAINTENANCE_MS - 1;
+    expect(runIdleMaintenance() == 0, "No maintenance before IDLE_MAINTENANCE_MS without input");
+    
+    // A key pressed during the run stops it before the next slice
+    g_fakeMaintenanceClockMs += 1;
+    unsigned long slices = g_maintenanceStats.slices;
+    unsigned long interrupted = g_maintenanceStats.interrupted;
+    std::thread run(runIdleMaintenance);
+    while (g_maintenanceStats.slices == slices) {
+        std::this_thread::yield();
     }
+    noteInputActivity();
+    run.join();
+    MaintenanceDebt debt = maintenanceDebt();
+    expect(g_maintenanceStats.interrupted == interrupted + 1 && (debt.staleRecords > 0 || debt.unverifiedBytes > 0),
+           "Input stops the maintenance run and counts it as interrupted");
     
-    // Sort other slots
-    std::sort(otherSlots.begin(), otherSlots.end(), [](const auto& a, const auto& b) {
-        try {
-            int numA = std::stoi(a.first);
-            int numB = std::stoi(b.first);
-            return numA < numB;
-        } catch (...) {
-            return a.first < b.first;
-        }
-    });
+    g_fakeMaintenanceClockMs += IDLE_MAINTENANCE_MS;
+    runIdleMaintenance();
+    debt = maintenanceDebt();
+    expect(debt.staleRecords == 0 && debt.unverifiedBytes == 0 && debt.historyRecords == 0,
+           "Maintenance pays the whole debt once idle");
+    expect(readSlotFromFile("100") == "0" + std::string(4000, 'm') && readSlotFromFile("1099") == "999" + std::string(4000, 'm') &&
+           !storeFileExists(".compact"), "Compaction keeps the slots");
     
-    for (const auto& slot : otherSlots) {
-        fileOut << "SLOT" << slot.first << "|" << slot.second << std::endl;
+    g_headless = headless;
+    IDLE_MAINTENANCE_MS = idleMs;
+    g_fakeMaintenanceClockMs = 0;
+    noteInputActivity();
+}
+
+void checkParallelSerialization() {
+    // More than PARALLEL_SERIALIZE_THRESHOLD in several batches of chunks:
+    // the pool writes the same bytes as one chunk formatted on this thread
+    std::vector<std::string> keys, values;
+    std::vector<StoreLine> lines;
+    lines.push_back({nullptr, 0, "KEY_SAVE1=0xBA", 14});
+    size_t total = 0;
+    for (size_t i = 0; total < 3 * PARALLEL_SERIALIZE_THRESHOLD; i++) {
+        keys.push_back(std::to_string(11 + i));
+        values.push_back(std::string(100 + (i * 7919) % 2000, (char)('a' + i % 26)) + "\\n|" + std::to_string(i));
+        total += keys.back().size() + values.back().size();
+    }
+    for (size_t i = 0; i < keys.size(); i++) {
+        lines.push_back({keys[i].data(), keys[i].size(), values[i].data(), values[i].size()});
+    }
+    StoreChunk all = {0, lines.size(), 0};
+    for (const auto& line : lines) {
+        all.bytes += line.size();
     }
+    std::string single;
+    formatStoreLines(lines, all, single);
     
-    fileOut.close();
-    return true;
+    std::string path = "check_parallel.dat";
+    std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    bool written = writeStoreLines(out, lines);
+    out.close();
+    std::ifstream in(path, std::ios::binary);
+    std::string parallel((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+    remove(path.c_str());
+    expect(written && all.bytes > 2 * SERIALIZE_CHUNK_BYTES * (workerPool().threadCount() + 1) && parallel == single,
+           "Parallel serialization writes the bytes of the single-threaded path");
 }
 
-void displayAllSlots() {
-    std::ifstream file(SAVE_FILE);
-    if (!file.is_open()) {
-        std::cout << "ERROR: Unable to open file" << std::endl;
-        return;
+void checkStoreStamp() {
+    // A same-size edit by hand, well within the second of the last write
+    ScratchStore store("check_stamp.dat");
+    writeSlotToFile("20", "aaaa");
+    std::string record = "SLOT20|aaaa";
+    char checksum[RECORD_CHECKSUM_SIZE];
+    formatChecksum(checksum, crc32c(record.data(), record.size()));
+    std::string written = record + std::string(checksum, RECORD_CHECKSUM_SIZE);
+    std::string edited = "SLOT20|" + std::string(written.size() - 7, 'b');
+    StoreStamp before = currentStoreStamp();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    
+    std::vector<std::string> configLines;
+    SlotTable slots;
+    expect(replaceInStore(written, edited) && currentStoreStamp().size == before.size && !(currentStoreStamp() == before) &&
+           !copyPublishedStore(configLines, slots), "A same-size edit within the second changes the store stamp");
+    expect(readSlotFromFile("20") == edited.substr(7), "The edited slot is read from the file");
+    g_undoStack.clear();
+    g_slotVersions.clear();
+}
+
+std::string cachedPrimaryText(const std::string& slotNum) {
+    // What a LOAD of slot 1-10 would publish without reading the file
+    const PrimarySlotCache* cached = primaryCacheEntry(slotNum);
+    return cached ? cached->text : "(not cached)";
+}
+
+void checkPrimaryCache() {
+    ScratchStore store("check_primary.dat");
+    std::string description;
+    size_t changed;
+    writeSlotToFile("2", "one");
+    expect(cachedPrimaryText("2") == "one" && writeSlotToFile("2", "two") && cachedPrimaryText("2") == "two",
+           "A cached LOAD after a SAVE returns the new content");
+    expect(clearSpecificSlot("2") && cachedPrimaryText("2").empty(), "A cached LOAD after a CLEAR returns nothing");
+    expect(undoLastAction(description) && cachedPrimaryText("2") == "two", "A cached LOAD after an undo returns the restored content");
+    
+    writeSlotToFile("15", "from 15");
+    expect(cachedPrimaryText("3").empty() && runRangeCommand("move 15 3", changed) && cachedPrimaryText("3") == "from 15",
+           "A cached LOAD after a range move into slots 1-10 returns the moved content");
+    
+    // Slots 1-10 are never deltas, but they are the bases of other slots
+    bool deltaStore = g_deltaStore;
+    g_deltaStore = true;
+    std::string base;
+    for (int line = 0; line < 20; line++) {
+        base += "setting" + std::to_string(line) + " = " + std::to_string(line * 37) + "\n";
     }
+    std::string edited = base;
+    edited.replace(40, 2, "99");
+    writeSlotToFile("4", base);
+    writeSlotToFile("16", edited);
+    expect(g_deltaStats.slots == 1 && cachedPrimaryText("4") == base, "A cached LOAD of a delta base returns its content");
+    writeSlotToFile("4", base + "tail\n");
+    expect(cachedPrimaryText("4") == base + "tail\n" && readSlotFromFile("16") == edited,
+           "A cached LOAD after a DELTA_STORE rewrite of a base returns the new content");
+    g_deltaStore = deltaStore;
     
-    std::cout << "=========================================================" << std::endl;
-    std::cout << "                  ACTIVE SLOTS                           " << std::endl;
-    std::cout << "=========================================================" << std::endl;
+    g_undoStack.clear();
+    g_slotVersions.clear();
+}
+
+void checkSyncThenGet() {
+    // Two stores merging through a directory of their own: the record a sync
+    // appends supersedes the older one of the same slot
+    const std::string dir = "check_sync";
+#ifdef _WIN32
+    CreateDirectoryA(dir.c_str(), NULL);
+#else
+    mkdir(dir.c_str(), 0700);
+#endif
+    ScratchStore first("check_sync_a.dat");
+    ScratchStore second("check_sync_b.dat");
+    auto use = [](const std::string& path) {
+        SAVE_FILE = path;
+        HISTORY_FILE = path + ".history";
+    };
+    SyncReport report;
+    std::string error;
     
-    std::map<std::string, std::string> allSlots;
-    std::string line;
+    use("check_sync_a.dat");
+    writeSlotToFile("50", "old from A");
+    writeSlotToFile("6", "old from A");
+    bool synced = runSync(dir, report, error);
+    use("check_sync_b.dat");
+    synced = synced && runSync(dir, report, error);
+    writeSlotToFile("50", "new from B");
+    writeSlotToFile("6", "new from B");
+    synced = synced && runSync(dir, report, error);
+    use("check_sync_a.dat");
+    bool cachedBefore = cachedPrimaryText("6") == "old from A";
+    synced = synced && runSync(dir, report, error);
+    expect(synced, "Sync between two stores succeeds");
+    expect(readSlotFromFile("50") == "new from B", "Get after a sync returns the synced content");
+    expect(cachedBefore && cachedPrimaryText("6") == "new from B", "A cached LOAD after a sync returns the synced content");
     
-    while (std::getline(file, line)) {
-        // Ignore configuration lines and comments
-        if (line.empty() || line[0] == '#' || line.substr(0, 4) == "KEY_" || line.substr(0, 10) == "SLOT_CHARS") {
-            continue;
-        }
-        
-        size_t pipePos = line.find('|');
-        if (pipePos != std::string::npos && line.substr(0, 4) == "SLOT") {
-            std::string key = line.substr(4, pipePos - 4);
-            std::string value = line.substr(pipePos + 1);
-            if (!value.empty()) {
-                allSlots[key] = unescapeString(value);
-            }
-        }
+    use("check_sync_b.dat");
+    std::vector<std::string> names;
+    listDeltaFiles(dir, names);
+    for (const std::string& name : names) {
+        remove((dir + "/" + name).c_str());
     }
-    file.close();
+#ifdef _WIN32
+    RemoveDirectoryA(dir.c_str());
+#else
+    rmdir(dir.c_str());
+#endif
+    g_undoStack.clear();
+    g_slotVersions.clear();
+}
+
+void checkHookAllocations() {
+    // Chords built in memory and fed to handleKeyEvent as the hook would,
+    // with the headless clipboard and keyboard
+    ScratchStore store("check_hook.dat");
+    bool headless = g_headless;
+    bool consoleVisible = g_consoleVisible;
+    g_headless = true;
+    g_consoleVisible = false;
+    g_fakeClipboard = "check clipboard";
     
-    // Display primary slots (1-10)
-    for (int i = 1; i <= 10; i++) {
-        std::string key = std::to_string(i);
-        std::cout << "  Slot " << i << " [key " << (i == 10 ? "0/" : std::to_string(i) + "/") << SLOT_CHARS[i-1] << "] : ";
-        
-        if (allSlots.find(key) != allSlots.end()) {
-            std::string content = allSlots[key];
-            std::string display = content;
-            for (size_t j = 0; j < display.length(); j++) {
-                if (display[j] == '\n' || display[j] == '\r' || display[j] == '\t') {
-                    display[j] = ' ';
-                }
-            }
-            
-            if (display.length() > 50) {
-                std::cout << "\"" << display.substr(0, 47) << "...\"" << std::endl;
-            } else {
-                std::cout << "\"" << display << "\"" << std::endl;
-            }
-        } else {
-            std::cout << "[EMPTY]" << std::endl;
+    std::vector<TraceRecord> records;
+    auto chord = [&records](int held, std::initializer_list<int> keys) {
+        records.push_back({0, (uint8_t)held, 0, TRACE_KEY_DOWN, 0});
+        for (int key : keys) {
+            records.push_back({0, (uint8_t)key, 0, TRACE_KEY_DOWN, 0});
+            records.push_back({0, (uint8_t)key, 0, TRACE_KEY_UP, 0});
         }
+        records.push_back({0, (uint8_t)held, 0, TRACE_KEY_UP, 0});
+    };
+    chord(KEY_SAVE1, {slotKeys[0]});                                    // SAVE 1
+    chord(KEY_LOAD, {slotKeys[0]});                                     // LOAD 1
+    chord(KEY_SAVE1, {slotKeys[1], slotKeys[4]});                       // SAVE 25
+    chord(KEY_SAVE1, {KEY_ALIAS, 'M', 'E', 'M', 'O'});                  // SAVE + N memo
+    chord(KEY_LOAD, {KEY_ALIAS, 'M', 'E'});                             // LOAD + N me (completed)
+    chord(KEY_LOAD, {KEY_RANGE, KEY_RANGE_COPY, slotKeys[1], slotKeys[4], KEY_RANGE, slotKeys[2], slotKeys[9]});
+    chord(KEY_LOAD, {KEY_TYPE, slotKeys[0]});                           // LOAD + K 1
+    chord(KEY_LOAD, {KEY_TRANSFORM, slotKeys[0]});                      // LOAD + X 1
+    chord(KEY_LOAD, {KEY_CLEAR, slotKeys[1], slotKeys[4]});             // LOAD + C 25
+    chord(KEY_LOAD, {KEY_UNDO});                                        // LOAD + Z
+    
+    t_allocations = 0;
+    for (const auto& record : records) {
+        replayKeyEvent(record);
     }
+    std::string memoSlot;
+    expect(readSlotFromFile("1") == "check clipboard" && readSlotFromFile("30") == "check clipboard" &&
+           readSlotFromFile("25") == "check clipboard" && resolveAlias("memo", memoSlot),
+           "Chords fed to handleKeyEvent reach the slots");
     
-    // Display other slots
-    std::vector<std::pair<std::string, std::string>> otherSlots;
-    for (const auto& slot : allSlots) {
-        try {
-            int num = std::stoi(slot.first);
-            if (num < 1 || num > 10) {
-                otherSlots.push_back(slot);
-            }
-        } catch (...) {
-            otherSlots.push_back(slot);
-        }
+    // The queue is not drained: actions past ACTION_QUEUE_SIZE are refused
+    records.clear();
+    for (size_t i = 0; i < ACTION_QUEUE_SIZE + 6; i++) {
+        chord(KEY_SAVE1, {slotKeys[2]});
+    }
+    for (const auto& record : records) {
+        replayKeyEvent(record, false);
     }
+    bool refused = g_actionQueueCount == ACTION_QUEUE_SIZE &&
+                   strstr(actionHistory[(historyNext + HISTORY_SIZE - 1) % HISTORY_SIZE], "Too many pending actions") != nullptr;
+    drainActions();
+    expect(refused, "Actions past a full queue are refused with a message");
+    expect(t_allocations == 0, "The hook path does not allocate (SAVE, LOAD, names, R, C, K, X, Z, full queue)");
     
-    if (!otherSlots.empty()) {
-        std::cout << "\n--- ADDITIONAL SLOTS ---" << std::endl;
-        
-        std::sort(otherSlots.begin(), otherSlots.end(), [](const auto& a, const auto& b) {
-            try {
-                int numA = std::stoi(a.first);
-                int numB = std::stoi(b.first);
-                return numA < numB;
-            } catch (...) {
-                return a.first < b.first;
-            }
-        });
-        
-        for (const auto& slot : otherSlots) {
-            std::cout << "  Slot [" << slot.first << "] : ";
-            
-            std::string display = slot.second;
-            for (size_t j = 0; j < display.length(); j++) {
-                if (display[j] == '\n' || display[j] == '\r' || display[j] == '\t') {
-                    display[j] = ' ';
-                }
-            }
-            
-            if (display.length() > 50) {
-                std::cout << "\"" << display.substr(0, 47) << "...\"" << std::endl;
-            } else {
-                std::cout << "\"" << display << "\"" << std::endl;
+    g_headless = headless;
+    g_consoleVisible = consoleVisible;
+    g_fakeClipboard.clear();
+    g_fakeTyped.clear();
+    clearAliases();
+    g_undoStack.clear();
+    g_slotVersions.clear();
+}
+
+void checkPhaseBuffers() {
+    // First traced event of a hook and a worker thread, on fresh threads; the
+    // trace is not written
+    startPhaseTracing(g_phaseTracePath);
+    unsigned long allocations[PHASE_RESERVED_BUFFERS] = {};
+    for (int i = 0; i < PHASE_RESERVED_BUFFERS; i++) {
+        std::thread([i, &allocations]() {
+            g_phaseReservedBuffer = i;
+            t_countAllocations = true;
+            {
+                PhaseScope phase("check");
             }
-        }
+            t_countAllocations = false;
+            allocations[i] = t_allocations;
+        }).join();
     }
-    
-    std::cout << "=========================================================" << std::endl;
+    g_phaseTracing = false;
+    for (int i = 0; i < PHASE_RESERVED_BUFFERS; i++) {
+        g_phaseBuffers[i].load()->count = 0;
+    }
+    expect(allocations[PHASE_BUFFER_HOOK] == 0 && allocations[PHASE_BUFFER_WORKER] == 0,
+           "First traced event of the hook and worker does not allocate");
 }
 
-void refreshDisplay() {
-    if (!g_consoleVisible) return;
+void checkSharedRegion() {
+    // Owner and reader mappings of a region of their own, in this process
+#ifdef _WIN32
+    const char* name = "Local\\ClipboardManagerSlotsCheck";
+#else
+    const char* name = "/ClipboardManagerSlotsCheck";
+#endif
+    SharedSlotRegion owner, reader;
+    if (!openSharedSlots(owner, true, name) || !openSharedSlots(reader, false, name)) {
+        expect(false, "Shared region can be created and opened");
+        closeSharedSlots(reader);
+        closeSharedSlots(owner);
+        return;
+    }
     
-    system("cls");
+    SlotTable slots;
+    slots.set("1", "first");
+    slots.set("15", escapeString("two\nlines|pipe"));
+    slots.set("200", "");
+    slots.sortKeys();
+    publishSharedSlots(owner, slots);
     
-    // Display last 4 action history
-    displayHistory();
+    const SharedSlotHeader* header = reinterpret_cast<const SharedSlotHeader*>(reader.base);
+    const SharedSlotEntry* entries = reinterpret_cast<const SharedSlotEntry*>(reader.base + sizeof(SharedSlotHeader));
+    expect(header->magic == SHARED_REGION_MAGIC && header->version == SHARED_REGION_VERSION && header->slotCount == 3,
+           "Shared header holds the magic, version and slot count");
+    expect(header->sequence.load() % 2 == 0, "Sequence is even after a publish");
+    bool layout = true;
+    for (uint32_t i = 0; i < header->slotCount; i++) {
+        layout = layout && entries[i].keyOffset >= sizeof(SharedSlotHeader) + 3 * sizeof(SharedSlotEntry) &&
+                 entries[i].valueOffset + entries[i].valueLength <= reader.size;
+    }
+    expect(layout, "Entries point after the table and inside the region");
     
-    // Display all slots
-    displayAllSlots();
+    std::string content;
+    expect(readSharedSlot(reader, "15", content) && content == "two\nlines|pipe", "Reader gets the decoded slot");
+    expect(readSharedSlot(reader, "200", content) && content.empty(), "Reader gets an empty slot");
+    expect(!readSharedSlot(reader, "16", content), "Reader reports a missing slot");
+    
+    // Every read must see one whole publish: all values equal, never mixed
+    SlotTable tables[2];
+    for (int t = 0; t < 2; t++) {
+        for (int i = 11; i < 75; i++) {
+            tables[t].set(std::to_string(i), std::string(4096, t == 0 ? 'a' : 'b'));
+        }
+        tables[t].sortKeys();
+    }
+    publishSharedSlots(owner, tables[0]);
+    std::atomic<bool> stop(false);
+    std::thread publisher([&owner, &tables, &stop]() {
+        for (int i = 0; !stop.load(); i++) {
+            publishSharedSlots(owner, tables[i & 1]);
+        }
+    });
+    // Long enough for the scheduler to stop the publisher mid-write, even on one core
+    bool consistent = true;
+    size_t reads = 0;
+    auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(200);
+    while (consistent && std::chrono::steady_clock::now() < until) {
+        // A read that gives up (the publisher kept the sequence odd) falls
+        // back to the file, which is allowed
+        std::string last;
+        if (visitSharedSlot(reader, "11", [&last](const char* data, size_t length) {
+                last.assign(data, length);
+            })) {
+            consistent = last.size() == 4096 && std::count(last.begin(), last.end(), last[0]) == 4096;
+            reads++;
+        }
+    }
+    stop = true;
+    publisher.join();
+    expect(consistent && reads > 0, "Seqlock readers never see a torn value");
+    
+    // An owner that died mid-publish leaves the sequence odd
+    SharedSlotHeader* ownerHeader = reinterpret_cast<SharedSlotHeader*>(owner.base);
+    ownerHeader->sequence.fetch_add(1);
+    auto start = std::chrono::steady_clock::now();
+    bool stuck = !readSharedSlot(reader, "11", content);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    expect(stuck && seconds < 1, "A stuck publish makes readers fall back to the file");
+    
+    closeSharedSlots(reader);
+    closeSharedSlots(owner);
+}
+
+int runSelfChecks() {
+    g_checkFailures = 0;
+    std::cout << "  Self checks" << std::endl;
+    if (!ALLOCATIONS_COUNTED) {
+        std::cout << "  (allocations not counted: build with -DCLIPBOARD_COUNT_ALLOCATIONS)" << std::endl;
+    }
+    checkTextEncoding();
+    checkPreviews();
+    checkTemplates();
+    checkStoreEncryption();
+    checkRecordChecksums();
+    checkDeltaStorage();
+    checkContentClassification();
+    checkSlotRanges();
+    checkTransforms();
+    checkAliases();
+    checkUndo();
+    checkPrimaryCache();
+    checkSyncThenGet();
+    checkStoreStamp();
+    checkParallelSerialization();
+    checkMaintenance();
+    checkSlotCommands();
+    checkHookAllocations();
+    checkPhaseBuffers();
+    checkSharedRegion();
+    std::cout << "  " << (g_checkFailures == 0 ? "All checks passed" : "Some checks FAILED") << std::endl;
+    std::cout << std::endl;
+    return g_checkFailures == 0 ? 0 : 1;
 }
 
 // ========================================
-// CLIPBOARD MANAGEMENT
+// BENCHMARK
 // ========================================
+// --bench measures the cost of the store record encodings: escaped text
+// against sealed records, with AES-NI/PCLMULQDQ when the CPU has them and
+// with the portable code. Nothing is read from or written to disk.
 
-std::string getClipboard() {
-    if (!OpenClipboard(nullptr)) {
-        return "";
+double encodingThroughput(size_t size, const std::function<size_t(const std::string&)>& roundTrip) {
+    // MB/s of content through encode + decode
+    std::string content;
+    content.reserve(size);
+    const char sample[] = "user=admin|token=3f9a\\x Lorem ipsum dolor sit amet\r\n";
+    while (content.size() < size) {
+        content.append(sample, std::min(sizeof(sample) - 1, size - content.size()));
     }
     
-    HANDLE hData = GetClipboardData(CF_UNICODETEXT);
-    if (hData == nullptr) {
-        CloseClipboard();
-        return "";
+    size_t iterations = std::max<size_t>(8, (64u << 20) / size);
+    size_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+        sink += roundTrip(content);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (sink != iterations * size) {
+        std::cerr << "ERROR: Round trip mismatch at " << size << " bytes" << std::endl;
+    }
+    return seconds > 0 ? (double)size * iterations / seconds / (1 << 20) : 0;
+}
+
+size_t residentBytes() {
+    // Physical memory currently used by the process
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return counters.WorkingSetSize;
+    }
+    return 0;
+#else
+    std::ifstream statm("/proc/self/statm");
+    size_t total = 0, resident = 0;
+    if (!(statm >> total >> resident)) {
+        return 0;
     }
+    return resident * (size_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+int runBenchmark() {
+    uint8_t secret[32];
+    if (!randomBytes(secret, sizeof(secret))) {
+        std::fill(secret, secret + sizeof(secret), 0x5A);
+    }
+    GcmKey hardwareKey, portableKey;
+    gcmInit(hardwareKey, secret, true);
+    gcmInit(portableKey, secret, false);
     
-    wchar_t* pszText = static_cast<wchar_t*>(GlobalLock(hData));
-    if (pszText == nullptr) {
-        CloseClipboard();
-        return "";
+    auto plain = [](const std::string& content) {
+        return unescapeString(escapeString(content)).size();
+    };
+    auto sealed = [](const GcmKey& key) {
+        return [&key](const std::string& content) {
+            std::string opened;
+            return openRecord(key, "1", sealRecord(key, "1", content), opened) ? opened.size() : 0;
+        };
+    };
+    
+    std::cout << "=========================================================" << std::endl;
+    std::cout << "                  BENCHMARK REPORT                       " << std::endl;
+    std::cout << "=========================================================" << std::endl;
+    int result = runSelfChecks();
+    
+    std::cout << "  Store records, encode + decode (MB/s)" << std::endl;
+    std::cout << "  AES-NI/PCLMULQDQ : " << (hardwareKey.hardware ? "available" : "not available") << std::endl;
+    std::cout << std::endl;
+    std::cout << "      Size |  Plain | AES-GCM HW | AES-GCM portable | Overhead" << std::endl;
+    
+    for (size_t size : {64u, 1024u, 16384u, 262144u}) {
+        double plainRate = encodingThroughput(size, plain);
+        double hardwareRate = hardwareKey.hardware ? encodingThroughput(size, sealed(hardwareKey)) : 0;
+        double portableRate = encodingThroughput(size, sealed(portableKey));
+        double bestRate = hardwareKey.hardware ? hardwareRate : portableRate;
+        
+        char row[160];
+        snprintf(row, sizeof(row), "  %8zu | %6.0f | %10.0f | %16.0f | %7.2fx",
+                 size, plainRate, hardwareRate, portableRate, bestRate > 0 ? plainRate / bestRate : 0);
+        std::cout << row << std::endl;
+    }
+    
+    // Record checksums against a plain memory copy of the same bytes
+    std::vector<std::string> keys, values;
+    for (size_t i = 0; keys.size() < 200000; i++) {
+        keys.push_back(std::to_string(11 + i));
+        values.push_back(std::string(64 + (i * 37) % 1500, (char)('a' + i % 26)));
     }
+    std::vector<StoreLine> lines;
+    for (size_t i = 0; i < keys.size(); i++) {
+        lines.push_back({keys[i].data(), keys[i].size(), values[i].data(), values[i].size()});
+    }
+    StoreChunk all = {0, lines.size(), 0};
+    for (const auto& line : lines) {
+        all.bytes += line.size();
+    }
+    std::string store;
+    formatStoreLines(lines, all, store);
+    std::string copy(store.size(), '\0');
     
-    int size = WideCharToMultiByte(CP_UTF8, 0, pszText, -1, nullptr, 0, nullptr, nullptr);
-    std::string text(size, 0);
-    WideCharToMultiByte(CP_UTF8, 0, pszText, -1, &text[0], size, nullptr, nullptr);
+    auto gigabytesPerSecond = [&store](const std::function<void()>& pass) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < 4; i++) {
+            pass();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return seconds > 0 ? 4.0 * store.size() / seconds / (1 << 30) : 0;
+    };
     
-    GlobalUnlock(hData);
-    CloseClipboard();
+    volatile uint32_t crcSink = 0;
+    StoreCheck check;
+    double copyRate = gigabytesPerSecond([&]() { memcpy(&copy[0], store.data(), store.size()); });
+    double softwareRate = gigabytesPerSecond([&]() { crcSink ^= crc32cSoftware(reinterpret_cast<const uint8_t*>(store.data()), store.size()); });
+    double hardwareRate = 0;
+#ifdef CLIPBOARD_HAVE_AESNI
+    if (crc32cHasHardware()) {
+        hardwareRate = gigabytesPerSecond([&]() { crcSink ^= crc32cHardware(reinterpret_cast<const uint8_t*>(store.data()), store.size()); });
+    }
+#endif
+    double verifyRate = gigabytesPerSecond([&]() { check = StoreCheck(); verifyStoreBuffer(store.data(), store.size(), check); });
+    
+    std::cout << std::endl;
+    std::cout << "  Record checksums, " << store.size() / (1 << 20) << " MB store of " << lines.size() << " records (GB/s)" << std::endl;
+    std::cout << "  memcpy (memory bandwidth) : " << copyRate << std::endl;
+    std::cout << "  CRC32C SSE4.2             : " << (hardwareRate > 0 ? std::to_string(hardwareRate) : "not available") << std::endl;
+    std::cout << "  CRC32C slicing-by-8       : " << softwareRate << std::endl;
+    std::cout << "  Store verification        : " << verifyRate << " (" << check.damaged << " damaged)" << std::endl;
     
-    if (!text.empty() && text.back() == '\0') {
-        text.pop_back();
+    // Slot table against the node map it replaced, with short clipboard-sized values
+    store.clear();
+    store.shrink_to_fit();
+    copy.clear();
+    copy.shrink_to_fit();
+    for (size_t i = 0; i < values.size(); i++) {
+        values[i].assign(16 + (i * 37) % 240, (char)('a' + i % 26));
     }
+    size_t payload = 0;
+    for (size_t i = 0; i < keys.size(); i++) {
+        payload += keys[i].size() + values[i].size();
+    }
+    volatile uint64_t hashSink = 0;
+    auto iterationMs = [&hashSink](const std::function<uint64_t()>& pass) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < 8; i++) {
+            hashSink ^= pass();
+        }
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / 8;
+    };
     
-    return text;
-}
-
-bool setClipboard(const std::string& text) {
-    if (!OpenClipboard(nullptr)) {
-        return false;
+    // Freed heap is reused without showing up again in resident memory, so
+    // the map is measured first and the table reports its own arenas
+    double tableMs, mapMs;
+    size_t tableBytes, mapBytes;
+    size_t before = residentBytes();
+    {
+        std::map<std::string, std::string> table;
+        for (size_t i = 0; i < keys.size(); i++) {
+            table[keys[i]] = values[i];
+        }
+        mapBytes = residentBytes() - before;
+        mapMs = iterationMs([&table]() {
+            uint64_t hash = 0;
+            for (const auto& slot : table) {
+                hash ^= hashContent(slot.second.data(), slot.second.size());
+            }
+            return hash;
+        });
     }
     
-    EmptyClipboard();
+    {
+        SlotTable table;
+        table.reserve(keys.size(), payload);
+        for (size_t i = 0; i < keys.size(); i++) {
+            table.append(keys[i].data(), keys[i].size(), values[i].data(), values[i].size());
+        }
+        table.sortKeys();
+        tableBytes = table.memoryUsage();
+        tableMs = iterationMs([&table]() {
+            uint64_t hash = 0;
+            for (const auto& slot : table) {
+                hash ^= hashContent(slot.valueData, slot.valueLength);
+            }
+            return hash;
+        });
+    }
     
-    int size = MultiByteToWideChar(CP_UTF8, 0, text.c_str(), -1, nullptr, 0);
-    HGLOBAL hMem = GlobalAlloc(GMEM_MOVEABLE, size * sizeof(wchar_t));
-    if (hMem == nullptr) {
-        CloseClipboard();
-        return false;
+    std::cout << std::endl;
+    std::cout << "  Slot storage, " << keys.size() << " slots, " << payload / keys.size() << " payload bytes per slot" << std::endl;
+    std::cout << "                 | Bytes/slot | Full iteration (ms)" << std::endl;
+    char row[160];
+    snprintf(row, sizeof(row), "  std::map       | %10zu | %8.2f", mapBytes / keys.size(), mapMs);
+    std::cout << row << std::endl;
+    snprintf(row, sizeof(row), "  Slot table     | %10zu | %8.2f", tableBytes / keys.size(), tableMs);
+    std::cout << row << std::endl;
+    
+    // Cost of one timed phase with --profile off (every run) and on
+    auto phaseNs = [](size_t count) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < count; i++) {
+            PhaseScope phase("bench");
+        }
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / count;
+    };
+    double phaseOffNs = phaseNs(10000000);
+    g_phaseEpoch = std::chrono::steady_clock::now();
+    g_phaseTracing = true;
+    double phaseOnNs = phaseNs(PHASE_BUFFER_EVENTS / 2);
+    g_phaseTracing = false;
+    std::cout << std::endl;
+    snprintf(row, sizeof(row), "  Phase tracing, ns per timed phase: %.2f off / %.1f on", phaseOffNs, phaseOnNs);
+    std::cout << row << std::endl;
+
+    // Paste transforms, one pass through the whole chain
+    std::string transformText;
+    while (transformText.size() < (8u << 20)) {
+        transformText += "  Lorem ipsum dolor sit amet, consectetur adipiscing \xC3\xA9lit   \r\n";
+    }
+    std::string transformError;
+    parseTransformChain("crlf|rstrip|trim|upper", g_slotTransforms["bench"], transformError);
+    auto transformStart = std::chrono::steady_clock::now();
+    for (int i = 0; i < 4; i++) {
+        std::string content = transformText;
+        transformSlotContent("bench", false, content);
+        hashSink ^= content.size();
     }
+    double transformSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - transformStart).count();
+    g_slotTransforms.erase("bench");
+    snprintf(row, sizeof(row), "  Paste transforms (crlf|rstrip|trim|upper), %zu MB: %.0f MB/s",
+             transformText.size() >> 20, transformSeconds > 0 ? 4.0 * transformText.size() / transformSeconds / (1 << 20) : 0);
+    std::cout << row << std::endl;
     
-    wchar_t* pMem = static_cast<wchar_t*>(GlobalLock(hMem));
-    if (pMem == nullptr) {
-        GlobalFree(hMem);
-        CloseClipboard();
-        return false;
+    // Slot metadata views, used within the last year
+    SlotMetadataTable metadata;
+    int64_t metadataNow = (int64_t)time(nullptr);
+    uint64_t seed = 0x2545F4914F6CDD1DULL;
+    for (uint32_t i = 1; i <= 1000000; i++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        uint32_t metadataRow = metadata.row(i);
+        metadata.lastUsed[metadataRow] = metadataNow - (int64_t)(seed % (365 * 86400));
+        metadata.uses[metadataRow] = (uint32_t)(seed >> 48) % 100;
     }
+    auto timeMetadata = [&hashSink](const std::function<size_t()>& query) {
+        auto queryStart = std::chrono::steady_clock::now();
+        hashSink ^= query();
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - queryStart).count();
+    };
+    size_t unusedCount = 0;
+    double recentMs = timeMetadata([&] { return slotMetadataView(metadata, VIEW_RECENT, metadataNow, 0).size(); });
+    double frequentMs = timeMetadata([&] { return slotMetadataView(metadata, VIEW_FREQUENT, metadataNow, 0).size(); });
+    double unusedMs = timeMetadata([&] { return slotMetadataView(metadata, VIEW_UNUSED, metadataNow, 90).size(); });
+    double countMs = timeMetadata([&] { return unusedCount = countUnusedSlots(metadata, metadataNow, 90); });
+    std::cout << std::endl;
+    std::cout << "  Slot metadata, " << metadata.count() << " slots (ms)" << std::endl;
+    snprintf(row, sizeof(row), "  Most recently used         : %.1f", recentMs);
+    std::cout << row << std::endl;
+    snprintf(row, sizeof(row), "  Most loaded                : %.1f", frequentMs);
+    std::cout << row << std::endl;
+    snprintf(row, sizeof(row), "  Unused for 90 days, sorted : %.1f (%zu slots, counted in %.2f)", unusedMs, unusedCount, countMs);
+    std::cout << row << std::endl;
     
-    MultiByteToWideChar(CP_UTF8, 0, text.c_str(), -1, pMem, size);
-    GlobalUnlock(hMem);
+    // Content classification: only the prefix of a large payload is read
+    std::string classifyPayload;
+    while (classifyPayload.size() < (10u << 20)) {
+        classifyPayload += "for (size_t i = 0; i < count; i++) { total += values[i] * weights[i]; }\n";
+    }
+    ByteClassCounts fullCounts;
+    auto classifyStart = std::chrono::steady_clock::now();
+    for (int i = 0; i < 1000; i++) {
+        hashSink += classifyContent(classifyPayload.data(), classifyPayload.size() - (i & 1));
+    }
+    double classifyUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - classifyStart).count() / 1000;
+    auto scanStart = std::chrono::steady_clock::now();
+    countByteClasses(reinterpret_cast<const unsigned char*>(classifyPayload.data()), classifyPayload.size(), fullCounts);
+    double simdMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - scanStart).count();
+    scanStart = std::chrono::steady_clock::now();
+    countByteClassesPortable(reinterpret_cast<const unsigned char*>(classifyPayload.data()), classifyPayload.size(), fullCounts);
+    double portableMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - scanStart).count();
+    hashSink += fullCounts.code;
+    std::cout << std::endl;
+    snprintf(row, sizeof(row), "  Content classification, %zu MB payload: %.2f us",
+             classifyPayload.size() >> 20, classifyUs);
+    std::cout << row << std::endl;
+    snprintf(row, sizeof(row), "  Byte class scan of the whole payload (ms): %.1f SSE2 / %.1f portable", simdMs, portableMs);
+    std::cout << row << std::endl;
     
-    SetClipboardData(CF_UNICODETEXT, hMem);
-    CloseClipboard();
+    // Delta storage: 200 configuration files with 10 small edits of each
+    std::string benchSaveFile = SAVE_FILE;
+    bool benchDeltaStore = g_deltaStore;
+    SAVE_FILE = benchSaveFile + ".deltabench";
+    std::vector<std::string> deltaConfig;
+    SlotTable deltaSlots;
+    uint64_t deltaSeed = 0x9E3779B97F4A7C15ULL;
+    auto nextRandom = [&deltaSeed]() {
+        deltaSeed ^= deltaSeed << 13;
+        deltaSeed ^= deltaSeed >> 7;
+        deltaSeed ^= deltaSeed << 17;
+        return deltaSeed;
+    };
+    for (int file = 0; file < 200; file++) {
+        std::string base;
+        for (int line = 0; line < 40; line++) {
+            base += "server.pool" + std::to_string(nextRandom() % 50) + ".timeout_ms = " + std::to_string(nextRandom() % 10000) + "\n";
+        }
+        for (int variant = 0; variant < 10; variant++) {
+            std::string content = base;
+            for (int edit = 0; edit < 3; edit++) {
+                content.replace(nextRandom() % (content.size() - 8), 4, std::to_string(nextRandom() % 100000));
+            }
+            std::string key = std::to_string(11 + file * 10 + variant);
+            deltaSlots.set(key, encodeStoredValue(key, content));
+        }
+    }
+    auto timeDeltaStore = [&](bool enabled, double& rewriteMs, double& loadUs) {
+        g_deltaStore = enabled;
+        auto rewriteStart = std::chrono::steady_clock::now();
+        writeStoreFile(deltaConfig, deltaSlots);
+        rewriteMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - rewriteStart).count();
+        long long size = currentStoreStamp().size;
+        auto loadStart = std::chrono::steady_clock::now();
+        for (int i = 0; i < 100; i++) {
+            hashSink += readSlotFromFile(std::to_string(11 + (i * 397) % 2000)).size();
+        }
+        loadUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - loadStart).count() / 100;
+        return size;
+    };
+    double fullRewriteMs, fullLoadUs, deltaRewriteMs, deltaLoadUs, cachedRewriteMs, cachedLoadUs;
+    long long fullSize = timeDeltaStore(false, fullRewriteMs, fullLoadUs);
+    long long deltaSize = timeDeltaStore(true, deltaRewriteMs, deltaLoadUs);
+    timeDeltaStore(true, cachedRewriteMs, cachedLoadUs);
+    size_t deltaCount = g_deltaStats.slots;
+    remove(SAVE_FILE.c_str());
+    SAVE_FILE = benchSaveFile;
+    g_deltaStore = benchDeltaStore;
+    std::cout << std::endl;
+    std::cout << "  Delta storage, " << deltaSlots.size() << " near-duplicate slots (" << deltaCount << " stored as deltas)" << std::endl;
+    snprintf(row, sizeof(row), "  Store size (KB)    : %lld full / %lld with deltas", (fullSize + 1023) / 1024, (deltaSize + 1023) / 1024);
+    std::cout << row << std::endl;
+    snprintf(row, sizeof(row), "  LOAD from file (us): %.0f full / %.0f with deltas", fullLoadUs, deltaLoadUs);
+    std::cout << row << std::endl;
+    snprintf(row, sizeof(row), "  Rewrite (ms)       : %.1f full / %.1f with deltas (%.1f cached)", fullRewriteMs, deltaRewriteMs, cachedRewriteMs);
+    std::cout << row << std::endl;
     
-    return true;
+    // Slot snapshots: readers looking slots up while 100 new snapshots are
+    // published, one per millisecond
+    SlotTable snapshotSlots;
+    for (int i = 1; i <= 10000; i++) {
+        snapshotSlots.set(std::to_string(i), std::string(200, (char)('a' + i % 26)));
+    }
+    unsigned maxReaders = std::max(4u, std::min(std::thread::hardware_concurrency(), (unsigned)SNAPSHOT_MAX_READERS - 1));
+    std::cout << std::endl;
+    std::cout << "  Slot snapshots, " << snapshotSlots.size() << " slots, 100 publishes" << std::endl;
+    std::cout << "   Readers |  Lookups/s | Publish p50 (ms) | Publish p99 (ms)" << std::endl;
+    for (unsigned readers = 0; readers <= maxReaders; readers = readers ? readers * 2 : 1) {
+        std::atomic<bool> stop(false);
+        std::atomic<uint64_t> lookups(0);
+        std::vector<std::thread> threads;
+        for (unsigned r = 0; r < readers; r++) {
+            threads.emplace_back([&stop, &lookups, r] {
+                uint64_t done = 0;
+                uint64_t found = 0;
+                unsigned key = r * 7919;
+                while (!stop.load(std::memory_order_relaxed)) {
+                    SnapshotReader reader;
+                    SlotTable::Entry entry;
+                    key = key % 10000 + 1;
+                    if (reader.get() && reader.get()->slots.findEntry(std::to_string(key), entry)) {
+                        found += entry.valueLength;
+                    }
+                    key += 7919;
+                    done++;
+                }
+                lookups += done + (found == 1);
+            });
+        }
+        std::vector<double> publishMs;
+        auto readStart = std::chrono::steady_clock::now();
+        for (int i = 0; i < 100; i++) {
+            auto publishStart = std::chrono::steady_clock::now();
+            publishSlotSnapshot(snapshotSlots);
+            publishMs.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - publishStart).count());
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        stop = true;
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        double readSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - readStart).count();
+        std::sort(publishMs.begin(), publishMs.end());
+        snprintf(row, sizeof(row), "   %7u | %10.0f | %16.2f | %16.2f", readers, readSeconds > 0 ? lookups / readSeconds : 0,
+                 publishMs[publishMs.size() / 2], publishMs[publishMs.size() * 99 / 100]);
+        std::cout << row << std::endl;
+    }
+    std::cout << "=========================================================" << std::endl;
+    return result;
 }
 
+#ifdef _WIN32
+
 // ========================================
 // SYSTEM TRAY ICON
 // ========================================
@@ -848,245 +10127,23 @@ LRESULT CALLBACK KeyboardProc(int nCode, WPARAM wParam, LPARAM lParam) {
     }
     
     KBDLLHOOKSTRUCT* kbStruct = (KBDLLHOOKSTRUCT*)lParam;
-    int vkCode = kbStruct->vkCode;
+    int vkCode = kbStruct->vkCode & 0xFF;
     bool isKeyDown = (wParam == WM_KEYDOWN || wParam == WM_SYSKEYDOWN);
     bool isKeyUp = (wParam == WM_KEYUP || wParam == WM_SYSKEYUP);
     
-    // ESC to exit
-    if (isKeyDown && vkCode == VK_ESCAPE) {
-        PostMessage(g_hwnd, WM_CLOSE, 0, 0);
-        return 1;
-    }
-    
-    // ========== SPECIAL KEY HANDLING ==========
-    
-    if (vkCode == KEY_SAVE1 || vkCode == KEY_SAVE2 || vkCode == KEY_LOAD) {
-        if (isKeyDown) {
-            if (!keyPressed[vkCode]) {
-                keyPressed[vkCode] = true;
-                actionExecuted[vkCode] = false;
-            }
-            
-            // LOAD + SAVE1 or LOAD + SAVE2 = CLEAR ALL SLOTS (except primary)
-            if ((vkCode == KEY_SAVE1 || vkCode == KEY_SAVE2) && keyPressed[KEY_LOAD] && !isAccumulatingSlot) {
-                clearNonPrimarySlots();
-                addToHistory("OK CLEAR --> All additional slots deleted");
-                refreshDisplay();
-                actionExecuted[KEY_SAVE1] = true;
-                actionExecuted[KEY_SAVE2] = true;
-                actionExecuted[KEY_LOAD] = true;
-                return 1;
-            }
-            
-            // SAVE1 + LOAD or SAVE2 + LOAD = TOGGLE CONSOLE
-            if (vkCode == KEY_LOAD && (keyPressed[KEY_SAVE1] || keyPressed[KEY_SAVE2]) && !isAccumulatingSlot) {
-                toggleConsole();
-                if (g_consoleVisible) {
-                    refreshDisplay();
-                }
-                actionExecuted[KEY_SAVE1] = true;
-                actionExecuted[KEY_SAVE2] = true;
-                actionExecuted[KEY_LOAD] = true;
-                return 1;
-            }
-            
-            return 1;
-        }
-        else if (isKeyUp) {
-            // Release SAVE1 or SAVE2 = SAVE
-            if ((vkCode == KEY_SAVE1 || vkCode == KEY_SAVE2) && isAccumulatingSlot && !currentSlotNumber.empty() && !isClearMode) {
-                // Convert slot according to rules
-                std::string finalSlot = currentSlotNumber;
-                if (currentSlotNumber == "0") {
-                    finalSlot = "10";
-                }
-                
-                // Save
-                std::string clipContent = getClipboard();
-                bool success = writeSlotToFile(finalSlot, clipContent);
-                
-                if (success) {
-                    std::string preview = clipContent;
-                    if (preview.length() > 40) {
-                        preview = preview.substr(0, 37) + "...";
-                    }
-                    for (size_t j = 0; j < preview.length(); j++) {
-                        if (preview[j] == '\n' || preview[j] == '\r' || preview[j] == '\t') {
-                            preview[j] = ' ';
-                        }
-                    }
-                    
-                    std::string action = "OK SAVE --> Slot [" + finalSlot + "] : \"" + preview + "\"";
-                    addToHistory(action);
-                    refreshDisplay();
-                }
-                
-                // Reset accumulation
-                isAccumulatingSlot = false;
-                currentSlotNumber = "";
-                actionExecuted[KEY_SAVE1] = true;
-                actionExecuted[KEY_SAVE2] = true;
-            }
-            
-            // Release LOAD = LOAD or CLEAR
-            if (vkCode == KEY_LOAD && isAccumulatingSlot && !currentSlotNumber.empty()) {
-                // Convert slot according to rules
-                std::string finalSlot = currentSlotNumber;
-                if (currentSlotNumber == "0") {
-                    finalSlot = "10";
-                }
-                
-                if (isClearMode) {
-                    // CLEAR MODE: Empty or delete slot
-                    bool success = clearSpecificSlot(finalSlot);
-                    
-                    if (success) {
-                        // Check if it's a primary slot
-                        bool isPrimary = false;
-                        try {
-                            int num = std::stoi(finalSlot);
-                            if (num >= 1 && num <= 10) {
-                                isPrimary = true;
-                            }
-                        } catch (...) {
-                            isPrimary = false;
-                        }
-                        
-                        if (isPrimary) {
-                            std::string action = "OK CLEAR --> Slot [" + finalSlot + "] emptied";
-                            addToHistory(action);
-                        } else {
-                            std::string action = "OK DELETE --> Slot [" + finalSlot + "] deleted";
-                            addToHistory(action);
-                        }
-                        refreshDisplay();
-                    } else {
-                        std::string action = "XX ERROR --> Slot [" + finalSlot + "] not found";
-                        addToHistory(action);
-                        refreshDisplay();
-                    }
-                } else {
-                    // NORMAL MODE: Load
-                    std::string content = readSlotFromFile(finalSlot);
-                    
-                    if (!content.empty()) {
-                        bool success = setClipboard(content);
-                        if (success) {
-                            std::string preview = content;
-                            if (preview.length() > 40) {
-                                preview = preview.substr(0, 37) + "...";
-                            }
-                            for (size_t j = 0; j < preview.length(); j++) {
-                                if (preview[j] == '\n' || preview[j] == '\r' || preview[j] == '\t') {
-                                    preview[j] = ' ';
-                                }
-                            }
-                            
-                            std::string action = "OK LOAD <-- Slot [" + finalSlot + "] : \"" + preview + "\"";
-                            addToHistory(action);
-                            refreshDisplay();
-                        }
-                    } else {
-                        std::string action = "XX ERROR --> Slot [" + finalSlot + "] is EMPTY";
-                        addToHistory(action);
-                        refreshDisplay();
-                    }
-                }
-                
-                // Reset accumulation and CLEAR mode
-                isAccumulatingSlot = false;
-                currentSlotNumber = "";
-                isClearMode = false;
-                actionExecuted[KEY_LOAD] = true;
-            }
-            
-            keyPressed[vkCode] = false;
-            
-            // If no action was performed, simulate the character
-            if (!actionExecuted[vkCode]) {
-                INPUT input[2] = {};
-                input[0].type = INPUT_KEYBOARD;
-                input[0].ki.wVk = vkCode;
-                input[1].type = INPUT_KEYBOARD;
-                input[1].ki.wVk = vkCode;
-                input[1].ki.dwFlags = KEYEVENTF_KEYUP;
-                SendInput(2, input, sizeof(INPUT));
-            }
-            
-            actionExecuted[vkCode] = false;
-            return 1;
-        }
-    }
-    
-    // ========== C KEY HANDLING (CLEAR MODE) ==========
-    
-    if (vkCode == KEY_CLEAR) {
-        if (isKeyDown && keyPressed[KEY_LOAD] && !keyPressed[vkCode]) {
-            // LOAD + C = Activate CLEAR mode
-            keyPressed[KEY_CLEAR] = true;
-            isClearMode = true;
-            return 1;
-        }
-        else if (isKeyUp) {
-            keyPressed[KEY_CLEAR] = false;
-            return 1;
-        }
-    }
-    
-    // ========== SLOT KEY HANDLING ==========
-    
-    bool isSlotKey = false;
-    std::string slotDigit = "";
-    for (int i = 0; i < 10; i++) {
-        if (vkCode == slotKeys[i]) {
-            isSlotKey = true;
-            if (i == 9) {
-                slotDigit = "0";
-            } else {
-                slotDigit = std::to_string(i + 1);
-            }
-            break;
-        }
-    }
-    
-    if (isSlotKey && isKeyDown) {
-        // Check if SAVE1 or SAVE2 is held (ACCUMULATION for SAVE)
-        if (keyPressed[KEY_SAVE1] || keyPressed[KEY_SAVE2]) {
-            if (!isAccumulatingSlot) {
-                isAccumulatingSlot = true;
-                currentSlotNumber = slotDigit;
-            } else {
-                currentSlotNumber += slotDigit;
-            }
-            
-            actionExecuted[KEY_SAVE1] = true;
-            actionExecuted[KEY_SAVE2] = true;
-            return 1;
-        }
-        // Check if LOAD is held (ACCUMULATION for LOAD)
-        else if (keyPressed[KEY_LOAD]) {
-            if (!isAccumulatingSlot) {
-                isAccumulatingSlot = true;
-                currentSlotNumber = slotDigit;
-            } else {
-                currentSlotNumber += slotDigit;
-            }
-            
-            actionExecuted[KEY_LOAD] = true;
-            return 1;
-        }
+    // Keys of a slot being typed are neither recorded nor taken as chords
+    if (g_typingActive && (kbStruct->flags & LLKHF_INJECTED)) {
+        return CallNextHookEx(g_hook, nCode, wParam, lParam);
     }
     
-    // Block slot keys if a special key is active
-    if (isSlotKey && (keyPressed[KEY_SAVE1] || keyPressed[KEY_SAVE2] || keyPressed[KEY_LOAD])) {
-        return 1;
+    PhaseScope phase("keyboard hook");
+    if (appendTraceRecord(kbStruct->time, vkCode, kbStruct->flags, isKeyDown, isKeyUp)) {
+        queueAction(ACTION_FLUSH_TRACE);
     }
     
-    // Block C key if LOAD is held
-    if (vkCode == KEY_CLEAR && keyPressed[KEY_LOAD]) {
+    if (handleKeyEvent(vkCode, isKeyDown, isKeyUp)) {
         return 1;
     }
-    
     return CallNextHookEx(g_hook, nCode, wParam, lParam);
 }
 
@@ -1109,7 +10166,7 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
             else if (LOWORD(wParam) == ID_TRAY_TOGGLE_CONSOLE) {
                 toggleConsole();
                 if (g_consoleVisible) {
-                    refreshDisplay();
+                    queueAction(ACTION_REFRESH);
                 }
             }
             else if (LOWORD(wParam) == ID_TRAY_ABOUT) {
@@ -1132,6 +10189,17 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
                     "SAVE + LOAD\n\n"
                     "CLEAR ADDITIONAL SLOTS:\n"
                     "LOAD + SAVE\n\n"
+                    "UNDO:\n"
+                    "LOAD + Z\n\n"
+                    "TEMPLATES:\n"
+                    "Hold SAVE + T + slot keys\n"
+                    "-> {date} {time} {clip} {counter} expanded on LOAD\n\n"
+                    "NAMED SLOTS:\n"
+                    "Hold SAVE or LOAD + N + letters/digits\n"
+                    "-> Completion shown in the console title\n\n"
+                    "AUTO SAVE:\n"
+                    "SAVE + A\n"
+                    "-> Next free slot for URLs, paths, numbers, JSON, code or text\n\n"
                     "CONFIGURATION:\n"
                     "Edit clipboard_slots.dat to change keys\n"
                     "KEY_SAVE1, KEY_SAVE2, KEY_LOAD, SLOT_CHARS\n\n"
@@ -1140,12 +10208,34 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
             }
             break;
             
+        case WM_COPYDATA: {
+            // Slot change sent by another instance or tool: "slot\0content"
+            const COPYDATASTRUCT* data = reinterpret_cast<const COPYDATASTRUCT*>(lParam);
+            const char* bytes = static_cast<const char*>(data->lpData);
+            const char* separator = bytes ? static_cast<const char*>(memchr(bytes, '\0', data->cbData)) : nullptr;
+            if (separator == nullptr || (data->dwData != SHARED_OP_SET && data->dwData != SHARED_OP_CLEAR)) {
+                return FALSE;
+            }
+            {
+                std::lock_guard<std::mutex> lock(g_remoteMutex);
+                g_remoteMutations.push_back({(unsigned long)data->dwData, std::string(bytes, separator),
+                                             std::string(separator + 1, bytes + data->cbData)});
+            }
+            queueAction(ACTION_REMOTE);
+            return TRUE;
+        }
+        
         case WM_CLOSE:
         case WM_DESTROY:
             if (g_hook) {
                 UnhookWindowsHookEx(g_hook);
                 g_hook = NULL;
             }
+            stopMaintenance();
+            stopActionWorker();
+            stopTraceRecording();
+            stopPhaseTracing();
+            closeSharedSlots(g_sharedSlots);
             RemoveTrayIcon();
             g_running = false;
             PostQuitMessage(0);
@@ -1162,6 +10252,82 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 // ========================================
 
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow) {
+    // Slot commands from a script: output goes to the calling shell
+    if (__argc > 1 && isSlotCommand(__argv[1])) {
+        if (GetStdHandle(STD_ERROR_HANDLE) == NULL && AttachConsole(ATTACH_PARENT_PROCESS)) {
+            FILE* fCommand;
+            freopen_s(&fCommand, "CONOUT$", "w", stderr);
+            if (GetStdHandle(STD_OUTPUT_HANDLE) == NULL) {
+                freopen_s(&fCommand, "CONOUT$", "w", stdout);
+            }
+        }
+        return runSlotCommands(__argc, __argv);
+    }
+    
+    // Store encoding benchmark
+    if (hasCommandLineFlag(__argc, __argv, "--bench")) {
+        AllocConsole();
+        FILE* fBench;
+        freopen_s(&fBench, "CONOUT$", "w", stdout);
+        freopen_s(&fBench, "CONOUT$", "w", stderr);
+        int result = runBenchmark();
+        system("pause");
+        return result;
+    }
+    
+    // Edge cases of the text, template and store code
+    if (hasCommandLineFlag(__argc, __argv, "--check")) {
+        AllocConsole();
+        FILE* fCheck;
+        freopen_s(&fCheck, "CONOUT$", "w", stdout);
+        freopen_s(&fCheck, "CONOUT$", "w", stderr);
+        int result = runSelfChecks();
+        system("pause");
+        return result;
+    }
+    
+    // Headless replay of a recorded trace
+    std::string replayTrace = commandLineOption(__argc, __argv, "--replay");
+    if (!replayTrace.empty()) {
+        AllocConsole();
+        FILE* fReplay;
+        freopen_s(&fReplay, "CONOUT$", "w", stdout);
+        freopen_s(&fReplay, "CONOUT$", "w", stderr);
+        std::string profile = commandLineOption(__argc, __argv, "--profile");
+        if (!profile.empty()) {
+            startPhaseTracing(profile);
+        }
+        int result = runReplay(replayTrace);
+        stopPhaseTracing();
+        system("pause");
+        return result;
+    }
+    
+    // One sync without the keyboard hook, e.g. from a scheduled task
+    std::string syncDir = commandLineOption(__argc, __argv, "--sync");
+    if (!syncDir.empty()) {
+        AllocConsole();
+        FILE* fSync;
+        freopen_s(&fSync, "CONOUT$", "w", stdout);
+        freopen_s(&fSync, "CONOUT$", "w", stderr);
+        OwnerLock syncLock;
+        if (!tryLockOwner(syncLock)) {
+            std::cout << "XX Clipboard Manager is running: type sync in its console" << std::endl;
+            return 1;
+        }
+        int result = runSyncOnce(syncDir);
+        unlockOwner(syncLock);
+        return result;
+    }
+    
+    // Only one instance owns the slots: a second one would race on the file
+    HANDLE ownerMutex = CreateMutexA(NULL, TRUE, OWNER_MUTEX_NAME);
+    if (ownerMutex != NULL && GetLastError() == ERROR_ALREADY_EXISTS) {
+        MessageBoxA(NULL, "Clipboard Manager is already running.", "Clipboard Manager", MB_ICONINFORMATION);
+        CloseHandle(ownerMutex);
+        return 0;
+    }
+    
     // Create a console VISIBLE at startup
     AllocConsole();
     FILE* fDummy;
@@ -1184,7 +10350,59 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     // INITIALIZE SAVE FILE
     std::cout << "\n[INIT] Initializing save file..." << std::endl;
     initializeSaveFile();
+    
+    // Damaged records are quarantined before anything else reads the store
+    StoreCheck check;
+    auto verifyStart = std::chrono::steady_clock::now();
+    if (verifyStoreFile(check)) {
+        double verifyMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - verifyStart).count();
+        if (check.damaged > 0) {
+            std::vector<std::string> configLines;
+            SlotTable slots;
+            readStoreFile(configLines, slots);
+            std::cout << "XX WARNING: " << check.damaged << " damaged record(s) moved to " << SAVE_FILE << ".quarantine" << std::endl;
+        } else {
+            std::cout << "OK " << check.records << " records verified in " << verifyMs << " ms" << std::endl;
+        }
+    }
+    
+    bool encryptionReady = applyStoreEncryption();
+    loadSlotHistory();
+    loadSlotMetadata();
     std::cout << "OK Save file ready: " << SAVE_FILE << std::endl;
+    if (!encryptionReady) {
+        std::cout << "XX ERROR: Store key unavailable, slots are saved UNENCRYPTED" << std::endl;
+    } else if (g_encryptStore) {
+        std::cout << "OK Slots encrypted (AES-256-GCM, " << (g_storeKey.hardware ? "AES-NI" : "portable") << ")" << std::endl;
+    }
+    
+    // Publish the slots for the console, other instances and tools
+    std::vector<std::string> startupConfigLines;
+    SlotTable startupSlots;
+    bool startupSlotsRead = readStoreFile(startupConfigLines, startupSlots);
+    if (startupSlotsRead) {
+        publishSlotSnapshot(startupSlots);
+    }
+    if (openSharedSlots(g_sharedSlots, true)) {
+        if (startupSlotsRead) {
+            publishSharedSlots(g_sharedSlots, startupSlots);
+        }
+        std::cout << "OK Slots shared with other processes" << std::endl;
+    } else {
+        std::cout << "XX Unable to share slots with other processes" << std::endl;
+    }
+    
+    // Changes made on the other machines while this one was off
+    if (!SYNC_DIR.empty()) {
+        SyncReport report;
+        std::string error;
+        if (runSync(SYNC_DIR, report, error)) {
+            std::cout << "OK Synced with " << SYNC_DIR << ": " << report.received << " slot(s) received, "
+                      << report.sent << " sent" << std::endl;
+        } else {
+            std::cout << "XX Sync failed: " << error << std::endl;
+        }
+    }
     
     std::cout << "\n[CONFIG] Key configuration:" << std::endl;
     std::cout << "  - SAVE1 (save): " << vkToChar(KEY_SAVE1) << " [" << intToHex(KEY_SAVE1) << "]" << std::endl;
@@ -1203,9 +10421,12 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     std::cout << "\n1. SAVE (infinite slots):" << std::endl;
     std::cout << "   Hold SAVE key + number keys" << std::endl;
     std::cout << "   Ex: SAVE + 1 + 2 + 3 then release = slot 123" << std::endl;
+    std::cout << "   SAVE + A = next free slot of the content's bank (url, path, number, json, code, text)" << std::endl;
     std::cout << "\n2. LOAD (infinite slots):" << std::endl;
     std::cout << "   Hold LOAD key + number keys" << std::endl;
     std::cout << "   Ex: LOAD + 4 + 5 then release = slot 45" << std::endl;
+    std::cout << "   Hold LOAD + K + number keys to type the slot instead (apps without clipboard)" << std::endl;
+    std::cout << "   Hold LOAD + X + number keys to load it with the TRANSFORM|chord clean-up" << std::endl;
     std::cout << "\n3. CLEAR A SLOT:" << std::endl;
     std::cout << "   Hold LOAD + C + number keys" << std::endl;
     std::cout << "   Ex: LOAD + C + 1 + 1 then release = clear slot 11" << std::endl;
@@ -1213,14 +10434,28 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     std::cout << "   SAVE + LOAD" << std::endl;
     std::cout << "\n5. CLEAR ADDITIONAL SLOTS:" << std::endl;
     std::cout << "   LOAD + SAVE" << std::endl;
-    std::cout << "\n6. CONFIGURATION:" << std::endl;
+    std::cout << "\n6. UNDO:" << std::endl;
+    std::cout << "   LOAD + Z (last SAVE, CLEAR, CLEAR ALL or range operation)" << std::endl;
+    std::cout << "\n7. NAMED SLOTS:" << std::endl;
+    std::cout << "   Hold SAVE or LOAD + N + letters/digits" << std::endl;
+    std::cout << "   Ex: SAVE + N + S + Q + L then release = slot named sql" << std::endl;
+    std::cout << "\n8. TEMPLATES:" << std::endl;
+    std::cout << "   Hold SAVE + T + number keys" << std::endl;
+    std::cout << "   {date} {time} {clip} {counter} are replaced on LOAD" << std::endl;
+    std::cout << "\n9. RANGES:" << std::endl;
+    std::cout << "   Hold LOAD + R + M/C/S/D + numbers separated by R" << std::endl;
+    std::cout << "   Or type in this console: move 11-500 12, copy 20-29 120, swap 3 7, delete 1000-9999" << std::endl;
+    std::cout << "   Type sync to exchange slots with SYNC_DIR" << std::endl;
+    std::cout << "   Type recent, frequent, unused 90 or numbers to reorder the slots" << std::endl;
+    std::cout << "   Type find <text> to list the slots containing it" << std::endl;
+    std::cout << "\n10. CONFIGURATION:" << std::endl;
     std::cout << "   Edit " << SAVE_FILE << " to customize keys" << std::endl;
-    std::cout << "\n7. EXIT:" << std::endl;
+    std::cout << "\n11. EXIT:" << std::endl;
     std::cout << "   ESC key" << std::endl;
     std::cout << "\n=========================================================" << std::endl;
     
     // Create window class
-    const char CLASS_NAME[] = "ClipboardManager";
+    const char CLASS_NAME[] = WINDOW_CLASS_NAME;
     WNDCLASSA wc = {};
     wc.lpfnWndProc = WindowProc;
     wc.hInstance = hInstance;
@@ -1239,6 +10474,30 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     // Add system tray icon
     AddTrayIcon(g_hwnd);
     
+    // Optional phase timings (--profile <file.json>), written on exit
+    g_phaseThreadName = "main (hook)";
+    g_phaseReservedBuffer = PHASE_BUFFER_HOOK;
+    std::string profile = commandLineOption(__argc, __argv, "--profile");
+    if (!profile.empty()) {
+        startPhaseTracing(profile);
+        std::cout << "OK Timing action phases to " << profile << " (written on exit)" << std::endl;
+    }
+    
+    // Start the action worker before the hook can queue anything
+    startActionWorker();
+    startMaintenance();
+    std::thread(consoleCommandLoop).detach();
+    
+    // Optional key trace (--record <file>)
+    std::string recordTrace = commandLineOption(__argc, __argv, "--record");
+    if (!recordTrace.empty()) {
+        if (startTraceRecording(recordTrace)) {
+            std::cout << "OK Recording key events to " << recordTrace << std::endl;
+        } else {
+            std::cout << "XX Unable to record key events to " << recordTrace << std::endl;
+        }
+    }
+    
     // Install keyboard hook
     g_hook = SetWindowsHookEx(WH_KEYBOARD_LL, KeyboardProc, hInstance, 0);
     if (!g_hook) {
@@ -1263,4 +10522,52 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     }
     
     return 0;
-}
\ No newline at end of file
+}
+
+#else
+
+// ========================================
+// MAIN FUNCTION (HEADLESS)
+// ========================================
+// Without the Win32 API there is no clipboard or keyboard hook: only the
+// trace replay harness, the benchmark and one-shot sync are available
+
+int main(int argc, char** argv) {
+    if (argc > 1 && isSlotCommand(argv[1])) {
+        return runSlotCommands(argc, argv);
+    }
+    std::string replayTrace = commandLineOption(argc, argv, "--replay");
+    if (!replayTrace.empty()) {
+        std::string profile = commandLineOption(argc, argv, "--profile");
+        if (!profile.empty()) {
+            startPhaseTracing(profile);
+        }
+        int result = runReplay(replayTrace);
+        stopPhaseTracing();
+        return result;
+    }
+    if (hasCommandLineFlag(argc, argv, "--bench")) {
+        return runBenchmark();
+    }
+    if (hasCommandLineFlag(argc, argv, "--check")) {
+        return runSelfChecks();
+    }
+    std::string syncDir = commandLineOption(argc, argv, "--sync");
+    if (!syncDir.empty()) {
+        OwnerLock syncLock;
+        if (!tryLockOwner(syncLock)) {
+            std::cout << "XX ERROR: Slots locked by another instance" << std::endl;
+            return 1;
+        }
+        int result = runSyncOnce(syncDir);
+        unlockOwner(syncLock);
+        return result;
+    }
+    
+    std::cerr << "Usage: clipboard_manager --replay <trace> [--profile <file.json>] | --bench | --check | --sync <dir> |" << std::endl;
+    std::cerr << "       --get <slot> | --set <slot> (content on stdin) | --clear <slot> ..." << std::endl;
+    std::cerr << "(the keyboard hook and clipboard require Windows)" << std::endl;
+    return 1;
+}
+
+#endif